@@ -14,6 +14,10 @@ public:
     return __builtin_ctz(v);
   }
 
+  static inline uint32_t CountLeadingZeros(uint32_t v) {
+    return __builtin_clz(v);
+  }
+
 #if JAVELIN_USE_CUSTOM_POP_COUNT
   static uint32_t PopCount(uint32_t v);
 #else
@@ -27,6 +31,10 @@ public:
     return __builtin_ctzll(v);
   }
 
+  static inline uint64_t CountLeadingZeros(uint64_t v) {
+    return __builtin_clzll(v);
+  }
+
   static inline uint64_t PopCount(uint64_t v) {
     return __builtin_popcountll(v);
   }
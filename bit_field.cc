@@ -32,4 +32,24 @@ TEST_BEGIN("BitField: Set bits iterate properly") {
 }
 TEST_END
 
+TEST_BEGIN("BitField: FindPrevious finds the highest set bit below n") {
+  BitField<256> bitfield;
+  bitfield.ClearAll();
+  assert(bitfield.FindPrevious(256) == size_t(-1));
+
+  bitfield.Set(0);
+  bitfield.Set(63);
+  bitfield.Set(64);
+  bitfield.Set(200);
+  assert(bitfield.FindPrevious(256) == 200);
+  assert(bitfield.FindPrevious(201) == 200);
+  assert(bitfield.FindPrevious(200) == 64);
+  assert(bitfield.FindPrevious(65) == 64);
+  assert(bitfield.FindPrevious(64) == 63);
+  assert(bitfield.FindPrevious(63) == 0);
+  assert(bitfield.FindPrevious(1) == 0);
+  assert(bitfield.FindPrevious(0) == size_t(-1));
+}
+TEST_END
+
 //---------------------------------------------------------------------------
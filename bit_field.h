@@ -71,6 +71,25 @@ public:
     return value << topClearShift >> (bottomClearShift + topClearShift);
   }
 
+  // Returns the index of the highest set bit below n, or -1 if there is none.
+  size_t FindPrevious(size_t n) const {
+    size_t wordIndex = n / BITS_PER_WORD;
+    if (const size_t bitOffset = n % BITS_PER_WORD; bitOffset != 0) {
+      const size_t value = data[wordIndex] << (BITS_PER_WORD - bitOffset);
+      if (value != 0) {
+        return n - 1 - Bit<sizeof(size_t)>::CountLeadingZeros(value);
+      }
+    }
+    while (wordIndex != 0) {
+      const size_t value = data[--wordIndex];
+      if (value != 0) {
+        return (wordIndex + 1) * BITS_PER_WORD - 1 -
+               Bit<sizeof(size_t)>::CountLeadingZeros(value);
+      }
+    }
+    return -1;
+  }
+
   void Set(size_t n) { data[n / BITS_PER_WORD] |= 1ULL << n % BITS_PER_WORD; }
   void Clear(size_t n) {
     data[n / BITS_PER_WORD] &= ~(1ULL << n % BITS_PER_WORD);
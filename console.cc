@@ -10,7 +10,11 @@
 
 //---------------------------------------------------------------------------
 
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
 ConsoleWriter::ClassData ConsoleWriter::classData = {
+#else
+thread_local ConsoleWriter::ClassData ConsoleWriter::classData = {
+#endif
     {nullptr, nullptr, nullptr, nullptr},
     0,
     &ConsoleWriter::instance,
@@ -51,14 +55,14 @@ ConsoleWriter::SetConnection(ConnectionId connectionId,
 
 Console Console::instance;
 
-static const ConsoleCommand HELP_COMMAND = {
+static constexpr ConsoleCommand HELP_COMMAND = {
     .command = "help",
     .description = "Provides a list of commands",
     .handler = &Console::HelpCommand,
     .context = nullptr,
 };
 
-static const ConsoleCommand HELLO_COMMAND = {
+static constexpr ConsoleCommand HELLO_COMMAND = {
     .command = "hello",
     .description = "Used to initiate a stable communication channel",
     .handler = &Console::HelloCommand,
@@ -74,9 +78,88 @@ static ConsoleCommand commands[MAX_COMMAND_COUNT] = {
 
 //---------------------------------------------------------------------------
 
+// Open addressing hash table of command indexes, keyed by command name.
+//
+// Commands are added as they are registered rather than on first use, since
+// hosts can run commands from several engine threads at once.
+class ConsoleCommandIndex {
+public:
+  constexpr ConsoleCommandIndex() {
+    Add(HELLO_COMMAND.command, 0);
+    Add(HELP_COMMAND.command, 1);
+  }
+
+  // Matches the first word of line.
+  const ConsoleCommand *Find(const char *line) const {
+    size_t length = 0;
+    while (!Unicode::IsWhitespace(uint8_t(line[length]))) {
+      ++length;
+    }
+
+    for (size_t slot = GetSlot(line, length);; slot = (slot + 1) % SIZE) {
+      const uint8_t entry = slots[slot];
+      if (entry == 0) {
+        return nullptr;
+      }
+      const ConsoleCommand &command = commands[entry - 1];
+      if (strncmp(line, command.command, length) == 0 &&
+          command.command[length] == '\0') {
+        return &command;
+      }
+    }
+  }
+
+  // Earlier registrations of the same name take precedence.
+  void Register(size_t index) {
+    const char *name = commands[index].command;
+    for (const char *p = name; *p; ++p) {
+      if (Unicode::IsWhitespace(uint8_t(*p))) {
+        isComplete = false;
+        return;
+      }
+    }
+    if (!Find(name)) {
+      Add(name, index);
+    }
+  }
+
+  // False if a command name can't be looked up by its first word.
+  bool IsComplete() const { return isComplete; }
+
+private:
+  static const size_t SIZE = 2 * MAX_COMMAND_COUNT;
+
+  bool isComplete = true;
+
+  // Command index + 1, or 0 for an empty slot.
+  uint8_t slots[SIZE] = {};
+
+  static constexpr size_t GetSlot(const char *name, size_t length) {
+    return Str::Hash(name, length) % SIZE;
+  }
+
+  constexpr void Add(const char *name, size_t index) {
+    size_t length = 0;
+    while (name[length]) {
+      ++length;
+    }
+    size_t slot = GetSlot(name, length);
+    while (slots[slot] != 0) {
+      slot = (slot + 1) % SIZE;
+    }
+    slots[slot] = index + 1;
+  }
+};
+
+static constinit ConsoleCommandIndex commandIndex;
+
+//---------------------------------------------------------------------------
+
 void Console::RegisterCommand(const ConsoleCommand &command) {
   assert(commandCount < MAX_COMMAND_COUNT);
-  commands[commandCount++] = command;
+  commands[commandCount] = command;
+  commandIndex.Register(commandCount);
+  commandCount++;
 }
 
 void Console::RegisterCommand(const char *command, const char *description,
@@ -87,6 +170,7 @@ void Console::RegisterCommand(const char *command, const char *description,
   commands[commandCount].description = description;
   commands[commandCount].handler = handler;
   commands[commandCount].context = context;
+  commandIndex.Register(commandCount);
   commandCount++;
 }
 
@@ -210,6 +294,10 @@ void Console::ProcessLineBuffer() {
 }
 
 const ConsoleCommand *Console::GetCommand(const char *buffer) {
+  if (commandIndex.IsComplete()) {
+    return commandIndex.Find(buffer);
+  }
+
   for (size_t i = 0; i < commandCount; ++i) {
     if (Str::HasPrefix(buffer, commands[i].command) &&
         Unicode::IsWhitespace(buffer[strlen(commands[i].command)])) {
@@ -268,6 +356,33 @@ TEST_BEGIN("Console should handle invalid commands") {
 }
 TEST_END
 
+static void CountCommand(void *context, const char *line) {
+  ++*(size_t *)context;
+}
+
+TEST_BEGIN("Console should find registered commands by their first word") {
+  size_t firstCount = 0;
+  size_t secondCount = 0;
+  Console::RegisterCommand("test_count", "", CountCommand, &firstCount);
+  Console::RegisterCommand("test_count", "", CountCommand, &secondCount);
+  Console::RegisterCommand("test_count_other", "", CountCommand,
+                           &secondCount);
+
+  assert(Console::RunCommand("test_count", ConsoleWriter::instance));
+  assert(Console::RunCommand("test_count 1 2", ConsoleWriter::instance));
+  assert(Console::RunCommand("test_count\t1", ConsoleWriter::instance));
+  assert(firstCount == 3);
+  assert(secondCount == 0);
+
+  assert(Console::RunCommand("test_count_other", ConsoleWriter::instance));
+  assert(secondCount == 1);
+
+  assert(!Console::RunCommand("test_coun", ConsoleWriter::instance));
+  assert(!Console::RunCommand("test_counts", ConsoleWriter::instance));
+  assert(!Console::RunCommand("", ConsoleWriter::instance));
+}
+TEST_END
+
 #endif
 
 //---------------------------------------------------------------------------
@@ -48,7 +48,32 @@ private:
     size_t count;
     IWriter *active;
   };
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
   static ClassData classData;
+#else
+  // Hosts can run independent engines on separate threads, each with their
+  // own console writer.
+  static thread_local ClassData classData;
+#endif
+};
+
+// Makes writer the active console writer for the lifetime of the sentry.
+// A null writer leaves the active console writer unchanged.
+class ConsoleWriterSentry {
+public:
+  ConsoleWriterSentry(IWriter *writer) : writer(writer) {
+    if (writer) {
+      ConsoleWriter::Push(writer);
+    }
+  }
+  ~ConsoleWriterSentry() {
+    if (writer) {
+      ConsoleWriter::Pop();
+    }
+  }
+
+private:
+  IWriter *writer;
 };
 
 //---------------------------------------------------------------------------
@@ -11,8 +11,12 @@
 
 const char StenoDictionary::SPACES[SPACES_COUNT + 1] = "                ";
 
-#if ENABLE_DICTIONARY_STATS
+#if RECORD_DICTIONARY_STATS
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
 StenoDictionary::Stats StenoDictionary::stats;
+#else
+thread_local StenoDictionary::Stats StenoDictionary::stats;
+#endif
 #endif
 
 //---------------------------------------------------------------------------
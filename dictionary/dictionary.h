@@ -13,6 +13,15 @@
 
 #define ENABLE_DICTIONARY_STATS 0
 
+// Stats are always recorded on test builds, where they are used to check the
+// engine cost model. ENABLE_DICTIONARY_STATS additionally prints them after
+// each stroke.
+#if ENABLE_DICTIONARY_STATS || RUN_TESTS
+#define RECORD_DICTIONARY_STATS 1
+#else
+#define RECORD_DICTIONARY_STATS 0
+#endif
+
 //---------------------------------------------------------------------------
 
 class BufferWriter;
@@ -320,7 +329,7 @@ public:
   virtual bool DisableDictionary(const char *name) { return false; }
   virtual bool ToggleDictionary(const char *name) { return false; }
 
-#if ENABLE_DICTIONARY_STATS
+#if RECORD_DICTIONARY_STATS
   struct Stats {
     size_t lookupCount;
     size_t reverseLookupCount;
@@ -333,7 +342,11 @@ public:
     }
   };
 
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
   static Stats stats;
+#else
+  static thread_local Stats stats;
+#endif
 
   static void ResetStats() { stats.Reset(); }
   static size_t GetLookupCount() { return stats.lookupCount; }
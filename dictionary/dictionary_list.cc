@@ -33,7 +33,7 @@ StenoDictionaryList::StenoDictionaryList(StenoDictionary *const *dictionaries,
 
 StenoDictionaryLookupResult
 StenoDictionaryList::Lookup(const StenoDictionaryLookup &lookup) const {
-#if ENABLE_DICTIONARY_STATS
+#if RECORD_DICTIONARY_STATS
   stats.lookupCount++;
 #endif
   for (const StenoDictionaryListEntry &entry : dictionaries) {
@@ -51,7 +51,7 @@ StenoDictionaryList::Lookup(const StenoDictionaryLookup &lookup) const {
 
 const StenoDictionary *StenoDictionaryList::GetDictionaryForOutline(
     const StenoDictionaryLookup &lookup) const {
-#if ENABLE_DICTIONARY_STATS
+#if RECORD_DICTIONARY_STATS
   stats.dictionaryForOutlineCount++;
 #endif
   for (const StenoDictionaryListEntry &entry : dictionaries) {
@@ -73,7 +73,7 @@ const StenoDictionary *StenoDictionaryList::GetDictionaryForOutline(
 
 void StenoDictionaryList::ReverseLookup(
     StenoReverseDictionaryLookup &lookup) const {
-#if ENABLE_DICTIONARY_STATS
+#if RECORD_DICTIONARY_STATS
   stats.reverseLookupCount++;
 #endif
   for (const StenoDictionaryListEntry &entry : dictionaries) {
@@ -10,9 +10,9 @@
 StenoReverseAutoSuffixDictionary::StenoReverseAutoSuffixDictionary(
     StenoDictionary *dictionary, const StenoCompiledOrthography &orthography)
     : StenoWrappedDictionary(dictionary), orthography(orthography) {
-  for (const StenoOrthographyReverseAutoSuffix &reverseAutoSuffix :
-       orthography.data.reverseAutoSuffixes) {
-    AddTest(reverseAutoSuffix);
+  for (size_t i = 0; i < orthography.data.reverseAutoSuffixes.GetCount();
+       ++i) {
+    AddTest(i);
   }
 
   for (const AutoSuffixTest &test : tests) {
@@ -20,8 +20,9 @@ StenoReverseAutoSuffixDictionary::StenoReverseAutoSuffixDictionary(
   }
 }
 
-void StenoReverseAutoSuffixDictionary::AddTest(
-    const StenoOrthographyReverseAutoSuffix &reverseAutoSuffix) {
+void StenoReverseAutoSuffixDictionary::AddTest(size_t index) {
+  const StenoOrthographyReverseAutoSuffix &reverseAutoSuffix =
+      orthography.data.reverseAutoSuffixes[index];
   for (AutoSuffixTest &test : tests) {
     if (test.testPattern == reverseAutoSuffix.testPattern &&
         test.replacement == reverseAutoSuffix.replacement &&
@@ -37,7 +38,7 @@ void StenoReverseAutoSuffixDictionary::AddTest(
   test.replacement = reverseAutoSuffix.replacement;
   test.text = reverseAutoSuffix.autoSuffix->text;
   test.textLength = Str::Length(test.text);
-  test.reversePattern = Pattern::Compile(reverseAutoSuffix.testPattern);
+  test.reversePattern = orthography.CreateReverseAutoSuffixPattern(index);
   test.replacements.Add(&reverseAutoSuffix);
   tests.Add(test);
 }
@@ -44,7 +44,8 @@ private:
 
   List<AutoSuffixTest> tests;
 
-  void AddTest(const StenoOrthographyReverseAutoSuffix &reverseAutoSuffix);
+  // Adds data.reverseAutoSuffixes[index] from orthography.
+  void AddTest(size_t index);
 
   void ProcessReverseAutoSuffix(StenoReverseDictionaryLookup &lookup,
                                 const AutoSuffixTest &test) const;
@@ -34,11 +34,15 @@ void StenoEngine::TemplateValue::Set(char *newValue) {
 
 StenoEngine::StenoEngine(StenoDictionary &dictionary,
                          const StenoCompiledOrthography &orthography,
-                         StenoUserDictionary *userDictionary)
-    : dictionary(dictionary), orthography(orthography),
-      userDictionary(userDictionary) {
-  previousConversionBuffer.Prepare(&this->orthography, &this->dictionary);
-  nextConversionBuffer.Prepare(&this->orthography, &this->dictionary);
+                         StenoUserDictionary *userDictionary,
+                         StenoEngineContext &context)
+    : context(context), dictionary(dictionary),
+      orthography(orthography, context), userDictionary(userDictionary),
+      emitter(context) {
+  previousConversionBuffer.Prepare(&this->orthography, &this->dictionary,
+                                   &context);
+  nextConversionBuffer.Prepare(&this->orthography, &this->dictionary,
+                               &context);
   ResetState();
 }
 
@@ -60,6 +64,7 @@ void StenoEngine::Process(const StenoKeyState &value, StenoAction action) {
 
 void StenoEngine::ProcessStroke(StenoStroke stroke) {
   const ExternalFlashSentry externalFlashSentry;
+  const ConsoleWriterSentry consoleWriterSentry(context.GetConsoleWriter());
 
   switch (mode) {
   case StenoEngineMode::NORMAL:
@@ -78,6 +83,7 @@ void StenoEngine::ProcessStroke(StenoStroke stroke) {
 
 void StenoEngine::ProcessUndo() {
   const ExternalFlashSentry externalFlashSentry;
+  const ConsoleWriterSentry consoleWriterSentry(context.GetConsoleWriter());
 
   switch (mode) {
   case StenoEngineMode::NORMAL:
@@ -102,11 +108,13 @@ bool StenoEngine::ProcessScanCode(uint32_t scanCodeAndModifiers,
 
   case StenoEngineMode::ADD_TRANSLATION: {
     const ExternalFlashSentry externalFlashSentry;
+    const ConsoleWriterSentry consoleWriterSentry(context.GetConsoleWriter());
     return HandleAddTranslationModeScanCode(scanCodeAndModifiers, action);
   }
 
   case StenoEngineMode::CONSOLE: {
     const ExternalFlashSentry externalFlashSentry;
+    const ConsoleWriterSentry consoleWriterSentry(context.GetConsoleWriter());
     return HandleConsoleModeScanCode(scanCodeAndModifiers, action);
   }
   }
@@ -118,6 +126,7 @@ bool StenoEngine::ProcessScanCode(uint32_t scanCodeAndModifiers,
 void StenoEngine::ResetState() {
   history.Reset();
   altTranslationHistory.Reset();
+  undoSnapshots.Reset();
   state.Reset();
   state.joinNext = true;
 }
@@ -128,7 +137,7 @@ void StenoEngine::PrintInfo() const {
   Console::Printf("  Javelin Steno Engine\n");
   Console::Printf("    Strokes: %zu\n", strokeCount);
   Console::Printf("    Host layout: %s\n",
-                  HostLayouts::GetActiveLayout().GetName());
+                  context.GetHostLayout().GetName());
   Console::Printf("    Space position: %s\n",
                   placeSpaceAfter ? "after" : "before");
 
@@ -233,6 +242,10 @@ __attribute__((weak)) void StenoEngine::Pump() {}
 #include "dictionary/test_dictionary.h"
 #include "dictionary/unicode_dictionary.h"
 #include "dictionary/user_dictionary.h"
+#include "engine_cost_baseline.h"
+#include "malloc_count.h"
+#include "stroke_list_parser.h"
+#include <string>
 
 extern StenoOrthography testOrthography;
 
@@ -256,6 +269,8 @@ public:
   static void TestScancodeAddTranslation(StenoEngine &engine);
   static void TestRetroInsertSpace(StenoEngine &engine);
   static void TestRetroInsertSpaceAutoSuffix(StenoEngine &engine);
+  static void TestUndoSnapshots(StenoEngine &engine,
+                                StenoEngine &conversionEngine);
   static void VerifyTextBuffer(StenoEngine &engine, const char *expected);
 };
 
@@ -535,6 +550,339 @@ TEST_BEGIN("Engine: Verify =retro_insert_space with auto-suffix") {
 }
 TEST_END
 
+TEST_BEGIN("Engine: Text writer receives text changes") {
+  uint8_t *buffer = new uint8_t[512 * 1024];
+  memset(buffer, 0, 512 * 1024);
+  const StenoUserDictionaryData layout(buffer, 512 * 1024);
+  StenoUserDictionary userDictionary(layout);
+
+  const StenoStroke catStroke("KAT");
+  userDictionary.Add(&catStroke, 1, "cat");
+  const StenoStroke dogStroke("TKOG");
+  userDictionary.Add(&dogStroke, 1, "dog");
+
+  const StenoCompiledOrthography orthography(
+      StenoOrthography::emptyOrthography);
+  StenoEngine engine(userDictionary, orthography);
+
+  BufferWriter writer;
+  engine.SetTextWriter(&writer);
+  engine.ProcessStroke(StenoStroke("KAT"));
+  engine.ProcessStroke(StenoStroke("TKOG"));
+  engine.ProcessUndo();
+
+  char *text = writer.TerminateStringAndAdoptBuffer();
+  assert(Str::Eq(text, "cat dog\b\b\b\b"));
+  free(text);
+
+  delete[] buffer;
+}
+TEST_END
+
+// Applies text writer output, so that engines can be compared by the text
+// they leave on the host.
+class ScreenWriter final : public IWriter {
+public:
+  std::string text;
+
+  void Write(const char *data, size_t length) final {
+    for (size_t i = 0; i < length; ++i) {
+      if (data[i] != '\b') {
+        text.push_back(data[i]);
+      } else if (!text.empty()) {
+        text.pop_back();
+      }
+    }
+  }
+};
+
+void StenoEngineTester::TestUndoSnapshots(StenoEngine &engine,
+                                          StenoEngine &conversionEngine) {
+  static const char *const STROKES[] = {
+      "KAT", "TKOG", "-S", "-G", "TEFT", "TP-PL", "KPA", "THE",
+  };
+  const size_t strokeCount = sizeof(STROKES) / sizeof(*STROKES);
+
+  ScreenWriter writer;
+  ScreenWriter conversionWriter;
+  engine.SetTextWriter(&writer);
+  conversionEngine.SetTextWriter(&conversionWriter);
+
+  const auto processUndo = [&]() {
+    conversionEngine.undoSnapshots.Reset();
+    engine.ProcessUndo();
+    conversionEngine.ProcessUndo();
+    assert(writer.text == conversionWriter.text);
+  };
+  const auto processStroke = [&](const char *text) {
+    StenoStroke stroke;
+    stroke.Set(text);
+    engine.ProcessStroke(stroke);
+    conversionEngine.ProcessStroke(stroke);
+    assert(writer.text == conversionWriter.text);
+  };
+
+  srand(0x5678);
+  for (size_t i = 0; i < 2000; ++i) {
+    if (rand() % 3 == 0) {
+      processUndo();
+    } else {
+      processStroke(STROKES[rand() % strokeCount]);
+    }
+  }
+
+  // Undo past the end of the snapshots.
+  for (size_t i = 0; i < 2 * JAVELIN_UNDO_SNAPSHOT_COUNT; ++i) {
+    processStroke(STROKES[i % strokeCount]);
+  }
+  for (size_t i = 0; i < 2 * JAVELIN_UNDO_SNAPSHOT_COUNT; ++i) {
+    processUndo();
+  }
+
+  processStroke("KAT");
+  StenoDictionary::ResetStats();
+  engine.ProcessUndo();
+  assert(StenoDictionary::GetLookupCount() == 0);
+}
+
+TEST_BEGIN("Engine: Undo snapshots match conversion") {
+  uint8_t *buffer = new uint8_t[512 * 1024];
+  memset(buffer, 0, 512 * 1024);
+  const StenoUserDictionaryData layout(buffer, 512 * 1024);
+  StenoUserDictionary userDictionary(layout);
+
+  static const char *const ENTRIES[][2] = {
+      {"KAT", "cat"},   {"TKOG", "dog"},       {"-S", "{^s}"},
+      {"-G", "{^ing}"}, {"TEFT", "test"},      {"TEFT/-G", "testing"},
+      {"TP-PL", "{.}"}, {"KPA", "{}{-|}"},     {"THE", "the"},
+      {"KAT/TKOG", "catalog"},
+  };
+  for (const auto &entry : ENTRIES) {
+    StrokeListParser parser;
+    parser.Parse(entry[0]);
+    userDictionary.Add(parser.strokes, parser.length, entry[1]);
+  }
+
+  const StenoCompiledOrthography orthography(testOrthography);
+  StenoEngine engine(userDictionary, orthography);
+  StenoEngine conversionEngine(userDictionary, orthography);
+  StenoEngineTester::TestUndoSnapshots(engine, conversionEngine);
+
+  delete[] buffer;
+}
+TEST_END
+
+TEST_BEGIN("Engine: Contexts are independent") {
+  uint8_t *buffer = new uint8_t[512 * 1024];
+  memset(buffer, 0, 512 * 1024);
+  const StenoUserDictionaryData layout(buffer, 512 * 1024);
+  StenoUserDictionary userDictionary(layout);
+
+  const StenoStroke catsStroke("KAT");
+  userDictionary.Add(&catsStroke, 1, "cats");
+  const StenoStroke suffixStroke("-S");
+  userDictionary.Add(&suffixStroke, 1, "{^s}");
+
+  static const uint8_t WORD_LIST_DATA[] = {0xf0, 'c', 'a', 't', 's', 's', 0xf5};
+  const WordList wordList(WORD_LIST_DATA, sizeof(WORD_LIST_DATA));
+  BufferWriter consoleWriter;
+  StenoEngineContext context(wordList, HostLayout::ansi, &consoleWriter);
+
+  const StenoCompiledOrthography orthography(testOrthography);
+  StenoEngine defaultEngine(userDictionary, orthography);
+  StenoEngine contextEngine(userDictionary, orthography, nullptr, context);
+  defaultEngine.EnablePaperTape();
+  contextEngine.EnablePaperTape();
+
+  Console::history.clear();
+  defaultEngine.ProcessStroke(StenoStroke("KAT"));
+  defaultEngine.ProcessStroke(StenoStroke("-S"));
+  contextEngine.ProcessStroke(StenoStroke("KAT"));
+  contextEngine.ProcessStroke(StenoStroke("-S"));
+
+  StenoEngineTester::VerifyTextBuffer(defaultEngine, "catles");
+  StenoEngineTester::VerifyTextBuffer(contextEngine, "catss");
+
+  char *consoleText = consoleWriter.TerminateStringAndAdoptBuffer();
+  assert(strstr(consoleText, "paper_tape") != nullptr);
+  free(consoleText);
+  assert(Console::history.size() > 0);
+
+  delete[] buffer;
+}
+TEST_END
+
+TEST_BEGIN("Engine: Profile records each stroke when enabled") {
+  StenoDictionaryList dictionaryList(
+      DICTIONARIES, sizeof(DICTIONARIES) / sizeof(*DICTIONARIES)); // NOLINT
+  const StenoCompiledOrthography orthography(testOrthography);
+  StenoEngine engine(dictionaryList, orthography);
+
+  const StenoEngineProfile &profile = engine.GetProfile();
+  engine.ProcessStroke(StenoStroke("KAT"));
+  assert(profile.GetHistogram(StenoProfileStage::TOTAL).GetCount() == 0);
+
+  engine.GetProfile().Enable();
+  engine.ProcessStroke(StenoStroke("KAT"));
+  engine.ProcessStroke(StenoStroke("TKOG"));
+  for (size_t i = 0; i < (size_t)StenoProfileStage::COUNT; ++i) {
+    assert(profile.GetHistogram((StenoProfileStage)i).GetCount() == 2);
+  }
+
+  Console::history.clear();
+  profile.PrintJson();
+  Console::history.push_back('\0');
+  assert(strstr(&Console::history[0], "\"total\":{\"count\":2,") != nullptr);
+
+  engine.GetProfile().Disable();
+  engine.ProcessStroke(StenoStroke("KAT"));
+  assert(profile.GetHistogram(StenoProfileStage::TOTAL).GetCount() == 2);
+}
+TEST_END
+
+// Replays a fixed corpus and compares operation counts with
+// engine_cost_baseline.h. Unlike timings, the counts are deterministic, so
+// regressions are caught on any machine.
+TEST_BEGIN("Engine: Cost model") {
+  static const StenoOrthographyRule RULES[] = {
+      {"^(.*)e \\^(ed|ing|er)$", "\\1\\2"},
+      {"^(.*[bcdfghjklmnpqrstvwxz])y \\^s$", "\\1ies"},
+      {"^(.*)(s|sh|x|z|ch) \\^s$", "\\1\\2es"},
+      {"^(.*[aeiou])([bdgmnpt]) \\^(ed|ing|er)$", "\\1\\2\\2\\3"},
+  };
+  static const StenoOrthographyAlias ALIASES[] = {
+      {"able", "ible"},
+  };
+  static const StenoOrthographyAutoSuffix AUTO_SUFFIXES[] = {
+      {StenoStroke("-Z"), " {^s}"},
+      {StenoStroke("-D"), " {^ed}"},
+  };
+  static const StenoOrthography ORTHOGRAPHY = {
+      .rules = {sizeof(RULES) / sizeof(*RULES), RULES},
+      .aliases = {sizeof(ALIASES) / sizeof(*ALIASES), ALIASES},
+      .autoSuffixMask = StenoStroke("-DZ"),
+      .autoSuffixes = {sizeof(AUTO_SUFFIXES) / sizeof(*AUTO_SUFFIXES),
+                       AUTO_SUFFIXES},
+      .reverseAutoSuffixes = {0, nullptr},
+  };
+
+  static const char *const ENTRIES[][2] = {
+      {"KAT", "cat"},         {"TKOG", "dog"},       {"-S", "{^s}"},
+      {"-G", "{^ing}"},       {"-D", "{^ed}"},       {"-R", "{^er}"},
+      {"TP-PL", "{.}"},       {"KW-BG", "{,}"},      {"THE", "the"},
+      {"WAUBG", "walk"},      {"HOP", "hope"},       {"STOP", "stop"},
+      {"TREU", "try"},        {"PWOBGS", "box"},     {"TEFT", "test"},
+      {"TEFT/-G", "testing"}, {"KPA", "{}{-|}"},     {"SKWR", "jump"},
+      {"TPAFT", "fast"},      {"HR-PBG", "{^ly}"},   {"SAEUF", "save"},
+  };
+
+  static const char *const CORPUS[] = {
+      "KPA", "THE",  "KAT",   "-S",   "SKWR",  "-D",   "TPAFT", "HR-PBG",
+      "TP-PL", "THE", "TKOG", "-S",   "HOP",   "-D",   "TP-PL", "STOP",
+      "-G",  "TREU", "-S",    "KW-BG", "PWOBGS", "-S", "TEFT",  "-G",
+      "*",   "-D",   "SAEUF", "-G",   "SAEUF", "-R",   "WAUBG", "-G",
+      "TP-PL", "KATZ", "TKOGZ", "WAUBGD", "HOPD", "STOPD", "TREUD", "*",
+      "TEFTD", "STKPWHR", "KAT", "*", "*", "THE", "KAT", "TP-PL",
+  };
+  static const size_t CORPUS_ROUND_COUNT = 8;
+
+  uint8_t *buffer = new uint8_t[512 * 1024];
+  memset(buffer, 0, 512 * 1024);
+  const StenoUserDictionaryData layout(buffer, 512 * 1024);
+  StenoUserDictionary userDictionary(layout);
+  for (const auto &entry : ENTRIES) {
+    StrokeListParser parser;
+    parser.Parse(entry[0]);
+    userDictionary.Add(parser.strokes, parser.length, entry[1]);
+  }
+
+  StenoDictionary *dictionaries[] = {
+      &userDictionary,
+      &StenoJeffPhrasingDictionary::instance,
+      &StenoJeffNumbersDictionary::instance,
+      &StenoEmilySymbolsDictionary::instance,
+      &mainDictionary,
+  };
+  StenoDictionaryList dictionaryList(
+      dictionaries, sizeof(dictionaries) / sizeof(*dictionaries));
+  // Suggestions exercise reverse lookups. Their console output is discarded
+  // so that it does not add to the malloc count.
+  StenoEngineContext context(WordList::instance, HostLayout::ansi,
+                             &NullWriter::instance);
+  const StenoCompiledOrthography orthography(ORTHOGRAPHY, context);
+  StenoEngine engine(dictionaryList, orthography, nullptr, context);
+  engine.EnableSuggestions();
+
+  // Key history allocates, and would be counted as engine mallocs.
+  Key::DisableHistory();
+
+  StenoDictionary::ResetStats();
+  StenoCompiledOrthography::ResetStats();
+  StenoSegmentBuilder::ResetStats();
+  const size_t mallocStart = MallocCount::Get();
+
+  for (size_t round = 0; round < CORPUS_ROUND_COUNT; ++round) {
+    for (const char *text : CORPUS) {
+      StenoStroke stroke;
+      stroke.Set(text);
+      if (stroke == StenoStroke(StrokeMask::STAR)) {
+        engine.ProcessUndo();
+      } else {
+        engine.ProcessStroke(stroke);
+      }
+    }
+  }
+
+  const EngineCostBaselineEntry counts[] = {
+      {"lookup", StenoDictionary::GetLookupCount()},
+      {"dictionary_for_outline",
+       StenoDictionary::GetDictionaryForOutlineCount()},
+      {"reverse_lookup", StenoDictionary::GetReverseLookupCount()},
+      {"add_suffix", StenoCompiledOrthography::GetAddSuffixCount()},
+      {"orthography_cache_miss",
+       StenoCompiledOrthography::GetCacheMissCount()},
+      {"malloc", MallocCount::Get() - mallocStart},
+      {"segment_builder_copy_bytes", StenoSegmentBuilder::GetCopyByteCount()},
+  };
+
+  Key::EnableHistory();
+  delete[] buffer;
+
+  static_assert(sizeof(counts) / sizeof(*counts) ==
+                sizeof(ENGINE_COST_BASELINE) / sizeof(*ENGINE_COST_BASELINE));
+
+  const size_t strokeCount =
+      CORPUS_ROUND_COUNT * sizeof(CORPUS) / sizeof(*CORPUS);
+  bool hasRegression = false;
+  for (size_t i = 0; i < sizeof(counts) / sizeof(*counts); ++i) {
+    const EngineCostBaselineEntry &count = counts[i];
+    const EngineCostBaselineEntry &baseline = ENGINE_COST_BASELINE[i];
+    assert(Str::Eq(count.name, baseline.name));
+
+    if (Str::Eq(count.name, "malloc") && !MallocCount::IsAvailable()) {
+      continue;
+    }
+
+    const size_t limit =
+        baseline.count + baseline.count * ENGINE_COST_THRESHOLD_PERCENT / 100;
+    if (count.count > limit) {
+      printf("Cost regression: %s %zu (%.2f/stroke), baseline %zu\n",
+             count.name, count.count, double(count.count) / strokeCount,
+             baseline.count);
+      hasRegression = true;
+    }
+  }
+
+  if (hasRegression) {
+    printf("Current counts:\n");
+    for (const EngineCostBaselineEntry &count : counts) {
+      printf("    {\"%s\", %zu},\n", count.name, count.count);
+    }
+  }
+  assert(!hasRegression);
+}
+TEST_END
+
 //---------------------------------------------------------------------------
 #endif // RUN_TESTS
 //---------------------------------------------------------------------------
@@ -1,6 +1,8 @@
 //---------------------------------------------------------------------------
 
 #pragma once
+#include "engine_context.h"
+#include "engine_profile.h"
 #include "orthography.h"
 #include "processor/processor.h"
 #include "segment_builder.h"
@@ -8,10 +10,12 @@
 #include "steno_key_code_buffer.h"
 #include "steno_key_code_emitter.h"
 #include "stroke_history.h"
+#include "undo_snapshot.h"
 
 //---------------------------------------------------------------------------
 
 class Console;
+class IWriter;
 class Pattern;
 class StenoDictionary;
 class StenoReverseDictionaryLookup;
@@ -26,9 +30,10 @@ enum StenoEngineMode { NORMAL, ADD_TRANSLATION, CONSOLE };
 
 class StenoEngine final : public StenoProcessorElement {
 public:
-  StenoEngine(StenoDictionary &dictionary,
-              const StenoCompiledOrthography &orthography,
-              StenoUserDictionary *userDictionary = nullptr);
+  StenoEngine(
+      StenoDictionary &dictionary, const StenoCompiledOrthography &orthography,
+      StenoUserDictionary *userDictionary = nullptr,
+      StenoEngineContext &context = StenoEngineContext::defaultContext);
 
   size_t GetStrokeCount() const { return strokeCount; }
 
@@ -48,6 +53,7 @@ public:
   void ReverseLookup(StenoReverseDictionaryLookup &lookup) const;
 
   StenoDictionary &GetDictionary() const { return dictionary; }
+  StenoEngineContext &GetContext() const { return context; }
   const StenoCompiledOrthography &GetOrthography() const { return orthography; }
 
   bool IsPaperTapeEnabled() const { return paperTapeEnabled; }
@@ -62,11 +68,26 @@ public:
   void EnableTextLog() { textLogEnabled = true; }
   void DisableTextLog() { textLogEnabled = false; }
 
+  StenoEngineProfile &GetProfile() { return profile; }
+  const StenoEngineProfile &GetProfile() const { return profile; }
+
+  // When set, every normal mode text change is written as a sequence of '\b'
+  // characters followed by the new text. Used by host tools.
+  void SetTextWriter(IWriter *writer) { textWriter = writer; }
+
   bool IsSpaceAfter() const { return placeSpaceAfter; }
   void SetSpaceAfter(bool spaceAfter) { placeSpaceAfter = spaceAfter; }
 
   bool IsJoinNext() const { return state.joinNext; }
 
+  // Used by host tools that transcribe a log from a point within it.
+  const StenoState &GetState() const { return state; }
+  size_t GetHistoryCount() const { return history.GetCount(); }
+
+  // Continues text that a previous engine wrote, as if after a word. With
+  // spaces placed after words, that text already ends with a space.
+  void ContinueAfterText() { state.joinNext = placeSpaceAfter; }
+
   void AddConsoleCommands(Console &console);
 
   static JavelinStaticAllocate<StenoEngine> container;
@@ -96,26 +117,30 @@ private:
   StenoEngineMode mode = StenoEngineMode::NORMAL;
 
   size_t strokeCount = 0;
+  StenoEngineContext &context;
   StenoDictionary &dictionary;
   const StenoCompiledOrthography orthography;
   StenoUserDictionary *userDictionary;
+  IWriter *textWriter = nullptr;
 
   StenoState state;
   StenoState altTranslationState;
   char *addTranslationText = nullptr;
 
   StenoKeyCodeEmitter emitter;
+  StenoEngineProfile profile;
 
   StenoStrokeHistory history;
   StenoStrokeHistory altTranslationHistory;
+  StenoUndoSnapshotRing undoSnapshots;
 
   struct ConversionBuffer {
     StenoSegmentBuilder segmentBuilder;
     StenoKeyCodeBuffer keyCodeBuffer;
 
     void Prepare(const StenoCompiledOrthography *orthography,
-                 StenoDictionary *dictionary) {
-      keyCodeBuffer.Prepare(orthography, dictionary);
+                 StenoDictionary *dictionary, StenoEngineContext *context) {
+      keyCodeBuffer.Prepare(orthography, dictionary, context);
     }
   };
 
@@ -137,6 +162,9 @@ private:
 
   void ProcessNormalModeUndo();
   void ProcessNormalModeStroke(StenoStroke stroke);
+  void AddUndoSnapshot(StenoStroke stroke, size_t conversionCount,
+                       const StenoSegmentList &previousSegments);
+  bool ProcessNormalModeUndoFromSnapshots(size_t undoCount);
 
   void InitiateAddTranslationMode(const char *text);
   void ProcessAddTranslationModeUndo();
@@ -173,8 +201,11 @@ private:
                                        StenoSegmentList &segments,
                                        const ConversionBuffer &longerBuffer,
                                        const StenoSegmentList &longerSegments);
+  // Segments before commonSegmentsCount are the same in the other buffer
+  // being converted, and the key codes from them set the watermark.
   void ConvertText(StenoKeyCodeBuffer &keyCodeBuffer,
-                   StenoSegmentList &segments, size_t startingOffset);
+                   StenoSegmentList &segments, size_t startingOffset,
+                   size_t commonSegmentsCount = 0);
 
   void PrintPaperTape(StenoStroke stroke,
                       const StenoSegmentList &previousSegments,
@@ -207,6 +238,9 @@ private:
                                          const char *commandLine);
   static void EnableTextLog_Binding(void *context, const char *commandLine);
   static void DisableTextLog_Binding(void *context, const char *commandLine);
+  static void EnableProfile_Binding(void *context, const char *commandLine);
+  static void DisableProfile_Binding(void *context, const char *commandLine);
+  static void PrintProfile_Binding(void *context, const char *commandLine);
   static void Lookup_Binding(void *context, const char *commandLine);
   static void LookupStroke_Binding(void *context, const char *commandLine);
   static void RemoveStroke_Binding(void *context, const char *commandLine);
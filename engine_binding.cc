@@ -166,6 +166,26 @@ void StenoEngine::DisableTextLog_Binding(void *context,
   Console::SendOk();
 }
 
+void StenoEngine::EnableProfile_Binding(void *context,
+                                        const char *commandLine) {
+  StenoEngine *engine = (StenoEngine *)context;
+  engine->profile.Enable();
+  Console::SendOk();
+}
+
+void StenoEngine::DisableProfile_Binding(void *context,
+                                         const char *commandLine) {
+  StenoEngine *engine = (StenoEngine *)context;
+  engine->profile.Disable();
+  Console::SendOk();
+}
+
+void StenoEngine::PrintProfile_Binding(void *context,
+                                       const char *commandLine) {
+  const StenoEngine *engine = (const StenoEngine *)context;
+  engine->profile.PrintJson();
+}
+
 void StenoEngine::Lookup_Binding(void *context, const char *commandLine) {
   const char *definition = strchr(commandLine, ' ');
   if (definition == nullptr) {
@@ -412,6 +432,15 @@ void StenoEngine::AddConsoleCommands(Console &console) {
                           StenoEngine::EnableTextLog_Binding, this);
   console.RegisterCommand("disable_text_log", "Disables text log output",
                           StenoEngine::DisableTextLog_Binding, this);
+  console.RegisterCommand("enable_profile",
+                          "Resets and enables stroke latency profiling",
+                          StenoEngine::EnableProfile_Binding, this);
+  console.RegisterCommand("disable_profile",
+                          "Disables stroke latency profiling",
+                          StenoEngine::DisableProfile_Binding, this);
+  console.RegisterCommand("print_profile",
+                          "Prints stroke latency histograms in JSON format",
+                          StenoEngine::PrintProfile_Binding, this);
   console.RegisterCommand("lookup", "Looks up a word",
                           StenoEngine::Lookup_Binding, this);
   console.RegisterCommand("lookup_stroke", "Looks up a stroke",
@@ -124,7 +124,7 @@ bool StenoEngine::HandleConsoleModeScanCode(uint32_t scanCodeAndModifiers,
 
 class HidWriter final : public IWriter {
 public:
-  HidWriter() {}
+  HidWriter(const HostLayout &hostLayout) : context(hostLayout) {}
   ~HidWriter() { context.ReleaseModifiers(context.modifiers); }
 
   virtual void Write(const char *data, size_t length);
@@ -146,7 +146,7 @@ void HidWriter::Write(const char *data, size_t length) {
 
 void StenoEngine::ConsoleModeExecute() {
   char *command = previousConversionBuffer.keyCodeBuffer.ToString();
-  HidWriter writer;
+  HidWriter writer(context.GetHostLayout());
   writer.context.TapKey(KeyCode::ENTER);
   if (!Console::RunCommand(command, writer)) {
     writer.Printf(
@@ -0,0 +1,85 @@
+//---------------------------------------------------------------------------
+
+#include "engine_context.h"
+#include "host_layout.h"
+#include "orthography.h"
+#include "word_list.h"
+
+//---------------------------------------------------------------------------
+
+StenoEngineContext StenoEngineContext::defaultContext;
+
+//---------------------------------------------------------------------------
+
+StenoEngineContext::StenoEngineContext()
+    : wordList(WordList::instance), hostLayout(nullptr),
+      consoleWriter(nullptr) {}
+
+StenoEngineContext::StenoEngineContext(const WordList &wordList,
+                                       const HostLayout &hostLayout,
+                                       IWriter *consoleWriter)
+    : wordList(wordList), hostLayout(&hostLayout),
+      consoleWriter(consoleWriter) {
+#if JAVELIN_THREADS
+  pthread_mutex_init(&orthographyCacheMutex, nullptr);
+#endif
+}
+
+#if JAVELIN_THREADS
+StenoEngineContext::~StenoEngineContext() {
+  if (!IsDefault()) {
+    pthread_mutex_destroy(&orthographyCacheMutex);
+  }
+}
+#endif
+
+//---------------------------------------------------------------------------
+
+const HostLayout &StenoEngineContext::GetHostLayout() const {
+  return hostLayout ? *hostLayout : HostLayouts::GetActiveLayout();
+}
+
+void StenoEngineContext::SetHostLayout(const HostLayout &layout) {
+  if (hostLayout) {
+    hostLayout = &layout;
+  } else {
+    HostLayouts::SetActiveLayout(layout);
+  }
+}
+
+bool StenoEngineContext::SetHostLayout(const char *name) {
+  if (!hostLayout) {
+    return HostLayouts::SetActiveLayout(name);
+  }
+
+  const HostLayout *layout = HostLayouts::GetLayout(name);
+  if (!layout) {
+    return false;
+  }
+  hostLayout = layout;
+  return true;
+}
+
+//---------------------------------------------------------------------------
+
+void StenoEngineContext::LockOrthographyCache() const {
+  if (IsDefault()) {
+    StenoCompiledOrthography::LockCache();
+    return;
+  }
+#if JAVELIN_THREADS
+  pthread_mutex_lock(&orthographyCacheMutex);
+#endif
+}
+
+void StenoEngineContext::UnlockOrthographyCache() const {
+  if (IsDefault()) {
+    StenoCompiledOrthography::UnlockCache();
+    return;
+  }
+#if JAVELIN_THREADS
+  pthread_mutex_unlock(&orthographyCacheMutex);
+#endif
+}
+
+//---------------------------------------------------------------------------
@@ -0,0 +1,70 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include <stddef.h>
+
+#if JAVELIN_THREADS
+#include <pthread.h>
+#endif
+
+//---------------------------------------------------------------------------
+
+class IWriter;
+class WordList;
+struct HostLayout;
+
+//---------------------------------------------------------------------------
+
+// The services an engine uses that would otherwise be process wide.
+//
+// Firmware runs a single engine using defaultContext, which refers to the
+// existing singletons: WordList::instance, the active host layout, the
+// active console writer and the static orthography cache locks.
+//
+// Hosts that run several engines concurrently give each engine its own
+// context, so that engines running on different threads share no mutable
+// state.
+class StenoEngineContext {
+public:
+  // If consoleWriter is null, console output from the engine goes to the
+  // active console writer.
+  StenoEngineContext(const WordList &wordList, const HostLayout &hostLayout,
+                     IWriter *consoleWriter = nullptr);
+#if JAVELIN_THREADS
+  ~StenoEngineContext();
+#endif
+
+  const WordList &GetWordList() const { return wordList; }
+
+  const HostLayout &GetHostLayout() const;
+  void SetHostLayout(const HostLayout &layout);
+  bool SetHostLayout(const char *name);
+
+  IWriter *GetConsoleWriter() const { return consoleWriter; }
+
+  void LockOrthographyCache() const;
+  void UnlockOrthographyCache() const;
+
+  bool IsDefault() const { return this == &defaultContext; }
+
+  static StenoEngineContext defaultContext;
+
+private:
+  StenoEngineContext();
+  StenoEngineContext(const StenoEngineContext &) = delete;
+
+  const WordList &wordList;
+
+  // nullptr indicates that HostLayouts' active layout is used.
+  const HostLayout *hostLayout;
+
+  IWriter *consoleWriter;
+
+#if JAVELIN_THREADS
+  // An engine converts previous and next text in parallel, which share the
+  // orthography cache.
+  mutable pthread_mutex_t orthographyCacheMutex;
+#endif
+};
+
+//---------------------------------------------------------------------------
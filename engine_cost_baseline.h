@@ -0,0 +1,33 @@
+//---------------------------------------------------------------------------
+//
+// Baseline operation counts for the "Engine: Cost model" test in engine.cc.
+//
+// The test replays a fixed corpus and fails if any count grows by more than
+// ENGINE_COST_THRESHOLD_PERCENT. When a change intentionally alters the
+// counts, replace these values with the ones printed by the test.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+#include <stddef.h>
+
+//---------------------------------------------------------------------------
+
+struct EngineCostBaselineEntry {
+  const char *name;
+  size_t count;
+};
+
+static const size_t ENGINE_COST_THRESHOLD_PERCENT = 5;
+
+static const EngineCostBaselineEntry ENGINE_COST_BASELINE[] = {
+    {"lookup", 7486},
+    {"dictionary_for_outline", 0},
+    {"reverse_lookup", 1489},
+    {"add_suffix", 4773},
+    {"orthography_cache_miss", 17},
+    {"malloc", 19104},
+    {"segment_builder_copy_bytes", 1768},
+};
+
+//---------------------------------------------------------------------------
@@ -12,27 +12,27 @@
 
 //---------------------------------------------------------------------------
 
-#define ENABLE_PROFILE 0
-
-//---------------------------------------------------------------------------
-
 #if JAVELIN_THREADS
 
 struct StenoEngine::UpdateNormalModeTextBufferThreadData {
   UpdateNormalModeTextBufferThreadData(StenoEngine *engine,
                                        StenoKeyCodeBuffer *keyCodeBuffer,
                                        StenoSegmentList *segments,
-                                       size_t startingOffset)
+                                       size_t startingOffset,
+                                       size_t commonSegmentsCount)
       : engine(engine), keyCodeBuffer(keyCodeBuffer), segments(segments),
-        startingOffset(startingOffset) {}
+        startingOffset(startingOffset),
+        commonSegmentsCount(commonSegmentsCount) {}
 
   StenoEngine *engine;
   StenoKeyCodeBuffer *keyCodeBuffer;
   StenoSegmentList *segments;
   size_t startingOffset;
+  size_t commonSegmentsCount;
 
   void ConvertText() {
-    engine->ConvertText(*keyCodeBuffer, *segments, startingOffset);
+    engine->ConvertText(*keyCodeBuffer, *segments, startingOffset,
+                        commonSegmentsCount);
   }
 
   static void ConvertTextEntryPoint(void *data) {
@@ -111,11 +111,9 @@ void StenoEngine::ProcessNormalModeStroke(StenoStroke stroke) {
   StenoDictionary::ResetStats();
 #endif
 
-  history.PruneIfFull();
+  const StenoEngineProfile::Sentry profileSentry(profile);
 
-#if ENABLE_PROFILE
-  uint32_t t0 = Clock::GetMicroseconds();
-#endif
+  history.PruneIfFull();
 
   const size_t previousSourceStrokeCount = history.GetCount();
   const size_t startingStroke = GetStartingStrokeForNormalModeProcessing();
@@ -125,16 +123,14 @@ void StenoEngine::ProcessNormalModeStroke(StenoStroke stroke) {
   const size_t conversionCount = history.GetCount() + 1 - startingStroke;
 
   history.Add(stroke, state, conversionCount);
+  profile.Mark(StenoProfileStage::HISTORY);
 
   StenoSegmentList nextSegments;
   CreateSegments(history.GetCount(), nextConversionBuffer, conversionCount,
                  nextSegments, true);
   history.UpdateDefinitionBoundaries(history.GetCount() - conversionCount,
                                      nextSegments);
-
-#if ENABLE_PROFILE
-  uint32_t t1 = Clock::GetMicroseconds();
-#endif
+  profile.Mark(StenoProfileStage::NEXT_SEGMENTS);
 
   StenoSegmentList previousSegments;
   if (nextConversionBuffer.segmentBuilder.HasModifiedStrokeHistory()) {
@@ -146,27 +142,24 @@ void StenoEngine::ProcessNormalModeStroke(StenoStroke stroke) {
                                     conversionCount - 1, previousSegments,
                                     nextConversionBuffer, nextSegments);
   }
+  profile.Mark(StenoProfileStage::PREVIOUS_SEGMENTS);
 
-#if ENABLE_PROFILE
-  uint32_t t2 = Clock::GetMicroseconds();
-#endif
-
+  const size_t commonSegmentsCount =
+      StenoSegmentList::GetCommonSegmentsCount(previousSegments, nextSegments);
   size_t startingOffset = StenoSegmentList::GetCommonStartingSegmentsCount(
-      previousSegments, nextSegments);
+      previousSegments, nextSegments, commonSegmentsCount);
   if (startingOffset > 0 && placeSpaceAfter) {
     --startingOffset;
   }
-
-#if ENABLE_PROFILE
-  uint32_t t3 = Clock::GetMicroseconds();
-#endif
+  profile.Mark(StenoProfileStage::COMMON_SEGMENTS);
 
 #if JAVELIN_THREADS
   UpdateNormalModeTextBufferThreadData previousThreadData(
       this, &previousConversionBuffer.keyCodeBuffer, &previousSegments,
-      startingOffset);
+      startingOffset, commonSegmentsCount);
   UpdateNormalModeTextBufferThreadData nextThreadData(
-      this, &nextConversionBuffer.keyCodeBuffer, &nextSegments, startingOffset);
+      this, &nextConversionBuffer.keyCodeBuffer, &nextSegments, startingOffset,
+      commonSegmentsCount);
 
   RunParallel(&UpdateNormalModeTextBufferThreadData::ConvertTextEntryPoint,
               &previousThreadData,
@@ -174,26 +167,28 @@ void StenoEngine::ProcessNormalModeStroke(StenoStroke stroke) {
               &nextThreadData);
 #else
   ConvertText(previousConversionBuffer.keyCodeBuffer, previousSegments,
-              startingOffset);
-  ConvertText(nextConversionBuffer.keyCodeBuffer, nextSegments, startingOffset);
-#endif
-
-#if ENABLE_PROFILE
-  uint32_t t4 = Clock::GetMicroseconds();
+              startingOffset, commonSegmentsCount);
+  ConvertText(nextConversionBuffer.keyCodeBuffer, nextSegments, startingOffset,
+              commonSegmentsCount);
 #endif
+  profile.Mark(StenoProfileStage::CONVERT_TEXT);
 
   state = nextConversionBuffer.keyCodeBuffer.state;
   state.shouldCombineUndo = false;
   state.isManualStateChange = false;
 
+  // The segments can view the current stroke's state in history, so its undo
+  // flags are only set once suggestions have been printed.
   bool printSuggestions = true;
-  if (emitter.Process(previousConversionBuffer.keyCodeBuffer,
-                      nextConversionBuffer.keyCodeBuffer)) {
-    history.SetBackCombineUndo();
+  bool shouldCombineUndo = false;
+  bool hasManualStateChange = false;
+  if (emitter.ProcessFromWatermark(previousConversionBuffer.keyCodeBuffer,
+                                   nextConversionBuffer.keyCodeBuffer)) {
+    shouldCombineUndo = true;
 
     if (previousConversionBuffer.keyCodeBuffer.count ==
         nextConversionBuffer.keyCodeBuffer.count) {
-      history.SetBackHasManualStateChange();
+      hasManualStateChange = true;
       if (state.caseMode != StenoCaseMode::NORMAL ||
           state.overrideCaseMode != StenoCaseMode::NORMAL) {
         printSuggestions = false;
@@ -205,6 +200,7 @@ void StenoEngine::ProcessNormalModeStroke(StenoStroke stroke) {
       }
     }
   }
+  profile.Mark(StenoProfileStage::EMITTER);
 
   PrintTextLog(previousConversionBuffer.keyCodeBuffer,
                nextConversionBuffer.keyCodeBuffer);
@@ -213,6 +209,10 @@ void StenoEngine::ProcessNormalModeStroke(StenoStroke stroke) {
   if (nextConversionBuffer.keyCodeBuffer.addTranslationCount >
       previousConversionBuffer.keyCodeBuffer.addTranslationCount) {
     history.SetBackNoCombineUndo();
+    if (hasManualStateChange) {
+      history.SetBackHasManualStateChange();
+    }
+    undoSnapshots.Reset();
     InitiateAddTranslationMode(
         nextConversionBuffer.keyCodeBuffer.addTranslationText);
     return;
@@ -221,6 +221,10 @@ void StenoEngine::ProcessNormalModeStroke(StenoStroke stroke) {
   if (nextConversionBuffer.keyCodeBuffer.consoleCount >
       previousConversionBuffer.keyCodeBuffer.consoleCount) {
     history.SetBackNoCombineUndo();
+    if (hasManualStateChange) {
+      history.SetBackHasManualStateChange();
+    }
+    undoSnapshots.Reset();
     InitiateConsoleMode();
     return;
   }
@@ -231,26 +235,23 @@ void StenoEngine::ProcessNormalModeStroke(StenoStroke stroke) {
     return;
   }
 
-#if ENABLE_PROFILE
-  uint32_t t5 = Clock::GetMicroseconds();
-#endif
+  AddUndoSnapshot(stroke, conversionCount, previousSegments);
+
+  profile.Skip();
 
   if (printSuggestions) {
     // PrintSuggestions will overwrite the previousConversionBuffer
     PrintSuggestions(previousSegments, nextSegments);
   }
 
-#if ENABLE_PROFILE
-  uint32_t t6 = Clock::GetMicroseconds();
-#endif
+  if (shouldCombineUndo) {
+    history.SetBackCombineUndo();
+  }
+  if (hasManualStateChange) {
+    history.SetBackHasManualStateChange();
+  }
 
-#if ENABLE_PROFILE
-  Console::Printf("Next Segments: %u\n", t1 - t0);
-  Console::Printf("Previous Segments: %u\n", t2 - t1);
-  Console::Printf("Common Check: %u\n", t3 - t2);
-  Console::Printf("Text Conversion: %u\n", t4 - t3);
-  Console::Printf("Suggestions: %u\n", t6 - t5);
-#endif
+  profile.Mark(StenoProfileStage::SUGGESTIONS);
 
 #if ENABLE_DICTIONARY_STATS
   Console::Printf("Lookups: %zu\n", StenoDictionary::GetLookupCount());
@@ -258,9 +259,6 @@ void StenoEngine::ProcessNormalModeStroke(StenoStroke stroke) {
                   StenoDictionary::GetReverseLookupCount());
   Console::Printf("DictionaryForOutline: %zu\n",
                   StenoDictionary::GetDictionaryForOutlineCount());
-#endif
-
-#if ENABLE_PROFILE || ENABLE_DICTIONARY_STATS
   Console::Printf("\n");
 #endif
 }
@@ -276,6 +274,11 @@ void StenoEngine::ProcessNormalModeUndo() {
     return;
   }
 
+  if (ProcessNormalModeUndoFromSnapshots(undoCount)) {
+    return;
+  }
+  undoSnapshots.Reset();
+
   const size_t startingStroke =
       history.GetStartingStroke(maximumConversionStrokes);
   const size_t conversionCount = history.GetCount() - startingStroke;
@@ -306,8 +309,10 @@ void StenoEngine::ProcessNormalModeUndo() {
   history.UpdateDefinitionBoundaries(history.GetCount() - nextConversionCount,
                                      nextSegments);
 
+  const size_t commonSegmentsCount =
+      StenoSegmentList::GetCommonSegmentsCount(previousSegments, nextSegments);
   size_t startingOffset = StenoSegmentList::GetCommonStartingSegmentsCount(
-      previousSegments, nextSegments);
+      previousSegments, nextSegments, commonSegmentsCount);
   if (startingOffset > 0 && placeSpaceAfter) {
     --startingOffset;
   }
@@ -315,9 +320,10 @@ void StenoEngine::ProcessNormalModeUndo() {
 #if JAVELIN_THREADS
   UpdateNormalModeTextBufferThreadData previousThreadData(
       this, &previousConversionBuffer.keyCodeBuffer, &previousSegments,
-      startingOffset);
+      startingOffset, commonSegmentsCount);
   UpdateNormalModeTextBufferThreadData nextThreadData(
-      this, &nextConversionBuffer.keyCodeBuffer, &nextSegments, startingOffset);
+      this, &nextConversionBuffer.keyCodeBuffer, &nextSegments, startingOffset,
+      commonSegmentsCount);
 
   RunParallel(&UpdateNormalModeTextBufferThreadData::ConvertTextEntryPoint,
               &previousThreadData,
@@ -325,18 +331,68 @@ void StenoEngine::ProcessNormalModeUndo() {
               &nextThreadData);
 #else
   ConvertText(previousConversionBuffer.keyCodeBuffer, previousSegments,
-              startingOffset);
-  ConvertText(nextConversionBuffer.keyCodeBuffer, nextSegments, startingOffset);
+              startingOffset, commonSegmentsCount);
+  ConvertText(nextConversionBuffer.keyCodeBuffer, nextSegments, startingOffset,
+              commonSegmentsCount);
 #endif
 
-  emitter.Process(previousConversionBuffer.keyCodeBuffer,
-                  nextConversionBuffer.keyCodeBuffer);
+  emitter.ProcessFromWatermark(previousConversionBuffer.keyCodeBuffer,
+                               nextConversionBuffer.keyCodeBuffer);
 
   PrintTextLog(previousConversionBuffer.keyCodeBuffer,
                nextConversionBuffer.keyCodeBuffer);
   PrintPaperTapeUndo(undoCount);
 }
 
+void StenoEngine::AddUndoSnapshot(StenoStroke stroke, size_t conversionCount,
+                                  const StenoSegmentList &previousSegments) {
+  StenoUndoSnapshot &snapshot = undoSnapshots.Add();
+  snapshot.stroke = stroke;
+
+  // Undo converts again when the conversion had side effects, such as
+  // =set_value, so that they are repeated.
+  snapshot.isValid =
+      !nextConversionBuffer.segmentBuilder.HasModifiedStrokeHistory() &&
+      snapshot.SetStates(history, conversionCount - 1, previousSegments) &&
+      snapshot.SetKeyCodes(previousConversionBuffer.keyCodeBuffer,
+                           nextConversionBuffer.keyCodeBuffer);
+}
+
+// Reverses the last undoCount strokes by emitting the key codes they
+// replaced, without converting the shortened history.
+bool StenoEngine::ProcessNormalModeUndoFromSnapshots(size_t undoCount) {
+  if (!undoSnapshots.CanUndo(history, undoCount)) {
+    return false;
+  }
+
+  state = history.Back(undoCount).state;
+  state.shouldCombineUndo = false;
+  state.isManualStateChange = false;
+
+  for (size_t i = 0; i < undoCount; ++i) {
+    const StenoUndoSnapshot &snapshot = undoSnapshots.RemoveBack();
+    history.RemoveBack(1);
+    history.SetBackStates(snapshot.states, snapshot.stateCount);
+
+    if (snapshot.removedKeyCodeCount == 0 &&
+        snapshot.restoredKeyCodeCount == 0) {
+      continue;
+    }
+
+    previousConversionBuffer.keyCodeBuffer.Set(snapshot.GetRemovedKeyCodes(),
+                                               snapshot.removedKeyCodeCount);
+    nextConversionBuffer.keyCodeBuffer.Set(snapshot.GetRestoredKeyCodes(),
+                                           snapshot.restoredKeyCodeCount);
+    emitter.Process(previousConversionBuffer.keyCodeBuffer,
+                    nextConversionBuffer.keyCodeBuffer);
+    PrintTextLog(previousConversionBuffer.keyCodeBuffer,
+                 nextConversionBuffer.keyCodeBuffer);
+  }
+
+  PrintPaperTapeUndo(undoCount);
+  return true;
+}
+
 void StenoEngine::CreateSegments(size_t sourceStrokeCount,
                                  ConversionBuffer &buffer,
                                  size_t conversionLimit,
@@ -379,17 +435,23 @@ void StenoEngine::CreateSegmentsUsingLongerResult(
     return;
   }
 
-  buffer.segmentBuilder.TransferStartFrom(longerBuffer.segmentBuilder,
-                                          startingOffset);
   BuildSegmentContext context(segments, *this, false);
   buffer.segmentBuilder.CreateSegments(context, startingOffset);
 }
 
 void StenoEngine::ConvertText(StenoKeyCodeBuffer &keyCodeBuffer,
-                              StenoSegmentList &segments,
-                              size_t startingOffset) {
-  StenoTokenizer *tokenizer = StenoTokenizer::Create(segments, startingOffset);
+                              StenoSegmentList &segments, size_t startingOffset,
+                              size_t commonSegmentsCount) {
+  const bool hasCommonSegments = commonSegmentsCount > startingOffset;
+  StenoTokenizer *tokenizer = StenoTokenizer::Create(
+      segments, startingOffset,
+      hasCommonSegments ? commonSegmentsCount : SIZE_MAX);
   keyCodeBuffer.Populate(tokenizer);
+  if (hasCommonSegments) {
+    keyCodeBuffer.SetWatermark();
+    tokenizer->Extend(SIZE_MAX);
+    keyCodeBuffer.Append(tokenizer);
+  }
   if (placeSpaceAfter && !keyCodeBuffer.state.joinNext &&
       segments.IsNotEmpty()) {
     keyCodeBuffer.AppendSpace();
@@ -698,7 +760,7 @@ char *StenoEngine::PrintSegmentSuggestion(size_t segmentCount,
 void StenoEngine::PrintTextLog(
     const StenoKeyCodeBuffer &previousKeyCodeBuffer,
     const StenoKeyCodeBuffer &nextKeyCodeBuffer) const {
-  if (!IsTextLogEnabled()) {
+  if (!IsTextLogEnabled() && textWriter == nullptr) {
     return;
   }
 
@@ -719,6 +781,21 @@ void StenoEngine::PrintTextLog(
     }
   }
 
+  if (textWriter) {
+    for (size_t j = 0; j < backspaceCount; ++j) {
+      textWriter->WriteByte('\b');
+    }
+    if (i < nextLength) {
+      char *text = nextKeyCodeBuffer.ToString(i);
+      textWriter->WriteString(text);
+      free(text);
+    }
+  }
+
+  if (!IsTextLogEnabled()) {
+    return;
+  }
+
   Console::Printf("EV {\"event\":\"text_log\",\"text\":\"");
   static const char BACKSPACES[] =
       "\\b\\b\\b\\b\\b\\b\\b\\b\\b\\b\\b\\b\\b\\b\\b\\b";
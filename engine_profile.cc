@@ -0,0 +1,46 @@
+//---------------------------------------------------------------------------
+
+#include "engine_profile.h"
+#include "console.h"
+
+//---------------------------------------------------------------------------
+
+static const char *const STAGE_NAMES[] = {
+    "history",      "next_segments", "previous_segments", "common_segments",
+    "convert_text", "emitter",       "suggestions",       "total",
+};
+
+static_assert(sizeof(STAGE_NAMES) / sizeof(*STAGE_NAMES) ==
+                  (size_t)StenoProfileStage::COUNT,
+              "STAGE_NAMES must match StenoProfileStage");
+
+//---------------------------------------------------------------------------
+
+void StenoEngineProfile::Reset() {
+  for (LatencyHistogram &histogram : histograms) {
+    histogram.Reset();
+  }
+}
+
+void StenoEngineProfile::MarkInternal(StenoProfileStage stage) {
+  const uint32_t now = Clock::GetMicroseconds();
+  histograms[(size_t)stage].Add(now - lastTime);
+  lastTime = now;
+}
+
+void StenoEngineProfile::EndInternal() {
+  const uint32_t now = Clock::GetMicroseconds();
+  histograms[(size_t)StenoProfileStage::TOTAL].Add(now - startTime);
+}
+
+void StenoEngineProfile::PrintJson() const {
+  Console::Printf("{\"enabled\":%s,\"unit\":\"us\",\"stages\":{",
+                  enabled ? "true" : "false");
+  for (size_t i = 0; i < (size_t)StenoProfileStage::COUNT; ++i) {
+    Console::Printf(i == 0 ? "\"%s\":" : ",\"%s\":", STAGE_NAMES[i]);
+    histograms[i].PrintJson();
+  }
+  Console::Printf("}}\n\n");
+}
+
+//---------------------------------------------------------------------------
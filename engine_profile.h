@@ -0,0 +1,93 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include "clock.h"
+#include "latency_histogram.h"
+
+//---------------------------------------------------------------------------
+
+enum class StenoProfileStage : uint8_t {
+  HISTORY,
+  NEXT_SEGMENTS,
+  PREVIOUS_SEGMENTS,
+  COMMON_SEGMENTS,
+  CONVERT_TEXT,
+  EMITTER,
+  SUGGESTIONS,
+  TOTAL,
+
+  COUNT,
+};
+
+//---------------------------------------------------------------------------
+
+// Latency histograms for each stage of normal mode stroke processing.
+//
+// Recording is off by default and costs a single flag test per stage when
+// disabled.
+class StenoEngineProfile {
+public:
+  bool IsEnabled() const { return enabled; }
+
+  // Enabling always starts a new collection.
+  void Enable() {
+    Reset();
+    enabled = true;
+  }
+  void Disable() { enabled = false; }
+  void Reset();
+
+  void Start() {
+    if (enabled) {
+      startTime = lastTime = Clock::GetMicroseconds();
+    }
+  }
+
+  // Records the time since the previous Start(), Mark() or Skip() against
+  // stage.
+  void Mark(StenoProfileStage stage) {
+    if (enabled) {
+      MarkInternal(stage);
+    }
+  }
+
+  // Excludes the time since the previous mark from all stages except TOTAL.
+  void Skip() {
+    if (enabled) {
+      lastTime = Clock::GetMicroseconds();
+    }
+  }
+
+  void End() {
+    if (enabled) {
+      EndInternal();
+    }
+  }
+
+  const LatencyHistogram &GetHistogram(StenoProfileStage stage) const {
+    return histograms[(size_t)stage];
+  }
+
+  void PrintJson() const;
+
+  // Calls Start() and End() for a scope.
+  class Sentry {
+  public:
+    Sentry(StenoEngineProfile &profile) : profile(profile) { profile.Start(); }
+    ~Sentry() { profile.End(); }
+
+  private:
+    StenoEngineProfile &profile;
+  };
+
+private:
+  bool enabled = false;
+  uint32_t startTime = 0;
+  uint32_t lastTime = 0;
+  LatencyHistogram histograms[(size_t)StenoProfileStage::COUNT];
+
+  void MarkInternal(StenoProfileStage stage);
+  void EndInternal();
+};
+
+//---------------------------------------------------------------------------
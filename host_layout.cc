@@ -64,11 +64,18 @@ const HostLayout HostLayout::ansi =
 
 const HostLayout *HostLayouts::activeLayout = &HostLayout::ansi;
 const HostLayouts *HostLayouts::instance;
+HostLayoutIndex *HostLayouts::indexes = nullptr;
+const HostLayoutIndex *HostLayouts::activeLayoutIndex = nullptr;
 
 //---------------------------------------------------------------------------
 
 const HostLayoutEntry *
 HostLayout::GetSequenceForUnicode(uint32_t unicode) const {
+  const HostLayoutIndex *index = HostLayouts::activeLayoutIndex;
+  if (index != nullptr && index->IsIndexing(*this)) {
+    return index->Find(unicode);
+  }
+
   const HostLayoutEntry *left = begin(entries);
   const HostLayoutEntry *right = end(entries);
 
@@ -89,21 +96,104 @@ HostLayout::GetSequenceForUnicode(uint32_t unicode) const {
 
 //---------------------------------------------------------------------------
 
+void HostLayoutIndex::Build(const HostLayout &layout) {
+  free(slots);
+  slots = nullptr;
+  this->layout = nullptr;
+
+  const size_t entryCount = layout.entries.GetCount();
+  if (entryCount >= 0xffff) {
+    return;
+  }
+
+  // Keep the load factor at or below 1/2.
+  uint32_t bitCount = 4;
+  while ((size_t(1) << bitCount) < 2 * entryCount) {
+    ++bitCount;
+  }
+
+  const size_t slotCount = size_t(1) << bitCount;
+  slots = (uint16_t *)calloc(slotCount, sizeof(uint16_t));
+  if (slots == nullptr) {
+    return;
+  }
+  shift = 32 - bitCount;
+  mask = slotCount - 1;
+
+  for (size_t i = 0; i < entryCount; ++i) {
+    size_t slotIndex = GetSlotIndex(layout.entries[i].unicode);
+    while (slots[slotIndex] != 0) {
+      slotIndex = (slotIndex + 1) & mask;
+    }
+    slots[slotIndex] = i + 1;
+  }
+  this->layout = &layout;
+}
+
+const HostLayoutEntry *HostLayoutIndex::Find(uint32_t unicode) const {
+  for (size_t slotIndex = GetSlotIndex(unicode);;
+       slotIndex = (slotIndex + 1) & mask) {
+    const size_t slot = slots[slotIndex];
+    if (slot == 0) {
+      return nullptr;
+    }
+    const HostLayoutEntry &entry = layout->entries[slot - 1];
+    if (entry.unicode == unicode) {
+      return &entry;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+
 void HostLayouts::SetData(const HostLayouts &layouts) {
+  activeLayoutIndex = nullptr;
+  delete[] indexes;
+
   instance = &layouts;
-  activeLayout = layouts.layouts.Front();
+  indexes = new HostLayoutIndex[layouts.layouts.GetCount()];
+  for (size_t i = 0; i < layouts.layouts.GetCount(); ++i) {
+    indexes[i].Build(*layouts.layouts[i]);
+  }
+  SetActiveLayout(*layouts.layouts.Front());
+}
+
+void HostLayouts::SetActiveLayout(const HostLayout &layout) {
+  activeLayout = &layout;
+
+  activeLayoutIndex = nullptr;
+  if (instance == nullptr) {
+    return;
+  }
+  for (size_t i = 0; i < instance->layouts.GetCount(); ++i) {
+    if (indexes[i].IsIndexing(layout)) {
+      activeLayoutIndex = &indexes[i];
+      return;
+    }
+  }
 }
 
 //---------------------------------------------------------------------------
 
-bool HostLayouts::SetActiveLayout(const char *name) {
+const HostLayout *HostLayouts::GetLayout(const char *name) {
+  if (instance == nullptr) {
+    return nullptr;
+  }
   for (const HostLayout *layout : instance->layouts) {
     if (Str::Eq(name, layout->name)) {
-      activeLayout = layout;
-      return true;
+      return layout;
     }
   }
-  return false;
+  return nullptr;
+}
+
+bool HostLayouts::SetActiveLayout(const char *name) {
+  const HostLayout *layout = GetLayout(name);
+  if (!layout) {
+    return false;
+  }
+  SetActiveLayout(*layout);
+  return true;
 }
 
 //---------------------------------------------------------------------------
@@ -135,3 +225,36 @@ void HostLayouts::ListHostLayouts() {
 }
 
 //---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+
+#include "unit_test.h"
+
+TEST_BEGIN("HostLayoutIndex: Finds the same entries as a binary search") {
+  const size_t ENTRY_COUNT = 300;
+  HostLayout *layout = (HostLayout *)malloc(
+      sizeof(HostLayout) + ENTRY_COUNT * sizeof(HostLayoutEntry));
+  memcpy((void *)layout, &HostLayout::ansi, sizeof(HostLayout));
+  layout->entries.SetCount(ENTRY_COUNT);
+  for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+    HostLayoutEntry &entry = begin(layout->entries)[i];
+    entry.unicode = 0xc0 + 3 * i + (i >= 200 ? 0x4e00 : 0);
+    entry.length = 1;
+    entry.keyCodes[0] = KeyCode::A;
+  }
+
+  HostLayoutIndex index;
+  index.Build(*layout);
+  assert(index.IsIndexing(*layout));
+  assert(!index.IsIndexing(HostLayout::ansi));
+
+  for (uint32_t unicode = 0x80; unicode < 0x5200; ++unicode) {
+    assert(index.Find(unicode) == layout->GetSequenceForUnicode(unicode));
+  }
+  assert(index.Find(0xc0) == &layout->entries[0]);
+  assert(index.Find(0xc1) == nullptr);
+
+  free(layout);
+}
+TEST_END
+
+//---------------------------------------------------------------------------
@@ -4,6 +4,7 @@
 #include "static_list.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 
 //---------------------------------------------------------------------------
 
@@ -27,6 +28,8 @@ static_assert(sizeof(HostLayoutEntry) == 16,
 //---------------------------------------------------------------------------
 
 // This is used to translate steno unicode -> scan codes.
+//
+// entries are sorted by unicode.
 struct HostLayout {
   const char name[15];
   UnicodeMode unicodeMode;
@@ -41,16 +44,49 @@ struct HostLayout {
 
 //---------------------------------------------------------------------------
 
+// A hash table of unicode -> entry for a single layout, so that non-ASCII
+// characters don't need a binary search of the entries.
+class HostLayoutIndex {
+public:
+  HostLayoutIndex() = default;
+  HostLayoutIndex(const HostLayoutIndex &) = delete;
+  ~HostLayoutIndex() { free(slots); }
+
+  // Indexing is skipped if the table can't be allocated.
+  void Build(const HostLayout &layout);
+
+  bool IsIndexing(const HostLayout &layout) const {
+    return &layout == this->layout;
+  }
+
+  const HostLayoutEntry *Find(uint32_t unicode) const;
+
+private:
+  const HostLayout *layout = nullptr;
+  uint32_t shift = 32;
+  size_t mask = 0;
+
+  // Entry index + 1, or 0 for empty slots.
+  uint16_t *slots = nullptr;
+
+  size_t GetSlotIndex(uint32_t unicode) const {
+    return (unicode * 0x9e3779b1) >> shift;
+  }
+};
+
+//---------------------------------------------------------------------------
+
 class HostLayouts {
 public:
   static void SetData(const HostLayouts &layouts);
 
-  static void SetActiveLayout(const HostLayout &layout) {
-    activeLayout = &layout;
-  }
+  static void SetActiveLayout(const HostLayout &layout);
   static bool SetActiveLayout(const char *name);
   static const HostLayout &GetActiveLayout() { return *activeLayout; }
 
+  // Returns nullptr if there is no layout with the specified name.
+  static const HostLayout *GetLayout(const char *name);
+
   static void SetHostLayout_Binding(void *context, const char *commandLine);
   static void ListHostLayouts();
 
@@ -59,6 +95,14 @@ private:
 
   static const HostLayout *activeLayout;
   static const HostLayouts *instance;
+
+  // Layouts are immutable, so each one from SetData is indexed once, and
+  // changing layouts, which dictionary commands can do on every conversion,
+  // only selects an index.
+  static HostLayoutIndex *indexes;
+  static const HostLayoutIndex *activeLayoutIndex;
+
+  friend struct HostLayout;
 };
 
 //---------------------------------------------------------------------------
@@ -9,6 +9,8 @@
 
 //---------------------------------------------------------------------------
 
+// Press and Release are implemented by the platform. Each event can be sent
+// as its own report, or coalesced with KeyboardReportBuilder.
 class Key {
 public:
   static void Press(KeyCode key);
@@ -0,0 +1,228 @@
+//---------------------------------------------------------------------------
+
+#include "keyboard_report_builder.h"
+
+//---------------------------------------------------------------------------
+
+size_t KeyboardReport::GetBootKeys(uint8_t *bootKeys) const {
+  size_t count = 0;
+  for (size_t key : keys) {
+    if (KeyCode(key).IsModifier()) {
+      continue;
+    }
+    bootKeys[count++] = key;
+    if (count == 6) {
+      break;
+    }
+  }
+  return count;
+}
+
+//---------------------------------------------------------------------------
+
+void KeyboardReportBuilder::Reset() {
+  report.keys.ClearAll();
+  changedKeys.ClearAll();
+  hasPendingKeyPress = false;
+  hasPendingModifierChange = false;
+  reportCount = 0;
+}
+
+void KeyboardReportBuilder::Flush() {
+  if (!changedKeys.IsAnySet()) {
+    return;
+  }
+
+  SendReport(report);
+  ++reportCount;
+  changedKeys.ClearAll();
+  hasPendingKeyPress = false;
+  hasPendingModifierChange = false;
+}
+
+void KeyboardReportBuilder::Update(KeyCode key, bool isPress) {
+  if (report.keys.IsSet(key.value) == isPress) {
+    return;
+  }
+
+  if (IsConflicting(key, isPress)) {
+    Flush();
+  }
+
+  if (isPress) {
+    report.keys.Set(key.value);
+  } else {
+    report.keys.Clear(key.value);
+  }
+  changedKeys.Set(key.value);
+
+  if (key.IsModifier()) {
+    hasPendingModifierChange = true;
+  } else if (isPress) {
+    hasPendingKeyPress = true;
+  }
+}
+
+bool KeyboardReportBuilder::IsConflicting(KeyCode key, bool isPress) const {
+  if (changedKeys.IsSet(key.value)) {
+    return true;
+  }
+  if (key.IsModifier()) {
+    return hasPendingKeyPress;
+  }
+  return isPress && (hasPendingKeyPress || hasPendingModifierChange);
+}
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+
+#ifdef RUN_TESTS
+
+#include "key.h"
+#include "steno_key_code_emitter.h"
+#include "unit_test.h"
+
+class RecordingReportBuilder : public KeyboardReportBuilder {
+public:
+  std::vector<KeyboardReport> reports;
+
+  void Replay(const std::vector<Key::HistoryEntry> &history) {
+    for (const Key::HistoryEntry &entry : history) {
+      if (entry.isPress) {
+        Press(entry.code);
+      } else {
+        Release(entry.code);
+      }
+    }
+    Flush();
+  }
+
+protected:
+  void SendReport(const KeyboardReport &report) final {
+    reports.push_back(report);
+  }
+};
+
+// A typed key is a non-modifier press, with the modifiers held at the time.
+struct TypedKey {
+  uint32_t key;
+  uint8_t modifiers;
+
+  bool operator==(const TypedKey &other) const {
+    return key == other.key && modifiers == other.modifiers;
+  }
+};
+
+static std::vector<TypedKey>
+GetTypedKeys(const std::vector<Key::HistoryEntry> &history) {
+  std::vector<TypedKey> result;
+  KeyboardReport state;
+  state.keys.ClearAll();
+  for (const Key::HistoryEntry &entry : history) {
+    if (entry.isPress) {
+      state.keys.Set(entry.code.value);
+      if (!entry.code.IsModifier()) {
+        result.push_back({entry.code.value, state.GetModifiers()});
+      }
+    } else {
+      state.keys.Clear(entry.code.value);
+    }
+  }
+  return result;
+}
+
+static std::vector<TypedKey>
+GetTypedKeys(const std::vector<KeyboardReport> &reports) {
+  std::vector<TypedKey> result;
+  KeyboardReport previous;
+  previous.keys.ClearAll();
+  for (const KeyboardReport &report : reports) {
+    size_t pressCount = 0;
+    for (size_t key : report.keys & ~previous.keys) {
+      if (!KeyCode(key).IsModifier()) {
+        result.push_back({uint32_t(key), report.GetModifiers()});
+        ++pressCount;
+      }
+    }
+    assert(pressCount <= 1);
+    previous = report;
+  }
+  return result;
+}
+
+static void VerifyReports(const RecordingReportBuilder &builder,
+                          const std::vector<Key::HistoryEntry> &history) {
+  assert(GetTypedKeys(builder.reports) == GetTypedKeys(history));
+  assert(!builder.reports.back().keys.IsAnySet());
+}
+
+TEST_BEGIN("KeyboardReportBuilder: Taps share reports with releases") {
+  RecordingReportBuilder builder;
+  builder.Press(KeyCode::A);
+  builder.Release(KeyCode::A);
+  builder.Press(KeyCode::B);
+  builder.Release(KeyCode::B);
+  builder.Press(KeyCode::B);
+  builder.Release(KeyCode::B);
+  builder.Flush();
+
+  // {A} {B} {} {B} {}
+  assert(builder.reports.size() == 5);
+  assert(builder.reports[0].keys.IsSet(KeyCode::A));
+  assert(builder.reports[1].keys.IsSet(KeyCode::B));
+  assert(!builder.reports[1].keys.IsSet(KeyCode::A));
+  assert(!builder.reports[2].keys.IsAnySet());
+  assert(builder.reports[3].keys.IsSet(KeyCode::B));
+  assert(!builder.reports[4].keys.IsAnySet());
+}
+TEST_END
+
+TEST_BEGIN("KeyboardReportBuilder: Emitted text matches key history") {
+  Key::history.clear();
+
+  StenoKeyCodeEmitter emitter;
+  const StenoKeyCode previous[] = {
+      StenoKeyCode('o', StenoCaseMode::NORMAL),
+      StenoKeyCode('o', StenoCaseMode::NORMAL),
+      StenoKeyCode('p', StenoCaseMode::NORMAL),
+      StenoKeyCode('s', StenoCaseMode::NORMAL),
+  };
+  const StenoKeyCode value[] = {
+      StenoKeyCode('H', StenoCaseMode::NORMAL),
+      StenoKeyCode('E', StenoCaseMode::NORMAL),
+      StenoKeyCode('l', StenoCaseMode::NORMAL),
+      StenoKeyCode('l', StenoCaseMode::NORMAL),
+      StenoKeyCode('o', StenoCaseMode::NORMAL),
+      StenoKeyCode(',', StenoCaseMode::NORMAL),
+      StenoKeyCode(' ', StenoCaseMode::NORMAL),
+      StenoKeyCode('w', StenoCaseMode::NORMAL),
+      StenoKeyCode('o', StenoCaseMode::NORMAL),
+      StenoKeyCode('r', StenoCaseMode::NORMAL),
+      StenoKeyCode('L', StenoCaseMode::NORMAL),
+      StenoKeyCode('d', StenoCaseMode::NORMAL),
+      StenoKeyCode('!', StenoCaseMode::NORMAL),
+  };
+  emitter.Process(previous, 4, value, 13);
+
+  RecordingReportBuilder builder;
+  builder.Replay(Key::history);
+  VerifyReports(builder, Key::history);
+  assert(builder.GetReportCount() == builder.reports.size());
+  assert(builder.reports.size() < Key::history.size());
+
+  // "HE" holds shift across both characters.
+  size_t shiftPressCount = 0;
+  for (const Key::HistoryEntry &entry : Key::history) {
+    if (entry.isPress && entry.code == KeyCode::L_SHIFT) {
+      ++shiftPressCount;
+    }
+  }
+  assert(shiftPressCount == 3);
+
+  Key::history.clear();
+}
+TEST_END
+
+#endif
+
+//---------------------------------------------------------------------------
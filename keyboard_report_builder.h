@@ -0,0 +1,82 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include "bit_field.h"
+#include "key_code.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------
+
+// The keys held down in a keyboard report, including modifiers.
+//
+// Platforms convert this to their wire format: the modifier byte plus up to
+// six keys for boot protocol (6KRO), or a bitmap for NKRO.
+struct KeyboardReport {
+  BitField<256> keys;
+
+  uint8_t GetModifiers() const {
+    return keys.GetRange(KeyCode::L_CTRL, KeyCode::R_META + 1);
+  }
+
+  // Writes up to six held non-modifier keys, returning the count.
+  size_t GetBootKeys(uint8_t *bootKeys) const;
+
+  bool operator==(const KeyboardReport &other) const {
+    return keys == other.keys;
+  }
+  bool operator!=(const KeyboardReport &other) const {
+    return keys != other.keys;
+  }
+};
+
+//---------------------------------------------------------------------------
+
+// Packs key presses and releases into as few reports as possible, starting a
+// new report only when an event can't share the pending one:
+//
+//  * A key that already changed in the pending report, since the host
+//    would never see its first change.
+//  * A key press when another key press or a modifier change is pending,
+//    so that the host sees presses in order, with the intended modifiers.
+//  * A modifier change when a key press is pending.
+//
+// Releases share reports with everything else. Typing text therefore takes
+// one report per character rather than two, and a shifted run keeps the
+// modifier held between characters. Repeated taps of the same key, such as
+// backspaces, still need a press and a release report each.
+//
+// Platforms call Press() and Release() from Key, and Flush() whenever a
+// report can be sent.
+class KeyboardReportBuilder {
+public:
+  KeyboardReportBuilder() { Reset(); }
+  virtual ~KeyboardReportBuilder() = default;
+
+  void Reset();
+
+  void Press(KeyCode key) { Update(key, true); }
+  void Release(KeyCode key) { Update(key, false); }
+
+  // Sends the pending report if any keys changed.
+  void Flush();
+
+  bool HasPendingReport() const { return changedKeys.IsAnySet(); }
+  const KeyboardReport &GetReport() const { return report; }
+  size_t GetReportCount() const { return reportCount; }
+
+protected:
+  virtual void SendReport(const KeyboardReport &report) {}
+
+private:
+  KeyboardReport report;
+  BitField<256> changedKeys;
+  bool hasPendingKeyPress;
+  bool hasPendingModifierChange;
+  size_t reportCount;
+
+  void Update(KeyCode key, bool isPress);
+  bool IsConflicting(KeyCode key, bool isPress) const;
+};
+
+//---------------------------------------------------------------------------
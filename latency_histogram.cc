@@ -0,0 +1,97 @@
+//---------------------------------------------------------------------------
+
+#include "latency_histogram.h"
+#include "console.h"
+#include "mem.h"
+
+//---------------------------------------------------------------------------
+
+void LatencyHistogram::Reset() { Mem::Clear(*this); }
+
+size_t LatencyHistogram::GetBucketIndex(uint32_t microseconds) {
+  if (microseconds == 0) {
+    return 0;
+  }
+  const size_t index = 32 - __builtin_clz(microseconds);
+  return index < BUCKET_COUNT ? index : BUCKET_COUNT - 1;
+}
+
+void LatencyHistogram::Add(uint32_t microseconds) {
+  ++count;
+  total += microseconds;
+  if (microseconds > maximum) {
+    maximum = microseconds;
+  }
+  ++buckets[GetBucketIndex(microseconds)];
+}
+
+uint32_t LatencyHistogram::GetPercentile(uint32_t percent) const {
+  if (count == 0) {
+    return 0;
+  }
+
+  // Smallest number of samples that satisfies the percentile.
+  const uint64_t threshold = (uint64_t(count) * percent + 99) / 100;
+  uint64_t runningCount = 0;
+  for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+    runningCount += buckets[i];
+    if (runningCount >= threshold) {
+      if (i == BUCKET_COUNT - 1) {
+        break;
+      }
+      const uint32_t limit = GetBucketLimit(i);
+      return limit < maximum ? limit : maximum;
+    }
+  }
+  return maximum;
+}
+
+void LatencyHistogram::PrintJson() const {
+  Console::Printf("{\"count\":%u,\"mean\":%u,\"p50\":%u,\"p90\":%u,"
+                  "\"p99\":%u,\"max\":%u,\"buckets\":[",
+                  count, GetMean(), GetPercentile(50), GetPercentile(90),
+                  GetPercentile(99), maximum);
+
+  // Trailing empty buckets are omitted.
+  size_t bucketCount = BUCKET_COUNT;
+  while (bucketCount > 0 && buckets[bucketCount - 1] == 0) {
+    --bucketCount;
+  }
+  for (size_t i = 0; i < bucketCount; ++i) {
+    Console::Printf(i == 0 ? "%u" : ",%u", buckets[i]);
+  }
+  Console::Printf("]}");
+}
+
+//---------------------------------------------------------------------------
+#if RUN_TESTS
+
+#include "unit_test.h"
+
+TEST_BEGIN("LatencyHistogram tests") {
+  LatencyHistogram histogram;
+  histogram.Reset();
+  assert(histogram.GetPercentile(50) == 0);
+
+  for (uint32_t i = 1; i <= 100; ++i) {
+    histogram.Add(i);
+  }
+  assert(histogram.GetCount() == 100);
+  assert(histogram.GetMaximum() == 100);
+  assert(histogram.GetMean() == 50);
+
+  // 50 lies in the [32, 64) bucket, 99 and 100 in the [64, 128) bucket.
+  assert(histogram.GetPercentile(50) == 63);
+  assert(histogram.GetPercentile(99) == 100);
+  assert(histogram.GetPercentile(1) == 1);
+
+  histogram.Add(0xffffffff);
+  assert(histogram.GetPercentile(100) == 0xffffffff);
+
+  histogram.Reset();
+  assert(histogram.GetCount() == 0);
+}
+TEST_END
+
+#endif
+//---------------------------------------------------------------------------
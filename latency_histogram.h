@@ -0,0 +1,42 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------
+
+// A histogram of durations in microseconds with power of two buckets.
+//
+// Bucket 0 holds durations of 0us, bucket i holds [2^(i-1), 2^i) us, and the
+// last bucket holds everything larger.
+class LatencyHistogram {
+public:
+  void Reset();
+  void Add(uint32_t microseconds);
+
+  uint32_t GetCount() const { return count; }
+  uint32_t GetMaximum() const { return maximum; }
+  uint32_t GetMean() const { return count ? uint32_t(total / count) : 0; }
+
+  // Returns an upper bound for the specified percentile, in microseconds.
+  uint32_t GetPercentile(uint32_t percent) const;
+
+  // Prints the histogram as a JSON object.
+  void PrintJson() const;
+
+  static const size_t BUCKET_COUNT = 24;
+
+private:
+  uint32_t count = 0;
+  uint32_t maximum = 0;
+  uint64_t total = 0;
+  uint32_t buckets[BUCKET_COUNT] = {};
+
+  static size_t GetBucketIndex(uint32_t microseconds);
+  static uint32_t GetBucketLimit(size_t index) {
+    return index == 0 ? 0 : (1u << index) - 1;
+  }
+};
+
+//---------------------------------------------------------------------------
@@ -0,0 +1,53 @@
+//---------------------------------------------------------------------------
+
+#include "malloc_count.h"
+
+//---------------------------------------------------------------------------
+
+#if ENABLE_MALLOC_COUNT
+
+thread_local size_t MallocCount::count = 0;
+
+void *AddMallocCount(void *p) {
+  ++MallocCount::count;
+  return p;
+}
+
+// glibc exports its allocator under these names so that programs can
+// interpose malloc while still using the same heap.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size) { return AddMallocCount(__libc_malloc(size)); }
+
+void *calloc(size_t count, size_t size) {
+  return AddMallocCount(__libc_calloc(count, size));
+}
+
+void *realloc(void *p, size_t size) {
+  return AddMallocCount(__libc_realloc(p, size));
+}
+}
+
+#endif
+
+//---------------------------------------------------------------------------
+
+#include "unit_test.h"
+
+TEST_BEGIN("MallocCount counts allocations on the calling thread") {
+  if (!MallocCount::IsAvailable()) {
+    return;
+  }
+
+  const size_t start = MallocCount::Get();
+  void *volatile p = malloc(16);
+  p = realloc(p, 32);
+  free(p);
+  assert(MallocCount::Get() - start == 2);
+}
+TEST_END
+
+//---------------------------------------------------------------------------
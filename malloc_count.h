@@ -0,0 +1,39 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include <stddef.h>
+#include <stdlib.h>
+
+//---------------------------------------------------------------------------
+
+#if RUN_TESTS && defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) &&      \
+    !defined(__SANITIZE_THREAD__)
+#define ENABLE_MALLOC_COUNT 1
+#else
+#define ENABLE_MALLOC_COUNT 0
+#endif
+
+//---------------------------------------------------------------------------
+
+// Counts heap allocations made by the calling thread.
+//
+// On host test builds malloc, calloc and realloc are interposed so that
+// benchmarks and tests can measure allocations per stroke. Elsewhere the
+// count is always 0.
+class MallocCount {
+public:
+  static bool IsAvailable() { return ENABLE_MALLOC_COUNT; }
+
+#if ENABLE_MALLOC_COUNT
+  static size_t Get() { return count; }
+
+private:
+  static thread_local size_t count;
+
+  friend void *AddMallocCount(void *p);
+#else
+  static size_t Get() { return 0; }
+#endif
+};
+
+//---------------------------------------------------------------------------
@@ -11,46 +11,135 @@
 
 //---------------------------------------------------------------------------
 
-const size_t MAXIMUM_CACHEABLE_WORD_LENGTH = 64;
-
-//---------------------------------------------------------------------------
-
+// Candidates are ranked together when the result is needed, so their word
+// list lookups share a single pass over the list. Ties go to the earliest
+// candidate.
 class StenoCompiledOrthography::BestCandidate {
 public:
-  void Add(char *newCandidate, int score);
+  BestCandidate(const WordList &wordList) : wordList(wordList) {}
 
-  char *GetResult() const { return candidate; }
+  // Takes ownership of newCandidate. defaultScore is used if it's not in the
+  // word list.
+  void Add(char *newCandidate, int defaultScore);
 
-  bool IsEmpty() const { return candidate == nullptr; }
-  bool IsNotEmpty() const { return candidate != nullptr; }
+  // Returns the best candidate, which the caller owns, or nullptr.
+  char *TakeResult();
 
   static const int NOT_IN_WORD_LIST_SCORE = WordList::MAX_SCORE + 1;
   static const int FALLBACK_SCORE = WordList::MAX_SCORE + 2;
   static const int EXCLUDE_WORD_SCORE = WordList::MAX_SCORE + 4;
 
 private:
-  char *candidate = nullptr;
-  int score = WordList::MAX_SCORE + 3;
+  static const size_t MAXIMUM_CANDIDATE_COUNT = 8;
+  static_assert(MAXIMUM_CANDIDATE_COUNT <= WordList::MAXIMUM_BATCH_COUNT);
+
+  // Candidates must score below this to be used.
+  static const int INITIAL_SCORE = WordList::MAX_SCORE + 3;
+
+  struct Candidate {
+    char *text;
+    int score;
+  };
+
+  const WordList &wordList;
+
+  // Candidates before rankedCount have their final score.
+  size_t count = 0;
+  size_t rankedCount = 0;
+  Candidate candidates[MAXIMUM_CANDIDATE_COUNT];
+
+  // Ranks the candidates, and keeps only the best.
+  void Rank();
 };
 
 void StenoCompiledOrthography::BestCandidate::Add(char *newCandidate,
-                                                  int newScore) {
-  char *unused;
-  if (newScore < score) {
-    unused = candidate;
-    candidate = newCandidate;
-    score = newScore;
+                                                  int defaultScore) {
+  // Nothing can beat the best possible score.
+  if (rankedCount != 0 && candidates[0].score == 0) {
+    free(newCandidate);
+    return;
+  }
+
+  // A repeated candidate has the same rank as the earlier one, so can only
+  // win with a lower default score. This holds for ranked candidates too:
+  // one not in the word list still has its default score.
+  for (size_t i = 0; i < count; ++i) {
+    if (Str::Eq(candidates[i].text, newCandidate) &&
+        candidates[i].score <= defaultScore) {
+      free(newCandidate);
+      return;
+    }
+  }
+
+  if (count == MAXIMUM_CANDIDATE_COUNT) {
+    Rank();
+  }
+  candidates[count++] = {
+      .text = newCandidate,
+      .score = defaultScore,
+  };
+}
+
+void StenoCompiledOrthography::BestCandidate::Rank() {
+  const size_t unrankedCount = count - rankedCount;
+  if (unrankedCount != 0) {
+    const char *texts[MAXIMUM_CANDIDATE_COUNT];
+    int scores[MAXIMUM_CANDIDATE_COUNT];
+    for (size_t i = 0; i < unrankedCount; ++i) {
+      texts[i] = candidates[rankedCount + i].text;
+      scores[i] = candidates[rankedCount + i].score;
+    }
+    wordList.GetRanks(texts, scores, unrankedCount);
+    for (size_t i = 0; i < unrankedCount; ++i) {
+      candidates[rankedCount + i].score = scores[i];
+    }
+  }
+
+  size_t bestIndex = count;
+  int bestScore = INITIAL_SCORE;
+  for (size_t i = 0; i < count; ++i) {
+    if (candidates[i].score < bestScore) {
+      bestIndex = i;
+      bestScore = candidates[i].score;
+    }
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (i != bestIndex) {
+      free(candidates[i].text);
+    }
+  }
+
+  if (bestIndex == count) {
+    count = 0;
   } else {
-    unused = newCandidate;
+    candidates[0] = candidates[bestIndex];
+    count = 1;
   }
-  free(unused);
+  rankedCount = count;
+}
+
+char *StenoCompiledOrthography::BestCandidate::TakeResult() {
+  // A single candidate that will be used whatever its rank doesn't need
+  // ranking.
+  if (count != 1 || candidates[0].score >= INITIAL_SCORE) {
+    Rank();
+  }
+  return count ? candidates[0].text : nullptr;
 }
 
 //---------------------------------------------------------------------------
 
-#if USE_ORTHOGRAPHY_CACHE
+#if RECORD_ORTHOGRAPHY_STATS
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
+StenoCompiledOrthography::Stats StenoCompiledOrthography::stats;
+#else
+thread_local StenoCompiledOrthography::Stats StenoCompiledOrthography::stats;
+#endif
+#endif
 
-#define RECORD_ORTHOGRAPHY_CACHE_STATS 0
+//---------------------------------------------------------------------------
+
+#if USE_ORTHOGRAPHY_CACHE
 
 #if RUN_TESTS
 
@@ -63,61 +152,65 @@ inline char *StenoCompiledOrthography::CacheEntry::DupResult() const {
   return Str::DupN(GetResult(), resultLength);
 }
 
-void StenoCompiledOrthography::CacheEntry::Set(const char *word,
-                                               const char *suffix,
-                                               const char *result) {
-  free(base);
-
-  const size_t wordLength = Str::Length(word);
-  const size_t suffixLength = Str::Length(suffix);
-  const size_t resultLength = Str::Length(result);
+void StenoCompiledOrthography::CacheEntry::Set(
+    uint8_t tag, const char *word, size_t wordLength, const char *suffix,
+    size_t suffixLength, const char *result, size_t resultLength) {
+  this->tag = tag;
+  isReferenced = false;
   this->resultLength = resultLength;
-  base = (char *)malloc(wordLength + suffixLength + resultLength + 3);
 
-  char *p = base;
+  char *p = text;
   memcpy(p, word, wordLength + 1);
   p += wordLength + 1;
 
-  suffixOffset = p - base;
+  suffixOffset = p - text;
   memcpy(p, suffix, suffixLength + 1);
   p += suffixLength + 1;
 
-  resultOffset = p - base;
+  resultOffset = p - text;
   memcpy(p, result, resultLength + 1);
 }
 
-bool StenoCompiledOrthography::CacheEntry::IsEqual(const char *word,
+bool StenoCompiledOrthography::CacheEntry::IsEqual(uint8_t tag,
+                                                   const char *word,
+                                                   size_t wordLength,
                                                    const char *suffix) const {
-  return base != nullptr && Str::Eq(word, GetWord()) &&
-         Str::Eq(suffix, GetSuffix());
+  return this->tag == tag && suffixOffset == wordLength + 1 &&
+         memcmp(text, word, wordLength) == 0 && Str::Eq(suffix, GetSuffix());
 }
 
-char *StenoCompiledOrthography::CacheBlock::Lookup(const char *word,
-                                                   const char *suffix) const {
-  LockCache();
-  for (size_t i = 0; i < CACHE_ASSOCIATIVITY; ++i) {
-    const CacheEntry &entry = entries[i];
-    if (entry.IsEqual(word, suffix)) {
-      char *result = entry.DupResult();
-      UnlockCache();
-      return result;
+char *StenoCompiledOrthography::CacheBlock::Lookup(uint8_t tag,
+                                                   const char *word,
+                                                   size_t wordLength,
+                                                   const char *suffix) {
+  for (CacheEntry &entry : entries) {
+    if (entry.IsEqual(tag, word, wordLength, suffix)) {
+      entry.isReferenced = true;
+      return entry.DupResult();
     }
   }
-
-  UnlockCache();
   return nullptr;
 }
 
-void StenoCompiledOrthography::CacheBlock::AddEntry(const char *word,
-                                                    const char *suffix,
-                                                    const char *result) {
-  LockCache();
-
-  const size_t entryIndex = entries[0].blockIndex++ & (CACHE_ASSOCIATIVITY - 1);
-  CacheEntry &entry = entries[entryIndex];
-  entry.Set(word, suffix, result);
+// Returns true if an entry was evicted.
+bool StenoCompiledOrthography::CacheBlock::AddEntry(
+    uint8_t tag, const char *word, size_t wordLength, const char *suffix,
+    size_t suffixLength, const char *result, size_t resultLength) {
+  for (;;) {
+    CacheEntry &entry = entries[hand];
+    if (++hand == CACHE_ASSOCIATIVITY) {
+      hand = 0;
+    }
+    if (entry.isReferenced) {
+      entry.isReferenced = false;
+      continue;
+    }
 
-  UnlockCache();
+    const bool isEviction = !entry.IsEmpty();
+    entry.Set(tag, word, wordLength, suffix, suffixLength, result,
+              resultLength);
+    return isEviction;
+  }
 }
 
 #endif
@@ -192,55 +285,372 @@ void StenoOrthography::Print() const {
 
 //---------------------------------------------------------------------------
 
+// Selects the rules that can match a word and suffix without running their
+// patterns.
+//
+// Rule patterns match "word ^suffix", and nearly all of them have literal
+// text immediately either side of the " \^" separator, e.g. "y \^s$". These
+// literals are extracted from the pattern source, and rules are grouped by
+// the first character of their suffix literal so that only a small list of
+// rules needs to be considered for any suffix.
+class StenoCompiledOrthography::RuleDispatch {
+public:
+  static const RuleDispatch *Create(const StenoOrthography &orthography);
+
+  // Returns the rules that can match, in rule order. The result is only
+  // valid when neither word nor suffix contain '^', as otherwise the pattern
+  // separator can match inside them.
+  const SizedList<uint16_t> &GetCandidates(const char *suffix) const {
+    return lists[listIndexes[uint8_t(*suffix)]];
+  }
+
+  bool IsPossibleMatch(size_t ruleIndex, const char *word, size_t wordLength,
+                       const char *suffix, size_t suffixLength) const {
+    return filters[ruleIndex].IsPossibleMatch(word, wordLength, suffix,
+                                              suffixLength);
+  }
+
+private:
+  // Literals required either side of the separator. These are necessary
+  // conditions only, so rules that pass still need their pattern matched.
+  struct Filter {
+    const char *wordEnding;
+    const char *suffix;
+    uint8_t wordEndingLength;
+    uint8_t suffixLength;
+    bool isExactSuffix;
+
+    void Set(const char *pattern);
+    bool IsPossibleMatch(const char *word, size_t wordLength,
+                         const char *suffix, size_t suffixLength) const;
+
+    static bool IsLiteral(char c) {
+      return c != '\0' && strchr(")|^$(\\[.*+?", c) == nullptr;
+    }
+  };
+
+  Filter *filters;
+
+  // Index 0 is the list of rules without a suffix literal.
+  uint8_t listIndexes[256];
+  SizedList<uint16_t> lists[];
+};
+
+void StenoCompiledOrthography::RuleDispatch::Filter::Set(const char *pattern) {
+  *this = {};
+
+  // Find the separator. Filters are only used when there is exactly one,
+  // outside of any group or top level alternation.
+  const char *separator = nullptr;
+  int depth = 0;
+  for (const char *p = pattern; *p; ++p) {
+    switch (*p) {
+    case '\\':
+      if (p[1] == '^') {
+        if (separator != nullptr || depth != 0) {
+          return;
+        }
+        separator = p;
+      }
+      if (p[1] != '\0') {
+        ++p;
+      }
+      break;
+    case '[':
+      while (p[1] != '\0' && p[1] != ']') {
+        ++p;
+      }
+      break;
+    case '(':
+      ++depth;
+      break;
+    case ')':
+      --depth;
+      break;
+    case '|':
+      if (depth == 0) {
+        return;
+      }
+      break;
+    }
+  }
+  if (separator == nullptr || separator[2] == '*' || separator[2] == '?') {
+    return;
+  }
+
+  // Literals directly after the separator are a required suffix prefix,
+  // except for a final character made optional by a quantifier.
+  const char *suffixStart = separator + 2;
+  const char *p = suffixStart;
+  while (IsLiteral(*p)) {
+    ++p;
+  }
+  size_t length = p - suffixStart;
+  if ((*p == '*' || *p == '?') && length != 0) {
+    --length;
+  }
+  if (length > 0xff) {
+    length = 0xff;
+  }
+  suffix = suffixStart;
+  suffixLength = length;
+  isExactSuffix = p[0] == '$' && p[1] == '\0' && length == size_t(p - suffix);
+
+  // Literals directly before the separator must end the text preceding it.
+  // Quantifiers are postfix, so none of these characters can be optional.
+  // Escaped characters, such as back references, stop the scan.
+  const char *q = separator;
+  while (q > pattern && IsLiteral(q[-1]) && q[-1] != ']' &&
+         (q - 1 == pattern || q[-2] != '\\') && separator - q < 0xff) {
+    --q;
+  }
+  wordEnding = q;
+  wordEndingLength = separator - q;
+}
+
+bool StenoCompiledOrthography::RuleDispatch::Filter::IsPossibleMatch(
+    const char *word, size_t wordLength, const char *suffix,
+    size_t suffixLength) const {
+  if (isExactSuffix ? suffixLength != this->suffixLength
+                    : suffixLength < this->suffixLength) {
+    return false;
+  }
+  if (this->suffixLength != 0 &&
+      memcmp(suffix, this->suffix, this->suffixLength) != 0) {
+    return false;
+  }
+  if (wordEndingLength == 0) {
+    return true;
+  }
+
+  // The text being matched has a space between the word and the separator.
+  if (wordEnding[wordEndingLength - 1] != ' ') {
+    return false;
+  }
+  const size_t length = wordEndingLength - 1;
+  return length <= wordLength &&
+         memcmp(word + wordLength - length, wordEnding, length) == 0;
+}
+
+const StenoCompiledOrthography::RuleDispatch *
+StenoCompiledOrthography::RuleDispatch::Create(
+    const StenoOrthography &orthography) {
+  const size_t ruleCount = orthography.rules.GetCount();
+  assert(ruleCount <= 0xffff);
+
+  Filter *filters = (Filter *)malloc(sizeof(Filter) * ruleCount);
+  bool hasFirstCharacter[256] = {};
+  size_t unfilteredCount = 0;
+  for (size_t i = 0; i < ruleCount; ++i) {
+    filters[i].Set(orthography.rules[i].testPattern);
+    if (filters[i].suffixLength == 0) {
+      ++unfilteredCount;
+    } else {
+      hasFirstCharacter[uint8_t(filters[i].suffix[0])] = true;
+    }
+  }
+
+  size_t listCount = 1;
+  for (bool hasList : hasFirstCharacter) {
+    listCount += hasList;
+  }
+  assert(listCount <= 0x100);
+
+  // Every list contains the unfiltered rules.
+  const size_t indexCount =
+      listCount * unfilteredCount + (ruleCount - unfilteredCount);
+  RuleDispatch *dispatch = (RuleDispatch *)malloc(
+      sizeof(RuleDispatch) + sizeof(SizedList<uint16_t>) * listCount);
+  uint16_t *indexes = (uint16_t *)malloc(sizeof(uint16_t) * indexCount);
+  dispatch->filters = filters;
+
+  size_t listIndex = 0;
+  for (size_t c = 0; c < 256; ++c) {
+    if (c != 0 && !hasFirstCharacter[c]) {
+      dispatch->listIndexes[c] = 0;
+      continue;
+    }
+
+    uint16_t *listStart = indexes;
+    for (size_t i = 0; i < ruleCount; ++i) {
+      const Filter &filter = filters[i];
+      if (filter.suffixLength == 0 ||
+          (c != 0 && uint8_t(filter.suffix[0]) == c)) {
+        *indexes++ = i;
+      }
+    }
+    dispatch->listIndexes[c] = listIndex;
+    dispatch->lists[listIndex++] = SizedList<uint16_t>{
+        .count = size_t(indexes - listStart),
+        .data = listStart,
+    };
+  }
+
+  return dispatch;
+}
+
+//---------------------------------------------------------------------------
+
+StenoCompiledOrthography::StenoCompiledOrthography(
+    const StenoOrthography &orthography,
+    const StenoOrthographySnapshot *snapshot,
+    const StenoEngineContext &context)
+    : data(orthography),
+      snapshot(snapshot && snapshot->IsValid(orthography) ? snapshot
+                                                          : nullptr),
+      patterns(CreatePatterns(orthography, this->snapshot)),
+      ruleDispatch(RuleDispatch::Create(orthography)), context(context) {
+#if USE_ORTHOGRAPHY_CACHE
+  Mem::Clear(cache);
+  Mem::Clear(cacheStats);
+#endif
+}
+
 StenoCompiledOrthography::StenoCompiledOrthography(
-    const StenoOrthography &orthography)
-    : data(orthography), patterns(CreatePatterns(orthography)) {
+    const StenoCompiledOrthography &orthography,
+    const StenoEngineContext &context)
+    : data(orthography.data), snapshot(orthography.snapshot),
+      patterns(orthography.patterns),
+      ruleDispatch(orthography.ruleDispatch), context(context) {
 #if USE_ORTHOGRAPHY_CACHE
   Mem::Clear(cache);
+  Mem::Clear(cacheStats);
 #endif
 }
 
-const Pattern *
-StenoCompiledOrthography::CreatePatterns(const StenoOrthography &orthography) {
+const Pattern *StenoCompiledOrthography::CreatePatterns(
+    const StenoOrthography &orthography,
+    const StenoOrthographySnapshot *snapshot) {
   Pattern *patterns =
       (Pattern *)malloc(sizeof(Pattern) * orthography.rules.GetCount());
   for (size_t i = 0; i < orthography.rules.GetCount(); ++i) {
-    patterns[i] = Pattern::Compile(orthography.rules[i].testPattern);
+    const PatternSnapshot *patternSnapshot =
+        snapshot ? snapshot->GetPattern(i) : nullptr;
+    patterns[i] = patternSnapshot
+                      ? Pattern::FromSnapshot(patternSnapshot)
+                      : Pattern::Compile(orthography.rules[i].testPattern);
   }
   return patterns;
 }
 
-#if USE_ORTHOGRAPHY_CACHE
+Pattern
+StenoCompiledOrthography::CreateReverseAutoSuffixPattern(size_t index) const {
+  const PatternSnapshot *patternSnapshot =
+      snapshot ? snapshot->GetReverseAutoSuffixPattern(index) : nullptr;
+  return patternSnapshot
+             ? Pattern::FromSnapshot(patternSnapshot)
+             : Pattern::Compile(data.reverseAutoSuffixes[index].testPattern);
+}
+
+//---------------------------------------------------------------------------
+
+uint32_t
+StenoOrthographySnapshot::GetRulesCrc(const StenoOrthography &orthography) {
+  uint32_t crc = 0;
+  for (const StenoOrthographyRule &rule : orthography.rules) {
+    crc = crc * 31 + Crc32(rule.testPattern, strlen(rule.testPattern));
+  }
+  for (const StenoOrthographyReverseAutoSuffix &reverseAutoSuffix :
+       orthography.reverseAutoSuffixes) {
+    crc = crc * 31 + Crc32(reverseAutoSuffix.testPattern,
+                           strlen(reverseAutoSuffix.testPattern));
+  }
+  return crc;
+}
+
+bool StenoOrthographySnapshot::IsValid(
+    const StenoOrthography &orthography) const {
+  return magic == MAGIC && ruleCount == orthography.rules.GetCount() &&
+         reverseAutoSuffixCount ==
+             orthography.reverseAutoSuffixes.GetCount() &&
+         rulesCrc == GetRulesCrc(orthography);
+}
+
+#if JAVELIN_USE_PATTERN_SNAPSHOT_WRITER
+
+void StenoOrthographySnapshot::Create(List<uint8_t> &buffer,
+                                      const StenoOrthography &orthography) {
+  const size_t ruleCount = orthography.rules.GetCount();
+  const size_t reverseAutoSuffixCount =
+      orthography.reverseAutoSuffixes.GetCount();
+  const size_t patternCount = ruleCount + reverseAutoSuffixCount;
+  const StenoOrthographySnapshot header = {
+      .magic = MAGIC,
+      .rulesCrc = GetRulesCrc(orthography),
+      .ruleCount = uint32_t(ruleCount),
+      .reverseAutoSuffixCount = uint32_t(reverseAutoSuffixCount),
+  };
+
+  const size_t start = buffer.GetCount();
+  buffer.AddCount((const uint8_t *)&header, sizeof(header));
+  for (size_t i = 0; i < patternCount; ++i) {
+    const uint32_t offset = 0;
+    buffer.AddCount((const uint8_t *)&offset, sizeof(offset));
+  }
+
+  for (size_t i = 0; i < patternCount; ++i) {
+    const char *testPattern =
+        i < ruleCount
+            ? orthography.rules[i].testPattern
+            : orthography.reverseAutoSuffixes[i - ruleCount].testPattern;
+    const uint32_t offset = buffer.GetCount() - start;
+    if (Pattern::CreateSnapshot(buffer, testPattern)) {
+      memcpy(begin(buffer) + start + sizeof(header) + i * sizeof(offset),
+             &offset, sizeof(offset));
+    }
+  }
+}
 
-#if RECORD_ORTHOGRAPHY_CACHE_STATS
-static size_t cacheHits;
-static size_t cacheMisses;
 #endif
+
+#if USE_ORTHOGRAPHY_CACHE
+
 char *StenoCompiledOrthography::AddSuffix(const char *word,
                                           const char *suffix) const {
+#if RECORD_ORTHOGRAPHY_STATS
+  stats.addSuffixCount++;
+#endif
+
   const size_t wordLength = Str::Length(word);
-  if (wordLength >= MAXIMUM_CACHEABLE_WORD_LENGTH) {
+  const size_t suffixLength = Str::Length(suffix);
+  if (!CacheEntry::CanStore(wordLength, suffixLength, 0)) {
+    context.LockOrthographyCache();
+    cacheStats.uncachedCount++;
+    context.UnlockOrthographyCache();
     return AddSuffixInternal(word, suffix);
   }
 
-  const uint32_t crc =
-      Crc32(word, wordLength) ^ Crc32(suffix, Str::Length(suffix));
+  const uint32_t crc = Crc32(word, wordLength) ^ Crc32(suffix, suffixLength);
+  const uint8_t tag = crc >> 24;
+  CacheBlock &block = cache[crc & (CACHE_BLOCK_COUNT - 1)];
 
-  const size_t blockIndex = crc & (CACHE_BLOCK_COUNT - 1);
-  char *cachedResult = cache[blockIndex].Lookup(word, suffix);
+  context.LockOrthographyCache();
+  char *cachedResult = block.Lookup(tag, word, wordLength, suffix);
   if (cachedResult) {
-#if RECORD_ORTHOGRAPHY_CACHE_STATS
-    cacheHits++;
+    cacheStats.hitCount++;
+    context.UnlockOrthographyCache();
+#if RECORD_ORTHOGRAPHY_STATS
+    stats.cacheHitCount++;
 #endif
     return cachedResult;
   }
+  cacheStats.missCount++;
+  context.UnlockOrthographyCache();
 
-#if RECORD_ORTHOGRAPHY_CACHE_STATS
-  cacheMisses++;
+#if RECORD_ORTHOGRAPHY_STATS
+  stats.cacheMissCount++;
 #endif
 
   char *result = AddSuffixInternal(word, suffix);
-  cache[blockIndex].AddEntry(word, suffix, result);
+  const size_t resultLength = Str::Length(result);
+  context.LockOrthographyCache();
+  if (!CacheEntry::CanStore(wordLength, suffixLength, resultLength)) {
+    cacheStats.uncachedCount++;
+  } else if (block.AddEntry(tag, word, wordLength, suffix, suffixLength,
+                            result, resultLength)) {
+    cacheStats.evictionCount++;
+  }
+  context.UnlockOrthographyCache();
   return result;
 }
 
@@ -249,8 +659,11 @@ char *StenoCompiledOrthography::AddSuffixInternal(const char *word,
 #else
 char *StenoCompiledOrthography::AddSuffix(const char *word,
                                           const char *suffix) const {
+#if RECORD_ORTHOGRAPHY_STATS
+  stats.addSuffixCount++;
 #endif
-  BestCandidate bestCandidate;
+#endif
+  BestCandidate bestCandidate(context.GetWordList());
 
   for (const StenoOrthographyAlias &alias : data.aliases) {
     if (Str::Eq(suffix, alias.text)) {
@@ -259,15 +672,12 @@ char *StenoCompiledOrthography::AddSuffix(const char *word,
     }
   }
 
-  char *simple = Str::Join(word, suffix);
-  const int score =
-      WordList::GetWordRank(simple, BestCandidate::FALLBACK_SCORE);
-  bestCandidate.Add(simple, score);
+  bestCandidate.Add(Str::Join(word, suffix), BestCandidate::FALLBACK_SCORE);
 
   AddCandidates(bestCandidate, word, suffix,
                 BestCandidate::NOT_IN_WORD_LIST_SCORE);
 
-  return bestCandidate.GetResult();
+  return bestCandidate.TakeResult();
 }
 
 char *StenoCompiledOrthography::AddSuffixToPhrase(const char *phrase,
@@ -312,31 +722,51 @@ void StenoCompiledOrthography::AddCandidates(BestCandidate &bestCandidate,
 
   const PatternQuickReject inputQuickReject(text);
 
-  for (size_t i = 0; i < data.rules.GetCount(); ++i) {
-    const Pattern &pattern = patterns[i];
-    if (!pattern.IsPossibleMatch(inputQuickReject)) {
-      continue;
+  // A '^' in the word or suffix could be matched as the separator, in which
+  // case every rule is tried.
+  if (strchr(word, '^') != nullptr || strchr(suffix, '^') != nullptr) {
+    for (size_t i = 0; i < data.rules.GetCount(); ++i) {
+      AddCandidate(bestCandidate, i, word, offset, text, inputQuickReject,
+                   defaultScore);
     }
-
-    const PatternMatch match = pattern.MatchBypassingQuickReject(text);
-    if (!match.match) {
-      continue;
+  } else {
+    const size_t suffixLength = strlen(suffix);
+    for (const uint16_t i : ruleDispatch->GetCandidates(suffix)) {
+      if (ruleDispatch->IsPossibleMatch(i, word, wordLength, suffix,
+                                        suffixLength)) {
+        AddCandidate(bestCandidate, i, word, offset, text, inputQuickReject,
+                     defaultScore);
+      }
     }
+  }
+  free(text);
+}
 
-    char *candidate = match.Replace(data.rules[i].replacement);
-    if (offset != 0) {
-      const size_t candidateWithNulLength = strlen(candidate) + 1;
-      char *fullCandidate = (char *)malloc(offset + candidateWithNulLength);
-      memcpy(fullCandidate, word, offset);
-      memcpy(fullCandidate + offset, candidate, candidateWithNulLength);
-      free(candidate);
-      candidate = fullCandidate;
-    }
+void StenoCompiledOrthography::AddCandidate(
+    BestCandidate &bestCandidate, size_t ruleIndex, const char *word,
+    size_t offset, const char *text, PatternQuickReject inputQuickReject,
+    int defaultScore) const {
+  const Pattern &pattern = patterns[ruleIndex];
+  if (!pattern.IsPossibleMatch(inputQuickReject)) {
+    return;
+  }
 
-    const int score = WordList::GetWordRank(candidate, defaultScore);
-    bestCandidate.Add(candidate, score);
+  const PatternMatch match = pattern.MatchBypassingQuickReject(text);
+  if (!match.match) {
+    return;
   }
-  free(text);
+
+  char *candidate = match.Replace(data.rules[ruleIndex].replacement);
+  if (offset != 0) {
+    const size_t candidateWithNulLength = strlen(candidate) + 1;
+    char *fullCandidate = (char *)malloc(offset + candidateWithNulLength);
+    memcpy(fullCandidate, word, offset);
+    memcpy(fullCandidate + offset, candidate, candidateWithNulLength);
+    free(candidate);
+    candidate = fullCandidate;
+  }
+
+  bestCandidate.Add(candidate, defaultScore);
 }
 
 //---------------------------------------------------------------------------
@@ -348,10 +778,166 @@ void StenoCompiledOrthography::PrintInfo() const {
   Console::Printf("      Auto-suffixes: %zu\n", data.autoSuffixes.GetCount());
   Console::Printf("      Reverse auto-suffixes: %zu\n",
                   data.reverseAutoSuffixes.GetCount());
-#if RECORD_ORTHOGRAPHY_CACHE_STATS
-  Console::Printf("      Cache hits: %zu/%zu\n", cacheHits,
-                  cacheHits + cacheMisses);
+#if USE_ORTHOGRAPHY_CACHE
+  const size_t lookupCount = cacheStats.hitCount + cacheStats.missCount;
+  Console::Printf("      Cache: %zu entries, %zu-way, %zu bytes\n", CACHE_SIZE,
+                  CACHE_ASSOCIATIVITY, sizeof(cache));
+  Console::Printf("      Cache hits: %zu/%zu (%zu%%)\n", cacheStats.hitCount,
+                  lookupCount,
+                  lookupCount ? 100 * cacheStats.hitCount / lookupCount : 0);
+  Console::Printf("      Cache evictions: %zu, uncached: %zu\n",
+                  cacheStats.evictionCount, cacheStats.uncachedCount);
 #endif
+#if JAVELIN_USE_PATTERN_DFA
+  size_t dfaStateCount = 0;
+  size_t dfaMemoryUsage = 0;
+  for (size_t i = 0; i < data.rules.GetCount(); ++i) {
+    dfaStateCount += patterns[i].GetDfaStateCount();
+    dfaMemoryUsage += patterns[i].GetDfaMemoryUsage();
+  }
+  Console::Printf("      Pattern DFA states: %zu, %zu bytes\n", dfaStateCount,
+                  dfaMemoryUsage);
+#endif
+}
+
+//---------------------------------------------------------------------------
+
+#include "unit_test.h"
+
+TEST_BEGIN("Orthography: Rule dispatch selects matching rules") {
+  static const StenoOrthographyRule RULES[] = {
+      {"^(.*)e \\^ing$", "\\1ing"},
+      {"^(.*[bcdfghjklmnpqrstvwxz])y \\^s$", "\\1ies"},
+      {"^(.*)(s|sh|x|z|ch) \\^s$", "\\1\\2es"},
+      {"^(.*)e \\^(ed|er)$", "\\1\\2"},
+      {"^(.*[aeiou])([bdgmnpt]) \\^(ed|ing|er)$", "\\1\\2\\2\\3"},
+      {"^(.*)c \\^(al|ly)?$", "\\1cal"},
+      {"^(.*)ic \\^a?l$", "\\1ical"},
+      {"^(ab \\^c|(.*)q \\^s)$", "\\2qs"},
+      {"^(.*) \\^(.*)$", "\\1-\\2"},
+  };
+  static const StenoOrthography ORTHOGRAPHY = {
+      .rules = {sizeof(RULES) / sizeof(*RULES), RULES},
+      .aliases = {0, nullptr},
+      .autoSuffixMask = StenoStroke(),
+      .autoSuffixes = {0, nullptr},
+      .reverseAutoSuffixes = {0, nullptr},
+  };
+  const StenoCompiledOrthography orthography(ORTHOGRAPHY);
+
+  static const char *const TESTS[][3] = {
+      {"make", "ing", "making"},
+      {"try", "s", "tries"},
+      {"box", "s", "boxes"},
+      {"bush", "s", "bushes"},
+      {"hope", "ed", "hoped"},
+      {"stop", "ing", "stopping"},
+      {"stop", "s", "stop-s"},
+      {"magic", "", "magical"},
+      {"magic", "al", "magical"},
+      {"ironic", "l", "ironical"},
+      {"faq", "s", "faqs"},
+      {"a^b", "s", "a^b-s"},
+      {"cat", "^s", "cat-^s"},
+  };
+  for (const auto &test : TESTS) {
+    char *result = orthography.AddSuffix(test[0], test[1]);
+    assert(Str::Eq(result, test[2]));
+    free(result);
+  }
 }
+TEST_END
+
+#if JAVELIN_USE_PATTERN_SNAPSHOT_WRITER
+TEST_BEGIN("Orthography: Snapshot rules match compiled rules") {
+  static const StenoOrthographyRule RULES[] = {
+      {"^(.*)e \\^ing$", "\\1ing"},
+      {"^(.*[bcdfghjklmnpqrstvwxz])y \\^s$", "\\1ies"},
+      {"^(.*[aeiou])([bdgmnpt]) \\^(ed|ing|er)$", "\\1\\2\\2\\3"},
+      {"^(.*)c \\^(al|ly)?$", "\\1cal"},
+  };
+  static StenoOrthographyAutoSuffix AUTO_SUFFIXES[] = {
+      {StenoStroke(), "{^s}"},
+  };
+  static const StenoOrthographyReverseAutoSuffix REVERSE_AUTO_SUFFIXES[] = {
+      {&AUTO_SUFFIXES[0], StenoStroke(), "^(.*[bdgkpt])s$", "\\1"},
+  };
+  static const StenoOrthography ORTHOGRAPHY = {
+      .rules = {sizeof(RULES) / sizeof(*RULES), RULES},
+      .aliases = {0, nullptr},
+      .autoSuffixMask = StenoStroke(),
+      .autoSuffixes = {1, AUTO_SUFFIXES},
+      .reverseAutoSuffixes = {1, REVERSE_AUTO_SUFFIXES},
+  };
+
+  List<uint8_t> buffer;
+  StenoOrthographySnapshot::Create(buffer, ORTHOGRAPHY);
+  const StenoOrthographySnapshot *snapshot =
+      (const StenoOrthographySnapshot *)begin(buffer);
+  assert(snapshot->IsValid(ORTHOGRAPHY));
+  assert(!snapshot->IsValid(StenoOrthography::emptyOrthography));
+  for (size_t i = 0; i < snapshot->ruleCount; ++i) {
+    assert(snapshot->GetPattern(i) != nullptr);
+  }
+  assert(snapshot->GetReverseAutoSuffixPattern(0) != nullptr);
+
+  const StenoCompiledOrthography compiled(ORTHOGRAPHY);
+  const StenoCompiledOrthography loaded(ORTHOGRAPHY, snapshot);
+
+  const Pattern reversePattern = loaded.CreateReverseAutoSuffixPattern(0);
+  assert(reversePattern.Match("cats").match);
+  assert(!reversePattern.Match("glass").match);
+
+  static const char *const TESTS[][2] = {
+      {"make", "ing"}, {"try", "s"},  {"stop", "ing"}, {"stop", "s"},
+      {"magic", ""},   {"magic", "ly"}, {"hope", "ed"},
+  };
+  for (const auto &test : TESTS) {
+    char *expected = compiled.AddSuffix(test[0], test[1]);
+    char *actual = loaded.AddSuffix(test[0], test[1]);
+    assert(Str::Eq(actual, expected));
+    free(expected);
+    free(actual);
+  }
+}
+TEST_END
+#endif
+
+#if USE_ORTHOGRAPHY_CACHE
+TEST_BEGIN("Orthography: Cache keeps referenced entries") {
+  const StenoCompiledOrthography orthography(
+      StenoOrthography::emptyOrthography);
+
+  char *first = orthography.AddSuffix("cat", "s");
+  assert(Str::Eq(first, "cats"));
+  free(first);
+
+  // Referenced entries survive any number of insertions into their set.
+  for (size_t i = 0; i < 4 * JAVELIN_ORTHOGRAPHY_CACHE_SIZE; ++i) {
+    char word[16];
+    Str::Sprintf(word, "w%zu", i);
+    free(orthography.AddSuffix(word, "s"));
+
+    char *result = orthography.AddSuffix("cat", "s");
+    assert(Str::Eq(result, "cats"));
+    free(result);
+  }
+
+  const StenoCompiledOrthography::CacheStats &stats =
+      orthography.GetCacheStats();
+  assert(stats.hitCount == 4 * JAVELIN_ORTHOGRAPHY_CACHE_SIZE);
+  assert(stats.missCount == 4 * JAVELIN_ORTHOGRAPHY_CACHE_SIZE + 1);
+  assert(stats.evictionCount != 0);
+
+  // Text that doesn't fit in an entry isn't cached.
+  char longWord[JAVELIN_ORTHOGRAPHY_CACHE_ENTRY_SIZE + 1];
+  memset(longWord, 'a', JAVELIN_ORTHOGRAPHY_CACHE_ENTRY_SIZE);
+  longWord[JAVELIN_ORTHOGRAPHY_CACHE_ENTRY_SIZE] = '\0';
+  free(orthography.AddSuffix(longWord, "s"));
+  free(orthography.AddSuffix(longWord, "s"));
+  assert(stats.uncachedCount == 2);
+}
+TEST_END
+#endif
 
 //---------------------------------------------------------------------------
@@ -1,6 +1,8 @@
 //---------------------------------------------------------------------------
 
 #pragma once
+#include JAVELIN_BOARD_CONFIG
+#include "engine_context.h"
 #include "malloc_allocate.h"
 #include "pattern.h"
 #include "sized_list.h"
@@ -11,6 +13,40 @@
 
 #define USE_ORTHOGRAPHY_CACHE 1
 
+// The cache holds JAVELIN_ORTHOGRAPHY_CACHE_SIZE entries in sets of
+// JAVELIN_ORTHOGRAPHY_CACHE_ASSOCIATIVITY, and is stored inline in each
+// StenoCompiledOrthography. Each entry is JAVELIN_ORTHOGRAPHY_CACHE_ENTRY_SIZE
+// bytes, with the word, suffix and result stored in the entry. Results that
+// don't fit are not cached.
+//
+// Each cache uses about CACHE_SIZE * ENTRY_SIZE bytes of RAM. StenoEngine
+// keeps its own copy of the compiled orthography, so an engine built from a
+// board level instance has two caches: 6.2kB in total with the device
+// defaults, and 24.7kB with the host defaults.
+#if !defined(JAVELIN_ORTHOGRAPHY_CACHE_SIZE)
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
+#define JAVELIN_ORTHOGRAPHY_CACHE_SIZE 64
+#else
+#define JAVELIN_ORTHOGRAPHY_CACHE_SIZE 256
+#endif
+#endif
+
+#if !defined(JAVELIN_ORTHOGRAPHY_CACHE_ASSOCIATIVITY)
+#define JAVELIN_ORTHOGRAPHY_CACHE_ASSOCIATIVITY 4
+#endif
+
+#if !defined(JAVELIN_ORTHOGRAPHY_CACHE_ENTRY_SIZE)
+#define JAVELIN_ORTHOGRAPHY_CACHE_ENTRY_SIZE 48
+#endif
+
+// Stats are always recorded on test builds, where they are used to check the
+// engine cost model.
+#if RUN_TESTS
+#define RECORD_ORTHOGRAPHY_STATS 1
+#else
+#define RECORD_ORTHOGRAPHY_STATS 0
+#endif
+
 //---------------------------------------------------------------------------
 
 struct StenoOrthographyRule {
@@ -51,65 +87,188 @@ struct StenoOrthography {
 
 //---------------------------------------------------------------------------
 
+// Rule and reverse auto suffix patterns for an orthography, compiled when the
+// dictionary image is built and stored alongside the orthography. Startup
+// matches the patterns in place instead of compiling each one.
+struct StenoOrthographySnapshot {
+  uint32_t magic;
+  uint32_t rulesCrc;
+  uint32_t ruleCount;
+  uint32_t reverseAutoSuffixCount;
+
+  // Offsets from the start of the snapshot for each rule, followed by each
+  // reverse auto suffix, or 0 for patterns that are compiled at startup.
+  uint32_t patternOffsets[];
+
+  // Snapshots only apply to the patterns they were created from.
+  bool IsValid(const StenoOrthography &orthography) const;
+
+  const PatternSnapshot *GetPattern(size_t index) const {
+    return GetPatternAt(index);
+  }
+  const PatternSnapshot *GetReverseAutoSuffixPattern(size_t index) const {
+    return GetPatternAt(ruleCount + index);
+  }
+
+#if JAVELIN_USE_PATTERN_SNAPSHOT_WRITER
+  static void Create(List<uint8_t> &buffer,
+                     const StenoOrthography &orthography);
+#endif
+
+private:
+  static const uint32_t MAGIC = 0x534f4a10 + PatternSnapshot::VERSION;
+
+  const PatternSnapshot *GetPatternAt(size_t index) const {
+    const uint32_t offset = patternOffsets[index];
+    return offset ? (const PatternSnapshot *)((const uint8_t *)this + offset)
+                  : nullptr;
+  }
+
+  static uint32_t GetRulesCrc(const StenoOrthography &orthography);
+};
+
+//---------------------------------------------------------------------------
+
 class StenoCompiledOrthography {
 public:
-  explicit StenoCompiledOrthography(const StenoOrthography &orthography);
+  explicit StenoCompiledOrthography(
+      const StenoOrthography &orthography,
+      const StenoEngineContext &context = StenoEngineContext::defaultContext)
+      : StenoCompiledOrthography(orthography, nullptr, context) {}
+
+  // Uses the rule patterns from snapshot if it was created from orthography,
+  // and compiles them otherwise.
+  StenoCompiledOrthography(
+      const StenoOrthography &orthography,
+      const StenoOrthographySnapshot *snapshot,
+      const StenoEngineContext &context = StenoEngineContext::defaultContext);
+
+  // Shares the compiled patterns of orthography, with an empty cache that
+  // belongs to context.
+  StenoCompiledOrthography(const StenoCompiledOrthography &orthography,
+                           const StenoEngineContext &context);
 
   char *AddSuffix(const char *word, const char *suffix) const;
   char *AddSuffixToPhrase(const char *phrase, const char *suffix) const;
 
+  // Returns the test pattern for data.reverseAutoSuffixes[index], from the
+  // snapshot if there is one.
+  Pattern CreateReverseAutoSuffixPattern(size_t index) const;
+
   void PrintInfo() const;
 
+#if USE_ORTHOGRAPHY_CACHE
+  // Counts for this instance's cache, shown by PrintInfo.
+  struct CacheStats {
+    size_t hitCount;
+    size_t missCount;
+    size_t evictionCount;
+    size_t uncachedCount;
+  };
+
+  const CacheStats &GetCacheStats() const { return cacheStats; }
+#endif
+
+#if RECORD_ORTHOGRAPHY_STATS
+  struct Stats {
+    size_t addSuffixCount;
+    size_t cacheHitCount;
+    size_t cacheMissCount;
+
+    void Reset() {
+      addSuffixCount = 0;
+      cacheHitCount = 0;
+      cacheMissCount = 0;
+    }
+  };
+
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
+  static Stats stats;
+#else
+  static thread_local Stats stats;
+#endif
+
+  static void ResetStats() { stats.Reset(); }
+  static size_t GetAddSuffixCount() { return stats.addSuffixCount; }
+  static size_t GetCacheMissCount() { return stats.cacheMissCount; }
+#endif
+
   const StenoOrthography &data;
 
 private:
+  class RuleDispatch;
+
+  const StenoOrthographySnapshot *snapshot;
   const Pattern *patterns;
+  const RuleDispatch *ruleDispatch;
+  const StenoEngineContext &context;
 
 #if USE_ORTHOGRAPHY_CACHE
-  struct CacheEntry : public JavelinMallocAllocate {
-    void Set(const char *word, const char *suffix, const char *result);
-
-    bool IsEqual(const char *word, const char *suffix) const;
+  static const size_t CACHE_SIZE = JAVELIN_ORTHOGRAPHY_CACHE_SIZE;
+  static const size_t CACHE_ASSOCIATIVITY =
+      JAVELIN_ORTHOGRAPHY_CACHE_ASSOCIATIVITY;
+  static const size_t CACHE_BLOCK_COUNT = CACHE_SIZE / CACHE_ASSOCIATIVITY;
 
-    const char *GetWord() const { return base; }
-    const char *GetSuffix() const { return base + suffixOffset; }
-    const char *GetResult() const { return base + resultOffset; }
+  static_assert((CACHE_BLOCK_COUNT & (CACHE_BLOCK_COUNT - 1)) == 0,
+                "Cache block count must be a power of 2");
+  static_assert(CACHE_ASSOCIATIVITY != 0 && CACHE_ASSOCIATIVITY <= 255 &&
+                    CACHE_BLOCK_COUNT * CACHE_ASSOCIATIVITY == CACHE_SIZE,
+                "Cache size must be a multiple of associativity");
+
+  struct CacheEntry {
+    static const size_t TEXT_SIZE = JAVELIN_ORTHOGRAPHY_CACHE_ENTRY_SIZE - 5;
+    static_assert(JAVELIN_ORTHOGRAPHY_CACHE_ENTRY_SIZE > 8 &&
+                      JAVELIN_ORTHOGRAPHY_CACHE_ENTRY_SIZE <= 260,
+                  "Cache entry offsets are stored in bytes");
+
+    static bool CanStore(size_t wordLength, size_t suffixLength,
+                         size_t resultLength) {
+      return wordLength + suffixLength + resultLength + 3 <= TEXT_SIZE;
+    }
+
+    bool IsEmpty() const { return suffixOffset == 0; }
+    bool IsEqual(uint8_t tag, const char *word, size_t wordLength,
+                 const char *suffix) const;
+    void Set(uint8_t tag, const char *word, size_t wordLength,
+             const char *suffix, size_t suffixLength, const char *result,
+             size_t resultLength);
+
+    const char *GetSuffix() const { return text + suffixOffset; }
+    const char *GetResult() const { return text + resultOffset; }
     char *DupResult() const;
 
-  private:
-    char *base;
+    // Upper bits of the hash, to avoid most string compares.
+    uint8_t tag;
+
+    // Set on lookup, and cleared as the replacement hand passes.
+    bool isReferenced;
+
+    // Text layout is: word \0 suffix \0 result \0
+    // suffixOffset is 0 for empty entries.
     uint8_t suffixOffset;
     uint8_t resultOffset;
     uint8_t resultLength;
-
-  public:
-    // The index of the currently used CacheEntry for a block.
-    //
-    // This should be stored in CacheBlock, but put here for better data
-    // packing.
-    //
-    // Only the first entry in each cache block is used.
-    uint8_t blockIndex;
+    char text[TEXT_SIZE];
   };
 
   static void LockCache();
   static void UnlockCache();
 
-  static const size_t CACHE_SIZE = 256;
-  static const size_t CACHE_ASSOCIATIVITY = 4;
-  static const size_t CACHE_BLOCK_COUNT = CACHE_SIZE / CACHE_ASSOCIATIVITY;
-
+  // Sets use CLOCK replacement: the hand skips entries referenced since it
+  // last passed them.
   struct CacheBlock {
-    // Stored separately for better data packing.
-    // uint8_t index;
-
+    uint8_t hand;
     CacheEntry entries[CACHE_ASSOCIATIVITY];
 
-    char *Lookup(const char *word, const char *suffix) const;
-    void AddEntry(const char *word, const char *suffix, const char *result);
+    char *Lookup(uint8_t tag, const char *word, size_t wordLength,
+                 const char *suffix);
+    bool AddEntry(uint8_t tag, const char *word, size_t wordLength,
+                  const char *suffix, size_t suffixLength, const char *result,
+                  size_t resultLength);
   };
 
   mutable CacheBlock cache[CACHE_BLOCK_COUNT];
+  mutable CacheStats cacheStats;
 
 #endif
 
@@ -118,8 +277,16 @@ private:
   class BestCandidate;
   void AddCandidates(BestCandidate &bestCandidate, const char *word,
                      const char *suffix, int defaultScore) const;
+  void AddCandidate(BestCandidate &bestCandidate, size_t ruleIndex,
+                    const char *word, size_t offset, const char *text,
+                    PatternQuickReject inputQuickReject,
+                    int defaultScore) const;
+
+  static const Pattern *
+  CreatePatterns(const StenoOrthography &orthography,
+                 const StenoOrthographySnapshot *snapshot);
 
-  static const Pattern *CreatePatterns(const StenoOrthography &orthography);
+  friend class StenoEngineContext;
 };
 
 //---------------------------------------------------------------------------
@@ -20,11 +20,101 @@ struct Pattern::BuildResult {
 
   PatternComponent *head;
   PatternComponent *tail;
+
+  // Where a match of this element can start, used to build the search
+  // filter. A match starts at the start of the text if anchored, or at a
+  // first byte, or can be empty.
+  bool isAnchored = false;
+  bool matchesEmpty = false;
+  uint8_t firstBytes[32] = {};
+
+  void AddFirstByte(uint8_t c) { firstBytes[c / 8] |= 1 << (c & 7); }
+  void AddAnyFirstByte() {
+    firstBytes[0] |= 0xfe;
+    memset(firstBytes + 1, 0xff, sizeof(firstBytes) - 1);
+  }
+  void AddFirstBytes(const BuildResult &other) {
+    for (size_t i = 0; i < sizeof(firstBytes); ++i) {
+      firstBytes[i] |= other.firstBytes[i];
+    }
+  }
+  void SetStart(const BuildResult &other) {
+    isAnchored = other.isAnchored;
+    matchesEmpty = other.matchesEmpty;
+    memcpy(firstBytes, other.firstBytes, sizeof(firstBytes));
+  }
+};
+
+struct Pattern::SearchFilter {
+  bool isAnchored;
+  size_t firstByteCount;
+  uint8_t singleFirstByte;
+  uint8_t firstBytes[32];
+
+  bool IsFirstByte(uint8_t c) const {
+    return (firstBytes[c / 8] & (1 << (c & 7))) != 0;
+  }
+
+  // Returns the first position at or after p that starts with a first byte,
+  // or nullptr if there are none.
+  const char *FindCandidate(const char *p) const;
+
+  static const SearchFilter *Create(const BuildResult &result);
+
+  static const SearchFilter ANCHORED;
+};
+
+const Pattern::SearchFilter Pattern::SearchFilter::ANCHORED = {
+    .isAnchored = true,
+    .firstByteCount = 0,
 };
 
+const Pattern::SearchFilter *
+Pattern::SearchFilter::Create(const BuildResult &result) {
+  size_t firstByteCount = 0;
+  for (uint8_t bits : result.firstBytes) {
+    firstByteCount += __builtin_popcount(bits);
+  }
+  if (firstByteCount == 0) {
+    return &ANCHORED;
+  }
+
+  SearchFilter *filter = (SearchFilter *)malloc(sizeof(SearchFilter));
+  filter->isAnchored = result.isAnchored;
+  filter->firstByteCount = firstByteCount;
+  filter->singleFirstByte = 0;
+  memcpy(filter->firstBytes, result.firstBytes, sizeof(firstBytes));
+  for (size_t c = 0; c < 256; ++c) {
+    if (filter->IsFirstByte(c)) {
+      filter->singleFirstByte = c;
+      break;
+    }
+  }
+  return filter;
+}
+
+const char *Pattern::SearchFilter::FindCandidate(const char *p) const {
+  switch (firstByteCount) {
+  case 0:
+    return nullptr;
+  case 1:
+    return strchr(p, singleFirstByte);
+  default:
+    for (;; ++p) {
+      if (IsFirstByte(*p)) {
+        return p;
+      }
+      if (*p == '\0') {
+        return nullptr;
+      }
+    }
+  }
+}
+
 //---------------------------------------------------------------------------
 
-Pattern Pattern::Compile(const char *p) {
+// Returns the pattern wrapped in capture 0, with epsilons removed.
+Pattern::BuildResult Pattern::ParsePattern(const char *p) {
   BuildContext context;
   context.p = p;
   context.captureIndex = 2;
@@ -32,24 +122,112 @@ Pattern Pattern::Compile(const char *p) {
   PatternComponent *captureStart = new CapturePatternComponent(0);
   const BuildResult result = ParseAlternate(context);
   captureStart->next = result.head;
-  result.tail->next = new CapturePatternComponent(1);
+  PatternComponent *captureEnd = new CapturePatternComponent(1);
+  result.tail->next = captureEnd;
 
   // If this assert is hit, then the entire pattern hasn't been processed.
   assert(*context.p == '\0');
   captureStart->RemoveEpsilon();
 
+  BuildResult patternResult(captureStart, captureEnd);
+  patternResult.SetStart(result);
+  return patternResult;
+}
+
+Pattern Pattern::Compile(const char *p) {
+  const BuildResult result = ParsePattern(p);
+  PatternComponent *captureStart = result.head;
+
   PatternQuickReject quickReject;
   captureStart->UpdateQuickReject(quickReject);
 
+  // Patterns that can match empty text can start anywhere, as can patterns
+  // starting with '.'.
+  const SearchFilter *searchFilter = nullptr;
+  if (!result.matchesEmpty) {
+    searchFilter = SearchFilter::Create(result);
+    if (!searchFilter->isAnchored && searchFilter->firstByteCount == 255 &&
+        !searchFilter->IsFirstByte('\0')) {
+      free((void *)searchFilter);
+      searchFilter = nullptr;
+    }
+  }
+
 #if JAVELIN_USE_PATTERN_JIT
   PatternJitContext jitContext;
   captureStart->Compile(jitContext);
   bool (*matchMethod)(const char *, const char **, const char *) =
       jitContext.Build();
+  Pattern pattern(matchMethod, quickReject);
+#else
+  Pattern pattern(captureStart, quickReject);
+#endif
+
+  pattern.searchFilter = searchFilter;
+
+#if JAVELIN_USE_PATTERN_DFA
+  pattern.dfa = PatternDfa::Build(captureStart);
+#endif
+
+#if JAVELIN_USE_PATTERN_JIT
+  PatternComponent::ResetPoolAllocator();
+#endif
+  return pattern;
+}
+
+Pattern Pattern::FromSnapshot(const PatternSnapshot *snapshot) {
+  Pattern pattern(nullptr, snapshot->quickReject);
+  pattern.snapshot = snapshot;
+
+#if JAVELIN_USE_PATTERN_DFA
+  if (snapshot->dfaOffset != 0) {
+    pattern.dfa = (const PatternDfa *)((const uint8_t *)snapshot +
+                                       snapshot->dfaOffset);
+  }
+#endif
+  return pattern;
+}
+
+#if JAVELIN_USE_PATTERN_SNAPSHOT_WRITER
+
+bool Pattern::CreateSnapshot(List<uint8_t> &buffer, const char *p) {
+  // As with Compile, components are not freed.
+  const BuildResult result = ParsePattern(p);
+
+  PatternQuickReject quickReject;
+  result.head->UpdateQuickReject(quickReject);
+
+#if JAVELIN_USE_PATTERN_DFA
+  const PatternDfa *dfa = PatternDfa::Build(result.head);
+  const bool success = PatternSnapshotWriter::Write(
+      buffer, result.head, quickReject, dfa, dfa ? dfa->GetMemoryUsage() : 0);
+  free((void *)dfa);
+#else
+  const bool success =
+      PatternSnapshotWriter::Write(buffer, result.head, quickReject, nullptr, 0);
+#endif
+
+#if JAVELIN_USE_PATTERN_JIT
   PatternComponent::ResetPoolAllocator();
-  return Pattern(matchMethod, quickReject);
+#endif
+  return success;
+}
+
+#endif
+
+size_t Pattern::GetDfaStateCount() const {
+#if JAVELIN_USE_PATTERN_DFA
+  return dfa ? dfa->GetStateCount() : 0;
 #else
-  return Pattern(captureStart, quickReject);
+  return 0;
+#endif
+}
+
+size_t Pattern::GetDfaMemoryUsage() const {
+#if JAVELIN_USE_PATTERN_DFA
+  return dfa ? dfa->GetMemoryUsage() : 0;
+#else
+  return 0;
 #endif
 }
 
@@ -69,6 +247,9 @@ Pattern::BuildResult Pattern::ParseAlternate(BuildContext &c) {
 
   result.tail->next = epsilon;
 
+  BuildResult alternateResult(alternate, epsilon);
+  alternateResult.SetStart(result);
+
   while (*c.p == '|') {
     c.p++;
     const BuildResult result = ParseSequence(c);
@@ -76,16 +257,24 @@ Pattern::BuildResult Pattern::ParseAlternate(BuildContext &c) {
     assert(result.tail != nullptr);
     alternate->Add(result.head);
     result.tail->next = epsilon;
+
+    alternateResult.isAnchored |= result.isAnchored;
+    alternateResult.matchesEmpty |= result.matchesEmpty;
+    alternateResult.AddFirstBytes(result);
   }
   alternate->next = epsilon;
 
-  return BuildResult(alternate, epsilon);
+  return alternateResult;
 }
 
 Pattern::BuildResult Pattern::ParseSequence(BuildContext &c) {
   BuildResult result = ParseQuantifiedAtom(c);
   if (result.head == nullptr) {
-    return BuildResult(&SuccessPatternComponent::instance);
+    // Callers link the tail to what follows, so this can't be the shared
+    // success component.
+    BuildResult emptyResult(new EpsilonPatternComponent);
+    emptyResult.matchesEmpty = true;
+    return emptyResult;
   }
 
   for (;;) {
@@ -96,6 +285,14 @@ Pattern::BuildResult Pattern::ParseSequence(BuildContext &c) {
 
     result.tail->next = nextElement.head;
     result.tail = nextElement.tail;
+
+    // Later elements can only start a match if everything before them can
+    // be empty.
+    if (result.matchesEmpty) {
+      result.isAnchored |= nextElement.isAnchored;
+      result.matchesEmpty = nextElement.matchesEmpty;
+      result.AddFirstBytes(nextElement);
+    }
   }
 
   return result;
@@ -105,13 +302,18 @@ Pattern::BuildResult Pattern::ParseQuantifiedAtom(BuildContext &c) {
   if (c.p[0] == '.') {
     if (c.p[1] == '*') {
       c.p += 2;
-      return BuildResult(new AnyStarPatternComponent);
+      BuildResult result(new AnyStarPatternComponent);
+      result.matchesEmpty = true;
+      result.AddAnyFirstByte();
+      return result;
     } else if (c.p[1] == '+') {
       c.p += 2;
       PatternComponent *any = new AnyPatternComponent;
       PatternComponent *anyStar = new AnyStarPatternComponent;
       any->next = anyStar;
-      return BuildResult(any, anyStar);
+      BuildResult result(any, anyStar);
+      result.AddAnyFirstByte();
+      return result;
     }
   }
 
@@ -129,13 +331,19 @@ Pattern::BuildResult Pattern::ParseAtom(BuildContext &c) {
   case ')':
   case '|':
     return BuildResult(nullptr);
-  case '^':
+  case '^': {
     c.p++;
-    return BuildResult(new StartOfLinePatternComponent);
+    BuildResult result(new StartOfLinePatternComponent);
+    result.isAnchored = true;
+    return result;
+  }
 
-  case '$':
+  case '$': {
     c.p++;
-    return BuildResult(new EndOfLinePatternComponent);
+    BuildResult result(new EndOfLinePatternComponent);
+    result.AddFirstByte('\0');
+    return result;
+  }
 
   case '(': {
     c.p++;
@@ -160,19 +368,29 @@ Pattern::BuildResult Pattern::ParseAtom(BuildContext &c) {
     PatternComponent *captureEnd =
         new CapturePatternComponent(captureIndex + 1);
     component.tail->next = captureEnd;
-    return BuildResult(captureStart, captureEnd);
+    BuildResult result(captureStart, captureEnd);
+    result.SetStart(component);
+    return result;
   }
   case '\\': {
     c.p++;
     switch (*c.p) {
     case '^':
-    case '\\':
-      return BuildResult(new BytePatternComponent(*c.p++));
+    case '\\': {
+      BuildResult result(new BytePatternComponent(*c.p));
+      result.AddFirstByte(*c.p++);
+      return result;
+    }
 
     case '1':
     case '2':
-    case '3':
-      return BuildResult(new BackReferencePatternComponent(*c.p++ - '0'));
+    case '3': {
+      // The referenced capture can be empty.
+      BuildResult result(new BackReferencePatternComponent(*c.p++ - '0'));
+      result.matchesEmpty = true;
+      result.AddAnyFirstByte();
+      return result;
+    }
 
     default:
       assert(!"Unhandled symbol");
@@ -199,11 +417,16 @@ Pattern::BuildResult Pattern::ParseAtom(BuildContext &c) {
     }
     c.p = p + 1;
 
-    return BuildResult(component);
+    BuildResult result(component);
+    memcpy(result.firstBytes, component->mask, sizeof(component->mask));
+    return result;
   }
-  case '.':
+  case '.': {
     c.p++;
-    return BuildResult(new AnyPatternComponent);
+    BuildResult result(new AnyPatternComponent);
+    result.AddAnyFirstByte();
+    return result;
+  }
 
   default:
     const char *pStart = c.p;
@@ -215,7 +438,9 @@ Pattern::BuildResult Pattern::ParseAtom(BuildContext &c) {
     } else {
       component = new (length) LiteralPatternComponent(pStart, length);
     }
-    return BuildResult(component);
+    BuildResult result(component);
+    result.AddFirstByte(*pStart);
+    return result;
   }
 }
 
@@ -255,14 +480,19 @@ Pattern::BuildResult Pattern::ParseQuantifier(BuildContext &c,
     BranchPatternComponent *star = new BranchPatternComponent(atom.head);
     atom.tail->next = star;
 
-    return BuildResult(star);
+    BuildResult result(star);
+    result.SetStart(atom);
+    result.matchesEmpty = true;
+    return result;
   }
   case '+': {
     c.p++;
     BranchPatternComponent *plus = new BranchPatternComponent(atom.head);
     atom.tail->next = plus;
 
-    return BuildResult(atom.head, plus);
+    BuildResult result(atom.head, plus);
+    result.SetStart(atom);
+    return result;
   }
 
   case '?': {
@@ -271,7 +501,11 @@ Pattern::BuildResult Pattern::ParseQuantifier(BuildContext &c,
     BranchPatternComponent *alternate = new BranchPatternComponent(atom.head);
     alternate->next = epsilon;
     atom.tail->next = epsilon;
-    return BuildResult(alternate, epsilon);
+
+    BuildResult result(alternate, epsilon);
+    result.SetStart(atom);
+    result.matchesEmpty = true;
+    return result;
   }
   default:
     return atom;
@@ -294,6 +528,15 @@ PatternMatch Pattern::Match(const char *text) const {
 PatternMatch Pattern::MatchBypassingQuickReject(const char *text) const {
   PatternMatch result;
 
+#if JAVELIN_USE_PATTERN_DFA
+  // The DFA only decides whether there is a match. Captures still need the
+  // backtracking matcher.
+  if (dfa && !dfa->IsPossibleMatch(text)) {
+    result.match = false;
+    return result;
+  }
+#endif
+
   // This code is in the hot path.
   // Expand this to avoid calls to __wrap_memset on rp2040.
   result.captures[0] = nullptr;
@@ -309,6 +552,10 @@ PatternMatch Pattern::MatchBypassingQuickReject(const char *text) const {
       .start = text,
       .captures = result.captures,
   };
+  if (snapshot) {
+    result.match = snapshot->Match(text, context);
+    return result;
+  }
 #if JAVELIN_USE_PATTERN_JIT
   result.match = matchMethod(text, result.captures, text);
 #else
@@ -317,22 +564,49 @@ PatternMatch Pattern::MatchBypassingQuickReject(const char *text) const {
   return result;
 }
 
-PatternMatch Pattern::Search(const char *text) const {
-  PatternMatch result;
-#if JAVELIN_USE_PATTERN_JIT
-  const char *start = text;
-  do {
-    result.match = matchMethod(start, result.captures, text);
-  } while (!result.match && *text++ != '\0');
-#else
+bool Pattern::MatchAt(const char **captures, const char *start,
+                      const char *p) const {
   PatternContext context = {
-      .start = text,
-      .captures = result.captures,
+      .start = start,
+      .captures = captures,
   };
-  do {
-    result.match = root->Match(text, context);
-  } while (!result.match && *text++ != '\0');
+  if (snapshot) {
+    return snapshot->Match(p, context);
+  }
+#if JAVELIN_USE_PATTERN_JIT
+  return matchMethod(start, captures, p);
+#else
+  return root->Match(p, context);
 #endif
+}
+
+PatternMatch Pattern::Search(const char *text) const {
+  PatternMatch result;
+  if (searchFilter == nullptr) {
+    const char *p = text;
+    do {
+      result.match = MatchAt(result.captures, text, p);
+    } while (!result.match && *p++ != '\0');
+    return result;
+  }
+
+  // Only positions where a match can start are tried.
+  if (searchFilter->isAnchored && !searchFilter->IsFirstByte(*text)) {
+    result.match = MatchAt(result.captures, text, text);
+    if (result.match) {
+      return result;
+    }
+  }
+
+  result.match = false;
+  const char *p = text;
+  while ((p = searchFilter->FindCandidate(p)) != nullptr) {
+    result.match = MatchAt(result.captures, text, p);
+    if (result.match || *p == '\0') {
+      break;
+    }
+    ++p;
+  }
   return result;
 }
 
@@ -446,6 +720,15 @@ TEST_BEGIN("Pattern: Empty alternate test") {
 }
 TEST_END
 
+TEST_BEGIN("Pattern: Empty alternate in sequence test") {
+  const Pattern pattern = Pattern::Compile("(x|)y");
+  assert(pattern.Match("y").match);
+  assert(pattern.Match("xy").match);
+  assert(!pattern.Match("").match);
+  assert(!pattern.Match("x").match);
+}
+TEST_END
+
 TEST_BEGIN("Pattern: Orthography example test") {
   const Pattern pattern = Pattern::Compile(
       R"(^(.*(?:[bcdfghjklmnprstvwxyz]|qu)[aeiou])([bcdfgklmnprtvz]) \^ ([aeiouy].*)$)");
@@ -455,6 +738,42 @@ TEST_BEGIN("Pattern: Orthography example test") {
   free(t1);
 }
 TEST_END
+TEST_BEGIN("Pattern: Search test") {
+  struct TestCase {
+    const char *pattern;
+    const char *text;
+    int start;
+    int end;
+  };
+  static const TestCase TEST_CASES[] = {
+      {"b+c", "abbbc", 1, 5},    // Single first byte.
+      {"[xy]z", "axxyzz", 3, 5}, // First byte set.
+      {"(q|r)s", "qrrs", 2, 4},
+      {"^ab", "abab", 0, 2}, // Anchored.
+      {"^ab", "bab", -1, -1},
+      {"c?d", "abcd", 2, 4}, // Optional first element.
+      {"c?d", "abd", 2, 3},
+      {"e$", "eee", 2, 3},
+      {"$", "ab", 2, 2}, // End of text.
+      {"x*", "ab", 0, 0}, // Empty match.
+      {"q", "ab", -1, -1},
+      {".*[ab]c", "ebcy", 0, 3}, // Leading .* starts at any byte.
+  };
+
+  for (const TestCase &testCase : TEST_CASES) {
+    const Pattern pattern = Pattern::Compile(testCase.pattern);
+    const PatternMatch match = pattern.Search(testCase.text);
+    if (testCase.start < 0) {
+      assert(!match.match);
+    } else {
+      assert(match.match);
+      assert(match.captures[0] == testCase.text + testCase.start);
+      assert(match.captures[1] == testCase.text + testCase.end);
+    }
+  }
+}
+TEST_END
+
 // spellchecker: enable
 
 //---------------------------------------------------------------------------
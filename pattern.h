@@ -1,7 +1,9 @@
 //---------------------------------------------------------------------------
 
 #pragma once
+#include "pattern_dfa.h"
 #include "pattern_quick_reject.h"
+#include "pattern_snapshot.h"
 #include <stddef.h>
 #include <string.h>
 
@@ -45,6 +47,16 @@ class Pattern {
 public:
   static Pattern Compile(const char *pattern);
 
+  // Uses the snapshot in place, without compiling. Snapshot patterns have no
+  // search filter, so Search tries every position.
+  static Pattern FromSnapshot(const PatternSnapshot *snapshot);
+
+#if JAVELIN_USE_PATTERN_SNAPSHOT_WRITER
+  // Appends a snapshot of the compiled pattern to buffer. Returns false if
+  // the pattern is too large for a snapshot.
+  static bool CreateSnapshot(List<uint8_t> &buffer, const char *pattern);
+#endif
+
   PatternMatch Match(const char *text) const;
   PatternMatch MatchBypassingQuickReject(const char *text) const;
   PatternMatch Search(const char *text) const;
@@ -58,6 +70,10 @@ public:
 
   const PatternQuickReject &GetQuickReject() const { return quickReject; }
 
+  // Returns 0 for patterns without a DFA prefilter.
+  size_t GetDfaStateCount() const;
+  size_t GetDfaMemoryUsage() const;
+
 private:
 #if JAVELIN_USE_PATTERN_JIT
   Pattern(bool (*matchMethod)(const char *start, const char **captures,
@@ -77,9 +93,23 @@ private:
 
   PatternQuickReject quickReject;
 
+  // Set for patterns loaded from a snapshot, which are matched by the
+  // snapshot program instead.
+  const PatternSnapshot *snapshot = nullptr;
+
+  struct SearchFilter;
+  const SearchFilter *searchFilter = nullptr;
+
+#if JAVELIN_USE_PATTERN_DFA
+  const PatternDfa *dfa = nullptr;
+#endif
+
   struct BuildContext;
   struct BuildResult;
 
+  bool MatchAt(const char **captures, const char *start, const char *p) const;
+
+  static BuildResult ParsePattern(const char *p);
   static BuildResult ParseAlternate(BuildContext &c);
   static BuildResult ParseSequence(BuildContext &c);
   static BuildResult ParseQuantifiedAtom(BuildContext &c);
@@ -1,6 +1,8 @@
 //---------------------------------------------------------------------------
 
 #pragma once
+#include "pattern_dfa.h"
+#include "pattern_snapshot.h"
 #include "pool_allocate.h"
 #include <assert.h>
 #include <string.h>
@@ -32,7 +34,13 @@ public:
   bool StartComponent(const PatternComponent *component);
   void AddCode(const void *data, size_t length);
   void PatchBranch(size_t offset);
+#if defined(__x86_64__)
+  void Call(const PatternComponent *component);
+  void BeqFail();
+  void BhsFail();
+#else
   void PatchImm16(size_t offset, uint32_t value);
+#endif
   void Branch(size_t target);
   void BneFail();
 
@@ -43,6 +51,19 @@ private:
   uint8_t *buffer;
   size_t count;
   size_t capacity;
+
+#if defined(__x86_64__)
+  struct CallSite {
+    size_t offset;
+    const PatternComponent *component;
+  };
+
+  CallSite *callSites;
+  size_t callSiteCount;
+  size_t callSiteCapacity;
+
+  void BranchFail(uint8_t condition);
+#endif
 };
 
 #define JIT_COMPONENT_METHOD                                                   \
@@ -51,6 +72,27 @@ private:
 #define JIT_COMPONENT_METHOD
 #endif
 
+#if JAVELIN_USE_PATTERN_DFA
+#define DFA_CLOSURE_METHOD                                                     \
+  void AddDfaClosure(PatternDfaBuilder &builder) const final;
+#define DFA_BYTE_MATCH_METHOD                                                  \
+  bool IsDfaByteMatch(size_t offset, uint8_t c) const final;
+#define DFA_NEXT_CLOSURE_METHOD                                                \
+  void AddDfaNextClosure(PatternDfaBuilder &builder, size_t offset)           \
+      const final;
+#else
+#define DFA_CLOSURE_METHOD
+#define DFA_BYTE_MATCH_METHOD
+#define DFA_NEXT_CLOSURE_METHOD
+#endif
+
+#if JAVELIN_USE_PATTERN_SNAPSHOT_WRITER
+#define SNAPSHOT_COMPONENT_METHOD                                              \
+  void WriteSnapshot(PatternSnapshotWriter &writer) const final;
+#else
+#define SNAPSHOT_COMPONENT_METHOD
+#endif
+
 //---------------------------------------------------------------------------
 
 class PatternComponent
@@ -73,6 +115,26 @@ public:
   virtual void Compile(PatternJitContext &context) const = 0;
 #endif
 
+#if JAVELIN_USE_PATTERN_DFA
+  // Adds the DFA positions reachable without consuming input. By default,
+  // the component itself consumes a byte.
+  virtual void AddDfaClosure(PatternDfaBuilder &builder) const;
+
+  // Whether the position at |offset| consumes |c|. A null byte is only
+  // consumed by end of line.
+  virtual bool IsDfaByteMatch(size_t offset, uint8_t c) const {
+    return false;
+  }
+
+  // Adds the closure after consuming a byte at |offset|.
+  virtual void AddDfaNextClosure(PatternDfaBuilder &builder,
+                                 size_t offset) const;
+#endif
+
+#if JAVELIN_USE_PATTERN_SNAPSHOT_WRITER
+  virtual void WriteSnapshot(PatternSnapshotWriter &writer) const = 0;
+#endif
+
   static void *operator new(size_t size);
   static void operator delete(void *p) {}
 
@@ -97,7 +159,9 @@ public:
   virtual void RemoveEpsilon() {}
   virtual void UpdateQuickReject(PatternQuickReject &quickReject) const {}
 
+  DFA_CLOSURE_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 
   static SuccessPatternComponent instance;
 };
@@ -110,21 +174,29 @@ public:
   virtual bool Match(const char *p, PatternContext &context) const;
   virtual bool IsEpsilon() const { return true; }
 
+  DFA_CLOSURE_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 };
 
 class AnyPatternComponent : public PatternComponent {
 public:
   virtual bool Match(const char *p, PatternContext &context) const;
 
+  DFA_BYTE_MATCH_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 };
 
 class AnyStarPatternComponent : public PatternComponent {
 public:
   virtual bool Match(const char *p, PatternContext &context) const;
 
+  DFA_CLOSURE_METHOD
+  DFA_BYTE_MATCH_METHOD
+  DFA_NEXT_CLOSURE_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 };
 
 class BackReferencePatternComponent : public PatternComponent {
@@ -133,7 +205,9 @@ public:
 
   virtual bool Match(const char *p, PatternContext &context) const;
 
+  DFA_CLOSURE_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 
 private:
   int index;
@@ -143,7 +217,9 @@ class CharacterSetPatternComponent : public PatternComponent {
 public:
   virtual bool Match(const char *p, PatternContext &context) const;
 
+  DFA_BYTE_MATCH_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 
 private:
   uint8_t mask[16] = {};
@@ -191,7 +267,9 @@ public:
   virtual bool Match(const char *p, PatternContext &context) const;
   virtual void RemoveEpsilon() final;
 
+  DFA_CLOSURE_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 
 private:
   PatternComponent *branch;
@@ -202,14 +280,19 @@ class StartOfLinePatternComponent : public PatternComponent {
 public:
   virtual bool Match(const char *p, PatternContext &context) const;
 
+  DFA_CLOSURE_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 };
 
 class EndOfLinePatternComponent : public PatternComponent {
 public:
   virtual bool Match(const char *p, PatternContext &context) const;
 
+  DFA_CLOSURE_METHOD
+  DFA_BYTE_MATCH_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 };
 
 class CapturePatternComponent : public PatternComponent {
@@ -218,7 +301,9 @@ public:
 
   virtual bool Match(const char *p, PatternContext &context) const final;
 
+  DFA_CLOSURE_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 
 private:
   size_t index;
@@ -232,7 +317,9 @@ public:
 
   virtual bool Match(const char *p, PatternContext &context) const final;
 
+  DFA_BYTE_MATCH_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 
 #if JAVELIN_USE_PATTERN_JIT
   static void CompileByteCheck(PatternJitContext &context, uint8_t byte);
@@ -254,7 +341,10 @@ public:
 
   virtual bool Match(const char *p, PatternContext &context) const final;
 
+  DFA_BYTE_MATCH_METHOD
+  DFA_NEXT_CLOSURE_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 
   static void *operator new(size_t size, size_t textLength) {
     return PatternComponent::operator new((size + textLength + sizeof(size_t)) &
@@ -285,7 +375,9 @@ public:
 
   virtual bool Match(const char *p, PatternContext &context) const final;
 
+  DFA_CLOSURE_METHOD
   JIT_COMPONENT_METHOD
+  SNAPSHOT_COMPONENT_METHOD
 };
 
 //---------------------------------------------------------------------------
@@ -0,0 +1,331 @@
+//---------------------------------------------------------------------------
+
+#include "pattern_dfa.h"
+
+#if JAVELIN_USE_PATTERN_DFA
+
+#include "pattern_component.h"
+#include <assert.h>
+#include <stdlib.h>
+
+//---------------------------------------------------------------------------
+
+void PatternDfaBuilder::BeginClosure(bool start, bool end) {
+  atStart = start;
+  atEnd = end;
+  closureMatch = false;
+  closure = 0;
+  visitedCount = 0;
+}
+
+void PatternDfaBuilder::AddPosition(const PatternComponent *component,
+                                    size_t offset) {
+  for (size_t i = 0; i < positionCount; ++i) {
+    if (positions[i].component == component &&
+        positions[i].offset == offset) {
+      closure |= uint64_t(1) << i;
+      return;
+    }
+  }
+  if (positionCount == MAX_POSITIONS) {
+    isSupported = false;
+    return;
+  }
+  positions[positionCount] = {
+      .component = component,
+      .offset = offset,
+  };
+  closure |= uint64_t(1) << positionCount++;
+}
+
+bool PatternDfaBuilder::Visit(const PatternComponent *component) {
+  for (size_t i = 0; i < visitedCount; ++i) {
+    if (visited[i] == component) {
+      return false;
+    }
+  }
+  if (visitedCount == MAX_VISITED) {
+    isSupported = false;
+    return false;
+  }
+  visited[visitedCount++] = component;
+  return true;
+}
+
+//---------------------------------------------------------------------------
+
+const PatternDfa *PatternDfa::Build(const PatternComponent *root) {
+  PatternDfaBuilder *builder = new PatternDfaBuilder;
+
+  builder->BeginClosure(true, false);
+  root->AddDfaClosure(*builder);
+  const uint64_t startClosure = builder->closure;
+  if (builder->closureMatch) {
+    delete builder;
+    return nullptr;
+  }
+
+  // Positions are found while computing closures, so this loop also covers
+  // positions added during the loop. Only end of line positions consume the
+  // terminating null.
+  for (size_t i = 0; i < builder->positionCount; ++i) {
+    PatternDfaBuilder::Position &position = builder->positions[i];
+    builder->BeginClosure(
+        false, position.component->IsDfaByteMatch(position.offset, 0));
+    position.component->AddDfaNextClosure(*builder, position.offset);
+    position.nextClosure = builder->closure;
+    position.nextMatch = builder->closureMatch;
+  }
+  if (!builder->isSupported) {
+    delete builder;
+    return nullptr;
+  }
+
+  // Bytes accepted by the same positions always have the same transitions.
+  uint64_t acceptMasks[256] = {};
+  for (size_t i = 0; i < builder->positionCount; ++i) {
+    const PatternDfaBuilder::Position &position = builder->positions[i];
+    for (size_t c = 0; c < 256; ++c) {
+      if (position.component->IsDfaByteMatch(position.offset, c)) {
+        acceptMasks[c] |= uint64_t(1) << i;
+      }
+    }
+  }
+
+  uint8_t byteClasses[256];
+  uint64_t classMasks[256];
+  size_t classCount = 0;
+  for (size_t c = 0; c < 256; ++c) {
+    size_t classIndex = 0;
+    while (classIndex < classCount && classMasks[classIndex] != acceptMasks[c]) {
+      ++classIndex;
+    }
+    if (classIndex == classCount) {
+      classMasks[classCount++] = acceptMasks[c];
+    }
+    byteClasses[c] = classIndex;
+  }
+  const size_t endClass = byteClasses[0];
+
+  uint64_t states[JAVELIN_PATTERN_DFA_STATE_LIMIT];
+  uint8_t transitions[JAVELIN_PATTERN_DFA_STATE_LIMIT][256];
+  size_t stateCount = 1;
+  states[0] = startClosure;
+
+  for (size_t stateIndex = 0; stateIndex < stateCount; ++stateIndex) {
+    for (size_t classIndex = 0; classIndex < classCount; ++classIndex) {
+      uint64_t positions = states[stateIndex] & classMasks[classIndex];
+      uint64_t next = 0;
+      bool match = false;
+      while (positions) {
+        const PatternDfaBuilder::Position &position =
+            builder->positions[__builtin_ctzll(positions)];
+        positions &= positions - 1;
+        next |= position.nextClosure;
+        match |= position.nextMatch;
+      }
+
+      uint8_t transition;
+      if (match) {
+        transition = ACCEPT_STATE;
+      } else if (next == 0 || classIndex == endClass) {
+        transition = REJECT_STATE;
+      } else {
+        size_t nextIndex = 0;
+        while (nextIndex < stateCount && states[nextIndex] != next) {
+          ++nextIndex;
+        }
+        if (nextIndex < stateCount) {
+          transition = nextIndex;
+        } else if (stateCount < JAVELIN_PATTERN_DFA_STATE_LIMIT) {
+          states[stateCount] = next;
+          transition = stateCount++;
+        } else {
+          transition = ACCEPT_STATE;
+        }
+      }
+      transitions[stateIndex][classIndex] = transition;
+    }
+  }
+  delete builder;
+
+  PatternDfa *dfa =
+      (PatternDfa *)malloc(sizeof(PatternDfa) + stateCount * classCount);
+  dfa->stateCount = stateCount;
+  dfa->classCount = classCount;
+  memcpy(dfa->byteClasses, byteClasses, sizeof(byteClasses));
+  for (size_t i = 0; i < stateCount; ++i) {
+    memcpy(dfa->transitions + i * classCount, transitions[i], classCount);
+  }
+  return dfa;
+}
+
+//---------------------------------------------------------------------------
+
+void PatternComponent::AddDfaClosure(PatternDfaBuilder &builder) const {
+  builder.AddPosition(this, 0);
+}
+
+void PatternComponent::AddDfaNextClosure(PatternDfaBuilder &builder,
+                                         size_t offset) const {
+  next->AddDfaClosure(builder);
+}
+
+void SuccessPatternComponent::AddDfaClosure(PatternDfaBuilder &builder) const {
+  builder.AddMatch();
+}
+
+void EpsilonPatternComponent::AddDfaClosure(PatternDfaBuilder &builder) const {
+  GetNext()->AddDfaClosure(builder);
+}
+
+bool AnyPatternComponent::IsDfaByteMatch(size_t offset, uint8_t c) const {
+  return c != 0;
+}
+
+void AnyStarPatternComponent::AddDfaClosure(PatternDfaBuilder &builder) const {
+  builder.AddPosition(this, 0);
+  GetNext()->AddDfaClosure(builder);
+}
+
+bool AnyStarPatternComponent::IsDfaByteMatch(size_t offset, uint8_t c) const {
+  return c != 0;
+}
+
+void AnyStarPatternComponent::AddDfaNextClosure(PatternDfaBuilder &builder,
+                                                size_t offset) const {
+  AddDfaClosure(builder);
+}
+
+void BackReferencePatternComponent::AddDfaClosure(
+    PatternDfaBuilder &builder) const {
+  builder.SetUnsupported();
+}
+
+bool CharacterSetPatternComponent::IsDfaByteMatch(size_t offset,
+                                                  uint8_t c) const {
+  return c < 128 && IsBitSet(c);
+}
+
+void BranchPatternComponent::AddDfaClosure(PatternDfaBuilder &builder) const {
+  if (builder.Visit(this)) {
+    branch->AddDfaClosure(builder);
+    GetNext()->AddDfaClosure(builder);
+  }
+}
+
+void StartOfLinePatternComponent::AddDfaClosure(
+    PatternDfaBuilder &builder) const {
+  if (builder.IsAtStart()) {
+    GetNext()->AddDfaClosure(builder);
+  } else if (builder.IsAtEnd()) {
+    // ^ after $ only matches empty text, which isn't tracked.
+    builder.SetUnsupported();
+  }
+}
+
+bool EndOfLinePatternComponent::IsDfaByteMatch(size_t offset,
+                                               uint8_t c) const {
+  return c == 0;
+}
+
+void EndOfLinePatternComponent::AddDfaClosure(
+    PatternDfaBuilder &builder) const {
+  if (builder.IsAtEnd()) {
+    GetNext()->AddDfaClosure(builder);
+  } else {
+    builder.AddPosition(this, 0);
+  }
+}
+
+void CapturePatternComponent::AddDfaClosure(PatternDfaBuilder &builder) const {
+  GetNext()->AddDfaClosure(builder);
+}
+
+bool BytePatternComponent::IsDfaByteMatch(size_t offset, uint8_t c) const {
+  return c == byte;
+}
+
+bool LiteralPatternComponent::IsDfaByteMatch(size_t offset, uint8_t c) const {
+  return c == (uint8_t)text[offset];
+}
+
+void LiteralPatternComponent::AddDfaNextClosure(PatternDfaBuilder &builder,
+                                                size_t offset) const {
+  if (text[offset + 1] != '\0') {
+    builder.AddPosition(this, offset + 1);
+  } else {
+    GetNext()->AddDfaClosure(builder);
+  }
+}
+
+void AlternatePatternComponent::AddDfaClosure(
+    PatternDfaBuilder &builder) const {
+  for (size_t i = 0; i < componentCount; ++i) {
+    components[i]->AddDfaClosure(builder);
+  }
+}
+
+//---------------------------------------------------------------------------
+
+#include "pattern.h"
+#include "unit_test.h"
+
+TEST_BEGIN("PatternDfa: Rejects text that can't match") {
+  const Pattern pattern = Pattern::Compile("^(.*[aeiou])([bdgmnpt]) \\^ing$");
+  assert(pattern.GetDfaStateCount() != 0);
+
+  assert(pattern.Match("sit ^ing").match);
+  assert(!pattern.Match("sit ^ings").match);
+  assert(!pattern.Match("sir ^ing").match);
+  assert(!pattern.Match("st ^ing").match);
+  assert(pattern.Match("admit ^ing").match);
+}
+TEST_END
+
+TEST_BEGIN("PatternDfa: Unsupported patterns have no DFA") {
+  const Pattern backReference = Pattern::Compile("^(.)\\1");
+  assert(backReference.GetDfaStateCount() == 0);
+  assert(backReference.Match("aa").match);
+  assert(!backReference.Match("ab").match);
+
+  const Pattern matchAll = Pattern::Compile("a*");
+  assert(matchAll.GetDfaStateCount() == 0);
+  assert(matchAll.Match("b").match);
+}
+TEST_END
+
+TEST_BEGIN("PatternDfa: Handles loops, alternates and anchors") {
+  struct TestCase {
+    const char *pattern;
+    const char *text;
+    bool match;
+  };
+  static const TestCase TEST_CASES[] = {
+      {"^(.*)(s|sh|x|z|ch) \\^s$", "bush ^s", true},
+      {"^(.*)(s|sh|x|z|ch) \\^s$", "bug ^s", false},
+      {"^(.*)c \\^(al|ly)?$", "magic ^", true},
+      {"^(.*)c \\^(al|ly)?$", "magic ^ly", true},
+      {"^(.*)c \\^(al|ly)?$", "magic ^lyx", false},
+      {"^a(b|c)*d$", "ad", true},
+      {"^a(b|c)*d$", "abcbd", true},
+      {"^a(b|c)*d$", "abce", false},
+      {"^(x+)+y", "xxxy", true},
+      {"^(x+)+y", "y", false},
+      {"^$", "", true},
+      {"^$", "a", false},
+  };
+
+  for (const TestCase &testCase : TEST_CASES) {
+    const Pattern pattern = Pattern::Compile(testCase.pattern);
+    assert(pattern.GetDfaStateCount() != 0);
+    assert(pattern.Match(testCase.text).match == testCase.match);
+  }
+}
+TEST_END
+
+//---------------------------------------------------------------------------
+
+#endif
+
+//---------------------------------------------------------------------------
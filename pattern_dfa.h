@@ -0,0 +1,120 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------
+
+// Patterns are prefiltered by a DFA with at most this many states, which
+// rejects non-matching text in linear time before the backtracking matcher
+// runs. Text that reaches transitions beyond the limit falls back to the
+// backtracking matcher. 0 disables the prefilter.
+#if !defined(JAVELIN_PATTERN_DFA_STATE_LIMIT)
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
+#define JAVELIN_PATTERN_DFA_STATE_LIMIT 0
+#else
+#define JAVELIN_PATTERN_DFA_STATE_LIMIT 32
+#endif
+#endif
+
+#define JAVELIN_USE_PATTERN_DFA (JAVELIN_PATTERN_DFA_STATE_LIMIT > 0)
+
+#if JAVELIN_USE_PATTERN_DFA
+
+static_assert(JAVELIN_PATTERN_DFA_STATE_LIMIT < 255,
+              "DFA states are stored in a byte");
+
+//---------------------------------------------------------------------------
+
+class PatternComponent;
+
+// Match or no-match DFA for a pattern, ignoring captures.
+//
+// States are built by subset construction over the pattern components at
+// compile time, so matching never modifies the DFA. Bytes that lead to the
+// same transitions share a byte class, and each state has one transition
+// per class.
+class PatternDfa {
+public:
+  // Returns nullptr when the pattern can't be represented, or would match
+  // any text.
+  static const PatternDfa *Build(const PatternComponent *root);
+
+  // Returns false only when text cannot match.
+  bool IsPossibleMatch(const char *text) const {
+    const uint8_t *p = (const uint8_t *)text;
+    size_t state = 0;
+    for (;;) {
+      state = transitions[state * classCount + byteClasses[*p++]];
+      if (state >= ACCEPT_STATE) {
+        return state == ACCEPT_STATE;
+      }
+    }
+  }
+
+  size_t GetStateCount() const { return stateCount; }
+  size_t GetClassCount() const { return classCount; }
+  size_t GetMemoryUsage() const {
+    return sizeof(PatternDfa) + stateCount * classCount;
+  }
+
+private:
+  // Also used for transitions to states beyond the state limit.
+  static const uint8_t ACCEPT_STATE = 0xfe;
+  static const uint8_t REJECT_STATE = 0xff;
+
+  uint8_t stateCount;
+  uint8_t classCount;
+  uint8_t byteClasses[256];
+  uint8_t transitions[];
+};
+
+//---------------------------------------------------------------------------
+
+// Collects the positions reachable from a component without consuming
+// input. A position is a component that consumes a byte, with an offset for
+// literals.
+class PatternDfaBuilder {
+public:
+  bool IsAtStart() const { return atStart; }
+  bool IsAtEnd() const { return atEnd; }
+
+  void AddMatch() { closureMatch = true; }
+  void AddPosition(const PatternComponent *component, size_t offset);
+  void SetUnsupported() { isSupported = false; }
+
+  // Returns false if the component has already been visited in this
+  // closure, which happens for loops that don't consume input.
+  bool Visit(const PatternComponent *component);
+
+private:
+  static const size_t MAX_POSITIONS = 64;
+  static const size_t MAX_VISITED = 32;
+
+  struct Position {
+    const PatternComponent *component;
+    size_t offset;
+    uint64_t nextClosure;
+    bool nextMatch;
+  };
+
+  bool isSupported = true;
+  bool atStart;
+  bool atEnd;
+  bool closureMatch;
+  uint64_t closure;
+
+  size_t positionCount = 0;
+  size_t visitedCount;
+  Position positions[MAX_POSITIONS];
+  const PatternComponent *visited[MAX_VISITED];
+
+  void BeginClosure(bool start, bool end);
+
+  friend class PatternDfa;
+};
+
+#endif
+
+//---------------------------------------------------------------------------
@@ -0,0 +1,468 @@
+//---------------------------------------------------------------------------
+//
+// x86-64 code generator for patterns, used by host builds with
+// JAVELIN_USE_PATTERN_JIT.
+//
+// Generated code uses the match method signature directly:
+//   rdi: start of text, for ^
+//   rsi: captures
+//   rdx: current text pointer
+//   eax: result
+//
+// Components only clobber rax, rcx and r8, and call their successors with
+// `call` wherever the interpreter would backtrack. The first bytes of every
+// compiled pattern are a shared failure exit, so no component has offset 0.
+//
+//---------------------------------------------------------------------------
+
+#include "pattern_component.h"
+
+#if JAVELIN_USE_PATTERN_JIT && defined(__x86_64__)
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+//---------------------------------------------------------------------------
+
+const uint8_t X86_JE = 0x84;
+const uint8_t X86_JNE = 0x85;
+const uint8_t X86_JAE = 0x83;
+
+// xor eax, eax; ret
+const uint8_t FAIL_CODE[] = {0x31, 0xc0, 0xc3};
+const size_t ENTRY_OFFSET = sizeof(FAIL_CODE);
+
+//---------------------------------------------------------------------------
+
+// Executable memory for compiled patterns. Code is packed into shared pages,
+// which are made writable only while new code is copied in. As with the
+// component pool allocator, patterns must be compiled before other threads
+// start matching.
+class PatternJitCodeArena {
+public:
+  static const void *Add(const uint8_t *code, size_t length);
+
+private:
+  static const size_t BLOCK_SIZE = 64 * 1024;
+
+  static uint8_t *data;
+  static size_t used;
+  static size_t size;
+};
+
+uint8_t *PatternJitCodeArena::data = nullptr;
+size_t PatternJitCodeArena::used = 0;
+size_t PatternJitCodeArena::size = 0;
+
+const void *PatternJitCodeArena::Add(const uint8_t *code, size_t length) {
+  const size_t pageSize = sysconf(_SC_PAGESIZE);
+  if (used + length > size) {
+    size = (length + BLOCK_SIZE - 1) & -BLOCK_SIZE;
+    used = 0;
+    data = (uint8_t *)mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(data != MAP_FAILED);
+  }
+
+  uint8_t *result = data + used;
+  uint8_t *const pageStart = (uint8_t *)((size_t)result & -pageSize);
+  const size_t protectLength = result + length - pageStart;
+
+  mprotect(pageStart, protectLength, PROT_READ | PROT_WRITE);
+  memcpy(result, code, length);
+  mprotect(pageStart, protectLength, PROT_READ | PROT_EXEC);
+
+  used = (used + length + 15) & -16;
+  return result;
+}
+
+//---------------------------------------------------------------------------
+
+PatternJitContext::PatternJitContext()
+    : buffer((uint8_t *)malloc(1024)), count(0), capacity(1024),
+      callSites(nullptr), callSiteCount(0), callSiteCapacity(0) {
+  // The success component is shared by all patterns, so its offset from a
+  // previous compile is not valid here.
+  SuccessPatternComponent::instance.jitOffset = 0;
+  AddCode(FAIL_CODE, sizeof(FAIL_CODE));
+}
+
+PatternJitContext::~PatternJitContext() {
+  free(buffer);
+  free(callSites);
+}
+
+bool PatternJitContext::StartComponent(const PatternComponent *component) {
+  if (component->jitOffset != 0) {
+    Branch(component->jitOffset);
+    return false;
+  }
+  component->jitOffset = count;
+  return true;
+}
+
+void PatternJitContext::AddCode(const void *data, size_t length) {
+  if (count + length > capacity) {
+    while (count + length > capacity) {
+      capacity *= 2;
+    }
+    buffer = (uint8_t *)realloc(buffer, capacity);
+  }
+  memcpy(buffer + count, data, length);
+  count += length;
+}
+
+// Updates the rel32 at |offset| to target the current offset.
+void PatternJitContext::PatchBranch(size_t offset) {
+  const int32_t displacement = int32_t(count - (offset + 4));
+  memcpy(buffer + offset, &displacement, 4);
+}
+
+void PatternJitContext::Call(const PatternComponent *component) {
+  const uint8_t code[] = {0xe8, 0, 0, 0, 0}; // call rel32
+  AddCode(code, sizeof(code));
+
+  if (callSiteCount == callSiteCapacity) {
+    callSiteCapacity = callSiteCapacity ? 2 * callSiteCapacity : 16;
+    callSites =
+        (CallSite *)realloc(callSites, callSiteCapacity * sizeof(CallSite));
+  }
+  callSites[callSiteCount++] = {
+      .offset = count - 4,
+      .component = component,
+  };
+}
+
+void PatternJitContext::Branch(size_t target) {
+  const uint8_t code[] = {0xe9, 0, 0, 0, 0}; // jmp rel32
+  AddCode(code, sizeof(code));
+  const int32_t displacement = int32_t(target - count);
+  memcpy(buffer + count - 4, &displacement, 4);
+}
+
+void PatternJitContext::BranchFail(uint8_t condition) {
+  const uint8_t code[] = {0x0f, condition, 0, 0, 0, 0}; // jcc rel32
+  AddCode(code, sizeof(code));
+  const int32_t displacement = -int32_t(count);
+  memcpy(buffer + count - 4, &displacement, 4);
+}
+
+void PatternJitContext::BneFail() { BranchFail(X86_JNE); }
+void PatternJitContext::BeqFail() { BranchFail(X86_JE); }
+void PatternJitContext::BhsFail() { BranchFail(X86_JAE); }
+
+bool (*PatternJitContext::Build())(const char *, const char **,
+                                   const char *) {
+  // Compiling a call target can add further call sites.
+  for (size_t i = 0; i < callSiteCount; ++i) {
+    const PatternComponent *component = callSites[i].component;
+    if (component->jitOffset == 0) {
+      component->Compile(*this);
+    }
+  }
+  for (size_t i = 0; i < callSiteCount; ++i) {
+    const size_t offset = callSites[i].offset;
+    const int32_t displacement =
+        int32_t(callSites[i].component->jitOffset - (offset + 4));
+    memcpy(buffer + offset, &displacement, 4);
+  }
+
+  const uint8_t *code =
+      (const uint8_t *)PatternJitCodeArena::Add(buffer, count);
+  return (bool (*)(const char *, const char **, const char *))(code +
+                                                               ENTRY_OFFSET);
+}
+
+//---------------------------------------------------------------------------
+
+void SuccessPatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+  const uint8_t code[] = {
+      0xb8, 1, 0, 0, 0, // mov eax, 1
+      0xc3,             // ret
+  };
+  context.AddCode(code, sizeof(code));
+}
+
+void EpsilonPatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+  GetNext()->Compile(context);
+}
+
+void AnyPatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+  const uint8_t compare[] = {0x80, 0x3a, 0}; // cmp byte [rdx], 0
+  context.AddCode(compare, sizeof(compare));
+  context.BeqFail();
+  const uint8_t increment[] = {0x48, 0xff, 0xc2}; // inc rdx
+  context.AddCode(increment, sizeof(increment));
+  GetNext()->Compile(context);
+}
+
+void AnyStarPatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+
+  // Find the end of the text, then try the next component at each position
+  // back to the start.
+  const uint8_t scan[] = {
+      0x48, 0x89, 0xd1, // mov rcx, rdx
+      0x80, 0x3a, 0,    // scan: cmp byte [rdx], 0
+      0x74, 0x05,       //   je loop
+      0x48, 0xff, 0xc2, //   inc rdx
+      0xeb, 0xf6,       //   jmp scan
+  };
+  context.AddCode(scan, sizeof(scan));
+
+  const size_t loopOffset = context.GetOffset();
+  const uint8_t save[] = {
+      0x51, // push rcx
+      0x52, // push rdx
+  };
+  context.AddCode(save, sizeof(save));
+  context.Call(GetNext());
+  const uint8_t restore[] = {
+      0x5a,             // pop rdx
+      0x59,             // pop rcx
+      0x85, 0xc0,       // test eax, eax
+      0x74, 0x01,       // jz next
+      0xc3,             // ret
+      0x48, 0x39, 0xca, // next: cmp rdx, rcx
+  };
+  context.AddCode(restore, sizeof(restore));
+  context.BeqFail();
+  const uint8_t decrement[] = {0x48, 0xff, 0xca}; // dec rdx
+  context.AddCode(decrement, sizeof(decrement));
+  context.Branch(loopOffset);
+}
+
+void BackReferencePatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+
+  const int32_t offset = index * 2 * sizeof(const char *);
+  uint8_t load[14] = {
+      0x48, 0x8b, 0x8e, 0, 0, 0, 0, // mov rcx, [rsi + start]
+      0x4c, 0x8b, 0x86, 0, 0, 0, 0, // mov r8, [rsi + end]
+  };
+  const int32_t endOffset = offset + sizeof(const char *);
+  memcpy(load + 3, &offset, 4);
+  memcpy(load + 10, &endOffset, 4);
+  context.AddCode(load, sizeof(load));
+
+  const uint8_t compare[] = {
+      0x4c, 0x39, 0xc1, // loop: cmp rcx, r8
+      0x73, 0x12,       //   jae done
+      0x8a, 0x01,       //   mov al, [rcx]
+      0x3a, 0x02,       //   cmp al, [rdx]
+  };
+  context.AddCode(compare, sizeof(compare));
+  context.BneFail();
+  const uint8_t increment[] = {
+      0x48, 0xff, 0xc1, // inc rcx
+      0x48, 0xff, 0xc2, // inc rdx
+      0xeb, 0xe9,       // jmp loop
+  };
+  context.AddCode(increment, sizeof(increment));
+
+  GetNext()->Compile(context);
+}
+
+void CharacterSetPatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+
+  uint64_t lowMask;
+  uint64_t highMask;
+  memcpy(&lowMask, mask, 8);
+  memcpy(&highMask, mask + 8, 8);
+
+  const uint8_t loadByte[] = {0x0f, 0xb6, 0x02}; // movzx eax, byte [rdx]
+  context.AddCode(loadByte, sizeof(loadByte));
+
+  if (highMask == 0) {
+    const uint8_t compare[] = {0x83, 0xf8, 0x40}; // cmp eax, 64
+    context.AddCode(compare, sizeof(compare));
+    context.BhsFail();
+
+    uint8_t loadMask[10] = {0x48, 0xb9}; // mov rcx, lowMask
+    memcpy(loadMask + 2, &lowMask, 8);
+    context.AddCode(loadMask, sizeof(loadMask));
+  } else {
+    const uint8_t compare[] = {0x3d, 0x80, 0, 0, 0}; // cmp eax, 128
+    context.AddCode(compare, sizeof(compare));
+    context.BhsFail();
+
+    uint8_t loadMask[] = {
+        0x48, 0xb9, 0, 0, 0, 0, 0, 0, 0, 0, // mov rcx, lowMask
+        0x49, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, // mov r8, highMask
+        0x83, 0xf8, 0x40,                   // cmp eax, 64
+        0x49, 0x0f, 0x43, 0xc8,             // cmovae rcx, r8
+    };
+    memcpy(loadMask + 2, &lowMask, 8);
+    memcpy(loadMask + 12, &highMask, 8);
+    context.AddCode(loadMask, sizeof(loadMask));
+  }
+
+  const uint8_t test[] = {0x48, 0x0f, 0xa3, 0xc1}; // bt rcx, rax
+  context.AddCode(test, sizeof(test));
+  context.BhsFail();
+
+  const uint8_t increment[] = {0x48, 0xff, 0xc2}; // inc rdx
+  context.AddCode(increment, sizeof(increment));
+  GetNext()->Compile(context);
+}
+
+void BranchPatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+
+  const uint8_t save[] = {0x52}; // push rdx
+  context.AddCode(save, sizeof(save));
+  context.Call(branch);
+  const uint8_t restore[] = {
+      0x5a,       // pop rdx
+      0x85, 0xc0, // test eax, eax
+      0x74, 0x01, // jz next
+      0xc3,       // ret
+  };
+  context.AddCode(restore, sizeof(restore));
+  GetNext()->Compile(context);
+}
+
+void StartOfLinePatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+  const uint8_t compare[] = {0x48, 0x39, 0xfa}; // cmp rdx, rdi
+  context.AddCode(compare, sizeof(compare));
+  context.BneFail();
+  GetNext()->Compile(context);
+}
+
+void EndOfLinePatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+  const uint8_t compare[] = {0x80, 0x3a, 0}; // cmp byte [rdx], 0
+  context.AddCode(compare, sizeof(compare));
+  context.BneFail();
+  GetNext()->Compile(context);
+}
+
+void CapturePatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+
+  // The previous capture value is kept on the stack, and restored if the
+  // rest of the pattern fails.
+  const int32_t offset = index * sizeof(const char *);
+  uint8_t store[13] = {
+      0xff, 0xb6, 0, 0, 0, 0,       // push qword [rsi + offset]
+      0x48, 0x89, 0x96, 0, 0, 0, 0, // mov [rsi + offset], rdx
+  };
+  memcpy(store + 2, &offset, 4);
+  memcpy(store + 9, &offset, 4);
+  context.AddCode(store, sizeof(store));
+
+  context.Call(GetNext());
+
+  uint8_t restore[] = {
+      0x59,                         // pop rcx
+      0x85, 0xc0,                   // test eax, eax
+      0x75, 0x07,                   // jnz done
+      0x48, 0x89, 0x8e, 0, 0, 0, 0, // mov [rsi + offset], rcx
+      0xc3,                         // done: ret
+  };
+  memcpy(restore + 8, &offset, 4);
+  context.AddCode(restore, sizeof(restore));
+}
+
+//---------------------------------------------------------------------------
+
+void BytePatternComponent::CompileByteCheck(PatternJitContext &context,
+                                            uint8_t byte) {
+  const uint8_t compare[] = {0x80, 0x3a, byte}; // cmp byte [rdx], byte
+  context.AddCode(compare, sizeof(compare));
+  context.BneFail();
+  const uint8_t increment[] = {0x48, 0xff, 0xc2}; // inc rdx
+  context.AddCode(increment, sizeof(increment));
+}
+
+void BytePatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+  CompileByteCheck(context, byte);
+  GetNext()->Compile(context);
+}
+
+//---------------------------------------------------------------------------
+
+void LiteralPatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+
+  // Compare using 8 bit displacements from rdx, advancing rdx whenever the
+  // displacement would overflow, and once at the end.
+  size_t displacement = 0;
+  for (const char *p = text; *p; ++p) {
+    if (displacement == 127) {
+      const uint8_t advance[] = {0x48, 0x83, 0xc2, 0x7f}; // add rdx, 127
+      context.AddCode(advance, sizeof(advance));
+      displacement = 0;
+    }
+    // cmp byte [rdx + displacement], c
+    const uint8_t compare[] = {0x80, 0x7a, uint8_t(displacement), uint8_t(*p)};
+    context.AddCode(compare, sizeof(compare));
+    context.BneFail();
+    ++displacement;
+  }
+  const uint8_t advance[] = {0x48, 0x83, 0xc2, uint8_t(displacement)};
+  context.AddCode(advance, sizeof(advance));
+
+  GetNext()->Compile(context);
+}
+
+//---------------------------------------------------------------------------
+
+void AlternatePatternComponent::Compile(PatternJitContext &context) const {
+  if (!context.StartComponent(this)) {
+    return;
+  }
+
+  for (size_t i = 0; i + 1 < componentCount; ++i) {
+    const uint8_t save[] = {0x52}; // push rdx
+    context.AddCode(save, sizeof(save));
+    context.Call(components[i]);
+    const uint8_t restore[] = {
+        0x5a,       // pop rdx
+        0x85, 0xc0, // test eax, eax
+        0x74, 0x01, // jz next
+        0xc3,       // ret
+    };
+    context.AddCode(restore, sizeof(restore));
+  }
+  components[componentCount - 1]->Compile(context);
+}
+
+//---------------------------------------------------------------------------
+
+#endif
+
+//---------------------------------------------------------------------------
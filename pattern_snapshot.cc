@@ -0,0 +1,441 @@
+//---------------------------------------------------------------------------
+
+#include "pattern_snapshot.h"
+#include "pattern_component.h"
+
+//---------------------------------------------------------------------------
+
+bool PatternSnapshot::Match(size_t pc, const char *p,
+                            PatternContext &context) const {
+  for (;;) {
+    switch (program[pc]) {
+    case SUCCESS:
+      return true;
+
+    case BYTE:
+      if (*p != (char)program[pc + 1]) {
+        return false;
+      }
+      ++p;
+      pc += 2;
+      break;
+
+    case LITERAL: {
+      const uint8_t *text = program + pc + 2;
+      const uint8_t *textEnd = text + program[pc + 1];
+      // Literals never contain null, so this stops at the end of p.
+      while (text < textEnd) {
+        if (*p++ != (char)*text++) {
+          return false;
+        }
+      }
+      pc = textEnd - program;
+      break;
+    }
+
+    case ANY:
+      if (*p == '\0') {
+        return false;
+      }
+      ++p;
+      ++pc;
+      break;
+
+    case ANY_STAR: {
+      const char *start = p;
+      p += strlen(p);
+
+      // Only positions where the following byte can match are tried.
+      const uint8_t *mask = nullptr;
+      int nextByte = -1;
+      size_t nextPc = pc + 1;
+      while (program[nextPc] == CAPTURE) {
+        nextPc += 2;
+      }
+      switch (program[nextPc]) {
+      case BYTE:
+        nextByte = program[nextPc + 1];
+        break;
+      case LITERAL:
+        nextByte = program[nextPc + 2];
+        break;
+      case END_OF_LINE:
+        nextByte = 0;
+        break;
+      case CHARACTER_SET:
+        mask = program + nextPc + 1;
+        break;
+      }
+
+      while (p >= start) {
+        const uint8_t c = *(const uint8_t *)p;
+        if (nextByte >= 0 ? c == nextByte
+                          : mask == nullptr ||
+                                (c < 128 && (mask[c / 8] & (1 << (c & 7))))) {
+          if (Match(pc + 1, p, context)) {
+            return true;
+          }
+        }
+        --p;
+      }
+      return false;
+    }
+
+    case CHARACTER_SET: {
+      const uint8_t c = *(const uint8_t *)p;
+      if (c >= 128 || (program[pc + 1 + c / 8] & (1 << (c & 7))) == 0) {
+        return false;
+      }
+      ++p;
+      pc += 17;
+      break;
+    }
+
+    case BACK_REFERENCE: {
+      const size_t index = program[pc + 1];
+      const char *compareP = context.captures[index * 2];
+      const char *comparedEnd = context.captures[index * 2 + 1];
+      while (compareP < comparedEnd) {
+        if (*p++ != *compareP++) {
+          return false;
+        }
+      }
+      pc += 2;
+      break;
+    }
+
+    case START_OF_LINE:
+      if (p != context.start) {
+        return false;
+      }
+      ++pc;
+      break;
+
+    case END_OF_LINE:
+      if (*p != '\0') {
+        return false;
+      }
+      ++pc;
+      break;
+
+    case CAPTURE: {
+      const char **const capture = &context.captures[program[pc + 1]];
+      const char *previous = *capture;
+      *capture = p;
+      if (Match(pc + 2, p, context)) {
+        return true;
+      }
+      *capture = previous;
+      return false;
+    }
+
+    case BRANCH:
+      if (Match(GetTarget(pc + 1), p, context)) {
+        return true;
+      }
+      pc += 3;
+      break;
+
+    case ALTERNATE: {
+      const size_t count = program[pc + 1];
+      for (size_t i = 0; i < count; ++i) {
+        if (Match(GetTarget(pc + 2 + 2 * i), p, context)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    case JUMP:
+      pc = GetTarget(pc + 1);
+      break;
+
+    default:
+      assert(!"Invalid pattern snapshot");
+      return false;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+
+#if JAVELIN_USE_PATTERN_SNAPSHOT_WRITER
+
+bool PatternSnapshotWriter::Write(List<uint8_t> &buffer,
+                                  const PatternComponent *root,
+                                  PatternQuickReject quickReject,
+                                  const void *dfa, size_t dfaSize) {
+  PatternSnapshotWriter writer;
+  root->WriteSnapshot(writer);
+
+  // Targets are written after the sequence that refers to them, which can
+  // add more targets.
+  for (size_t i = 0; i < writer.pendingTargets.GetCount(); ++i) {
+    const Label target = writer.pendingTargets[i];
+    const Label *label = writer.FindComponent(target.component);
+    if (label == nullptr) {
+      target.component->WriteSnapshot(writer);
+      label = writer.FindComponent(target.component);
+    }
+    writer.program[target.offset] = label->offset;
+    writer.program[target.offset + 1] = label->offset >> 8;
+  }
+
+  const size_t programOffset = sizeof(PatternSnapshot);
+  const size_t dfaOffset =
+      dfa ? programOffset + writer.program.GetCount() : 0;
+  const size_t size = (programOffset + writer.program.GetCount() + dfaSize +
+                       sizeof(uint32_t) - 1) &
+                      -sizeof(uint32_t);
+  if (size > 0xffff) {
+    return false;
+  }
+
+  PatternSnapshot header = {
+      .quickReject = quickReject,
+      .dfaOffset = uint16_t(dfaOffset),
+      .size = uint16_t(size),
+  };
+  const size_t start = buffer.GetCount();
+  buffer.AddCount((const uint8_t *)&header, sizeof(header));
+  buffer.AddCount(begin(writer.program), writer.program.GetCount());
+  if (dfa) {
+    buffer.AddCount((const uint8_t *)dfa, dfaSize);
+  }
+  while (buffer.GetCount() - start < size) {
+    buffer.Add(0);
+  }
+  return true;
+}
+
+const PatternSnapshotWriter::Label *
+PatternSnapshotWriter::FindComponent(const PatternComponent *component) const {
+  for (const Label &label : componentOffsets) {
+    if (label.component == component) {
+      return &label;
+    }
+  }
+  return nullptr;
+}
+
+bool PatternSnapshotWriter::StartComponent(const PatternComponent *component) {
+  const Label *label = FindComponent(component);
+  if (label) {
+    Add(PatternSnapshot::JUMP);
+    AddOffset(label->offset);
+    return false;
+  }
+
+  componentOffsets.Add(Label{
+      .component = component,
+      .offset = program.GetCount(),
+  });
+  return true;
+}
+
+void PatternSnapshotWriter::AddTarget(const PatternComponent *component) {
+  pendingTargets.Add(Label{
+      .component = component,
+      .offset = program.GetCount(),
+  });
+  AddOffset(0);
+}
+
+void PatternSnapshotWriter::AddOffset(size_t offset) {
+  Add(offset);
+  Add(offset >> 8);
+}
+
+//---------------------------------------------------------------------------
+
+void SuccessPatternComponent::WriteSnapshot(
+    PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    writer.Add(PatternSnapshot::SUCCESS);
+  }
+}
+
+void EpsilonPatternComponent::WriteSnapshot(
+    PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    GetNext()->WriteSnapshot(writer);
+  }
+}
+
+void AnyPatternComponent::WriteSnapshot(PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    writer.Add(PatternSnapshot::ANY);
+    GetNext()->WriteSnapshot(writer);
+  }
+}
+
+void AnyStarPatternComponent::WriteSnapshot(
+    PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    writer.Add(PatternSnapshot::ANY_STAR);
+    GetNext()->WriteSnapshot(writer);
+  }
+}
+
+void BackReferencePatternComponent::WriteSnapshot(
+    PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    writer.Add(PatternSnapshot::BACK_REFERENCE);
+    writer.Add(index);
+    GetNext()->WriteSnapshot(writer);
+  }
+}
+
+void CharacterSetPatternComponent::WriteSnapshot(
+    PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    writer.Add(PatternSnapshot::CHARACTER_SET);
+    writer.Add(mask, sizeof(mask));
+    GetNext()->WriteSnapshot(writer);
+  }
+}
+
+void BranchPatternComponent::WriteSnapshot(
+    PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    writer.Add(PatternSnapshot::BRANCH);
+    writer.AddTarget(branch);
+    GetNext()->WriteSnapshot(writer);
+  }
+}
+
+void StartOfLinePatternComponent::WriteSnapshot(
+    PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    writer.Add(PatternSnapshot::START_OF_LINE);
+    GetNext()->WriteSnapshot(writer);
+  }
+}
+
+void EndOfLinePatternComponent::WriteSnapshot(
+    PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    writer.Add(PatternSnapshot::END_OF_LINE);
+    GetNext()->WriteSnapshot(writer);
+  }
+}
+
+void CapturePatternComponent::WriteSnapshot(
+    PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    writer.Add(PatternSnapshot::CAPTURE);
+    writer.Add(index);
+    GetNext()->WriteSnapshot(writer);
+  }
+}
+
+void BytePatternComponent::WriteSnapshot(PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    writer.Add(PatternSnapshot::BYTE);
+    writer.Add(byte);
+    GetNext()->WriteSnapshot(writer);
+  }
+}
+
+void LiteralPatternComponent::WriteSnapshot(
+    PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    const char *p = text;
+    size_t length = strlen(p);
+    while (length) {
+      const size_t chunkLength = length < 255 ? length : 255;
+      writer.Add(PatternSnapshot::LITERAL);
+      writer.Add(chunkLength);
+      writer.Add(p, chunkLength);
+      p += chunkLength;
+      length -= chunkLength;
+    }
+    GetNext()->WriteSnapshot(writer);
+  }
+}
+
+void AlternatePatternComponent::WriteSnapshot(
+    PatternSnapshotWriter &writer) const {
+  if (writer.StartComponent(this)) {
+    assert(componentCount <= 255);
+    writer.Add(PatternSnapshot::ALTERNATE);
+    writer.Add(componentCount);
+    for (size_t i = 0; i < componentCount; ++i) {
+      writer.AddTarget(components[i]);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+
+#include "pattern.h"
+#include "str.h"
+#include "unit_test.h"
+#include <stdlib.h>
+
+TEST_BEGIN("PatternSnapshot: Matches the same as compiled patterns") {
+  static const char *const PATTERNS[] = {
+      "^(.*)e \\^ing$",
+      "^(.*[aeiou])([bdgmnpt]) \\^(ed|ing|er)$",
+      "^(.*)(s|sh|x|z|ch) \\^s$",
+      "^(.*)c \\^(al|ly)?$",
+      "(.+(.))\\2ed",
+      "a(b|c)*d",
+      "^(x+)+y",
+      "(x|)y",
+      "abc|",
+      "^$",
+  };
+  static const char *const TEXTS[] = {
+      "",         "make ^ing", "stop ^ed", "bush ^s",  "magic ^",
+      "magic ^ly", "fitted",   "abcbcd",   "ad",       "xxxy",
+      "y",        "zzabc",     "xy",       "stop ^ing",
+  };
+
+  for (const char *source : PATTERNS) {
+    List<uint8_t> buffer;
+    assert(Pattern::CreateSnapshot(buffer, source));
+    const PatternSnapshot *snapshot = (const PatternSnapshot *)begin(buffer);
+    assert(snapshot->size == buffer.GetCount());
+
+    const Pattern compiled = Pattern::Compile(source);
+    const Pattern loaded = Pattern::FromSnapshot(snapshot);
+    for (const char *text : TEXTS) {
+      const PatternMatch expected = compiled.Match(text);
+      const PatternMatch actual = loaded.Match(text);
+      assert(actual.match == expected.match);
+      for (size_t i = 0; i < 8; ++i) {
+        assert(actual.captures[i] == expected.captures[i]);
+      }
+
+      const PatternMatch expectedSearch = compiled.Search(text);
+      const PatternMatch actualSearch = loaded.Search(text);
+      assert(actualSearch.match == expectedSearch.match);
+      if (expectedSearch.match) {
+        assert(actualSearch.captures[0] == expectedSearch.captures[0]);
+        assert(actualSearch.captures[1] == expectedSearch.captures[1]);
+      }
+    }
+  }
+}
+TEST_END
+
+TEST_BEGIN("PatternSnapshot: Loops are written once") {
+  List<uint8_t> buffer;
+  assert(Pattern::CreateSnapshot(buffer, "^a(bc)*d$"));
+  const PatternSnapshot *snapshot = (const PatternSnapshot *)begin(buffer);
+
+  const Pattern pattern = Pattern::FromSnapshot(snapshot);
+  assert(pattern.Match("ad").match);
+  assert(pattern.Match("abcbcd").match);
+  assert(!pattern.Match("abd").match);
+
+  char *result = pattern.Replace(Str::Dup("abcd"), "x\\1y");
+  assert(Str::Eq(result, "xbcy"));
+  free(result);
+}
+TEST_END
+
+#endif
+
+//---------------------------------------------------------------------------
@@ -0,0 +1,115 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include "list.h"
+#include "pattern_quick_reject.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------
+
+// Snapshots are written on hosts, where dictionary images are built. Devices
+// only need to match them.
+#if !defined(JAVELIN_USE_PATTERN_SNAPSHOT_WRITER)
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
+#define JAVELIN_USE_PATTERN_SNAPSHOT_WRITER 0
+#else
+#define JAVELIN_USE_PATTERN_SNAPSHOT_WRITER 1
+#endif
+#endif
+
+//---------------------------------------------------------------------------
+
+class PatternComponent;
+struct PatternContext;
+
+// A compiled pattern that contains no pointers, so it can be stored in flash
+// and matched in place without compiling at startup.
+//
+// The program is a byte code version of the component graph. Components that
+// only continue to their next component are laid out sequentially, and
+// branch targets are 16 bit offsets from the start of the program.
+struct PatternSnapshot {
+  // Incremented whenever the program encoding changes.
+  static const uint32_t VERSION = 1;
+
+  enum Opcode : uint8_t {
+    SUCCESS,
+    BYTE,           // c
+    LITERAL,        // length, text[length]
+    ANY,            //
+    ANY_STAR,       //
+    CHARACTER_SET,  // mask[16]
+    BACK_REFERENCE, // index
+    START_OF_LINE,  //
+    END_OF_LINE,    //
+    CAPTURE,        // index
+    BRANCH,         // target. Tries target, then continues
+    ALTERNATE,      // count, target[count]
+    JUMP,           // target
+  };
+
+  PatternQuickReject quickReject;
+
+  // Offset of a PatternDfa from the start of the snapshot, or 0.
+  uint16_t dfaOffset;
+
+  // Total size, including padding to keep following snapshots aligned.
+  uint16_t size;
+
+  uint8_t program[];
+
+  bool Match(const char *p, PatternContext &context) const {
+    return Match(0, p, context);
+  }
+
+private:
+  bool Match(size_t pc, const char *p, PatternContext &context) const;
+
+  size_t GetTarget(size_t pc) const {
+    return program[pc] | (program[pc + 1] << 8);
+  }
+};
+
+//---------------------------------------------------------------------------
+
+#if JAVELIN_USE_PATTERN_SNAPSHOT_WRITER
+
+class PatternSnapshotWriter {
+public:
+  // Appends a PatternSnapshot for the component graph at root to buffer.
+  // Returns false if the program doesn't fit in 16 bit offsets.
+  static bool Write(List<uint8_t> &buffer, const PatternComponent *root,
+                    PatternQuickReject quickReject, const void *dfa,
+                    size_t dfaSize);
+
+  // Returns false if the component has already been written, after adding a
+  // jump to it.
+  bool StartComponent(const PatternComponent *component);
+
+  void Add(uint8_t byte) { program.Add(byte); }
+  void Add(const void *data, size_t length) {
+    program.AddCount((const uint8_t *)data, length);
+  }
+
+  // Adds a target for the component, which is written after the current
+  // sequence if it hasn't been written already.
+  void AddTarget(const PatternComponent *component);
+
+private:
+  struct Label {
+    const PatternComponent *component;
+    size_t offset;
+  };
+
+  List<uint8_t> program;
+  List<Label> componentOffsets;
+  List<Label> pendingTargets;
+
+  void AddOffset(size_t offset);
+  const Label *FindComponent(const PatternComponent *component) const;
+};
+
+#endif
+
+//---------------------------------------------------------------------------
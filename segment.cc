@@ -22,6 +22,12 @@ StenoSegmentList::~StenoSegmentList() {
 size_t
 StenoSegmentList::GetCommonStartingSegmentsCount(const List<StenoSegment> &a,
                                                  const List<StenoSegment> &b) {
+  return GetCommonStartingSegmentsCount(a, b, GetCommonSegmentsCount(a, b));
+}
+
+size_t
+StenoSegmentList::GetCommonSegmentsCount(const List<StenoSegment> &a,
+                                         const List<StenoSegment> &b) {
   const size_t limit =
       a.GetCount() < b.GetCount() ? a.GetCount() : b.GetCount();
 
@@ -35,7 +41,12 @@ StenoSegmentList::GetCommonStartingSegmentsCount(const List<StenoSegment> &a,
       break;
     }
   }
+  return commonPrefixCount;
+}
 
+size_t StenoSegmentList::GetCommonStartingSegmentsCount(
+    const List<StenoSegment> &a, const List<StenoSegment> &b,
+    size_t commonPrefixCount) {
   // For suffixes to work, check if the next segment has a command in it.
   if (commonPrefixCount < a.GetCount()) {
     if (a[commonPrefixCount].HasCommand()) {
@@ -98,9 +109,10 @@ size_t StenoSegmentList::GetWordStartingSegmentIndex(size_t endIndex) const {
 class StenoSegmentListTokenizer final : public StenoTokenizer {
 public:
   StenoSegmentListTokenizer(const List<StenoSegment> &list,
-                            size_t startingOffset)
-      : list(list), elementIndex(startingOffset) {
-    if (list.IsEmpty()) {
+                            size_t startingOffset, size_t endOffset)
+      : list(list), elementIndex(startingOffset),
+        endIndex(endOffset < list.GetCount() ? endOffset : list.GetCount()) {
+    if (elementIndex >= endIndex) {
       p = elementText = nullptr;
     } else {
       p = "";
@@ -113,9 +125,16 @@ public:
 
   StenoToken GetNext() final;
 
+  void Extend(size_t endOffset) final {
+    endIndex = endOffset < list.GetCount() ? endOffset : list.GetCount();
+    p = "";
+    PrepareNextP();
+  }
+
 private:
   const List<StenoSegment> &list;
   size_t elementIndex;
+  size_t endIndex;
   const char *elementText;
   const char *p;
   const StenoState *nextState = nullptr;
@@ -190,7 +209,7 @@ void StenoSegmentListTokenizer::PrepareNextP() {
     if (*p != '\0') {
       return;
     }
-    if (elementIndex == list.GetCount()) {
+    if (elementIndex >= endIndex) {
       p = elementText = nullptr;
       return;
     }
@@ -202,8 +221,9 @@ void StenoSegmentListTokenizer::PrepareNextP() {
 }
 
 StenoTokenizer *StenoTokenizer::Create(const List<StenoSegment> &segments,
-                                       size_t startingOffset) {
-  return new StenoSegmentListTokenizer(segments, startingOffset);
+                                       size_t startingOffset,
+                                       size_t endOffset) {
+  return new StenoSegmentListTokenizer(segments, startingOffset, endOffset);
 }
 
 //---------------------------------------------------------------------------
@@ -5,6 +5,7 @@
 #include "list.h"
 #include "malloc_allocate.h"
 #include "state.h"
+#include <stdint.h>
 
 //---------------------------------------------------------------------------
 
@@ -63,8 +64,14 @@ public:
   virtual bool HasMore() const = 0;
   virtual StenoToken GetNext() = 0;
 
+  // Continues tokenizing up to endOffset after the previous end is reached.
+  virtual void Extend(size_t endOffset) = 0;
+
+  // Tokenizes segments from startingOffset up to, but not including,
+  // endOffset.
   static StenoTokenizer *Create(const List<StenoSegment> &segments,
-                                size_t startingOffset = 0);
+                                size_t startingOffset = 0,
+                                size_t endOffset = SIZE_MAX);
 };
 
 //---------------------------------------------------------------------------
@@ -79,6 +86,16 @@ public:
   static size_t GetCommonStartingSegmentsCount(const List<StenoSegment> &a,
                                                const List<StenoSegment> &b);
 
+  // Returns the number of leading segments with the same lookups, without
+  // allowing for suffixes changing earlier segments.
+  static size_t GetCommonSegmentsCount(const List<StenoSegment> &a,
+                                       const List<StenoSegment> &b);
+
+  // As above, with commonSegmentsCount from GetCommonSegmentsCount.
+  static size_t GetCommonStartingSegmentsCount(const List<StenoSegment> &a,
+                                               const List<StenoSegment> &b,
+                                               size_t commonSegmentsCount);
+
   // Returns the starting index of a word.
   //
   // A word is defined as either finger spelling start or
@@ -15,6 +15,16 @@
 
 //---------------------------------------------------------------------------
 
+#if RECORD_SEGMENT_BUILDER_STATS
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
+size_t StenoSegmentBuilder::copyByteCount;
+#else
+thread_local size_t StenoSegmentBuilder::copyByteCount;
+#endif
+#endif
+
+//---------------------------------------------------------------------------
+
 BuildSegmentContext::BuildSegmentContext(StenoSegmentList &segments,
                                          StenoEngine &engine,
                                          bool allowSetValue)
@@ -24,26 +34,51 @@ BuildSegmentContext::BuildSegmentContext(StenoSegmentList &segments,
 
 //---------------------------------------------------------------------------
 
-void StenoSegmentBuilder::TransferStartFrom(const StenoSegmentBuilder &source,
-                                            size_t count) {
-  source.strokes->CopyTo(strokes, count);
-  source.states->CopyTo(states, count);
-  hasModifiedStrokeHistory = false;
-}
-
 void StenoSegmentBuilder::TransferFrom(const StenoStrokeHistory &source,
                                        size_t sourceStrokeCount,
                                        size_t maxCount) {
   const size_t offset =
       sourceStrokeCount <= maxCount ? 0 : sourceStrokeCount - maxCount;
   count = sourceStrokeCount - offset;
+  hasModifiedStrokeHistory = false;
+
+  if (source.IsContiguous(offset, count)) {
+    strokes = source.GetStrokes(offset);
+    states = source.GetStates(offset);
+    return;
+  }
 
   for (size_t i = 0; i < count; ++i) {
-    const StenoStrokeHistoryEntry &entry = source[offset + i];
-    strokes[i] = entry.stroke;
-    states[i] = entry.state;
+    const StenoStrokeHistory::ConstEntry entry = source[offset + i];
+    strokeBuffer[i] = entry.stroke;
+    stateBuffer[i] = entry.state;
   }
-  hasModifiedStrokeHistory = false;
+  strokes = strokeBuffer;
+  states = stateBuffer;
+#if RECORD_SEGMENT_BUILDER_STATS
+  copyByteCount += count * (sizeof(StenoStroke) + sizeof(StenoState));
+#endif
+}
+
+// Retro commands modify the strokes and states they are converting, which
+// must not change the stroke history. Copies a viewed history into the
+// buffers, and moves the segments built so far to the copy.
+void StenoSegmentBuilder::ModifyStrokeHistory(BuildSegmentContext &context) {
+  hasModifiedStrokeHistory = true;
+  if (states == stateBuffer) {
+    return;
+  }
+
+  strokes->CopyTo(strokeBuffer, count);
+  states->CopyTo(stateBuffer, count);
+  for (StenoSegment &segment : context.segments) {
+    segment.state = stateBuffer + (segment.state - states);
+  }
+  strokes = strokeBuffer;
+  states = stateBuffer;
+#if RECORD_SEGMENT_BUILDER_STATS
+  copyByteCount += count * (sizeof(StenoStroke) + sizeof(StenoState));
+#endif
 }
 
 void StenoSegmentBuilder::AddSegments(BuildSegmentContext &context,
@@ -488,8 +523,8 @@ void StenoSegmentBuilder::HandleRetroSetValue(BuildSegmentContext &context,
     writer.WriteString(format);
   }
 
-  hasModifiedStrokeHistory = true;
-  states[currentOffset].joinNext =
+  ModifyStrokeHistory(context);
+  stateBuffer[currentOffset].joinNext =
       context.segments[startingSegmentIndex].state->joinNext;
   context.segments.Add(
       StenoSegment(length, SegmentLookupType::DIRECT, states + currentOffset,
@@ -783,15 +818,15 @@ void StenoSegmentBuilder::ResetStrokes(size_t offset, size_t length) {
   emptyState.Reset();
 
   for (size_t i = 0; i < length; ++i) {
-    strokes[offset + i] = StenoStroke(0);
-    states[offset + i] = emptyState;
+    strokeBuffer[offset + i] = StenoStroke(0);
+    stateBuffer[offset + i] = emptyState;
   }
 }
 
 void StenoSegmentBuilder::HandleRetroInsertSpace(BuildSegmentContext &context,
                                                  size_t currentOffset,
                                                  size_t length) {
-  hasModifiedStrokeHistory = true;
+  ModifyStrokeHistory(context);
 
   if (currentOffset == 0) {
     ResetStrokes(currentOffset, length);
@@ -803,13 +838,13 @@ void StenoSegmentBuilder::HandleRetroInsertSpace(BuildSegmentContext &context,
 
   ResetStrokes(currentOffset - 1, length);
 
-  strokes[currentOffset + length - 1] = lastStroke;
-  states[currentOffset + length - 1] = lastState;
+  strokeBuffer[currentOffset + length - 1] = lastStroke;
+  stateBuffer[currentOffset + length - 1] = lastState;
 }
 
 void StenoSegmentBuilder::HandleRetroToggleAsterisk(
     BuildSegmentContext &context, size_t currentOffset, size_t length) {
-  hasModifiedStrokeHistory = true;
+  ModifyStrokeHistory(context);
 
   ResetStrokes(currentOffset, length);
 
@@ -817,13 +852,13 @@ void StenoSegmentBuilder::HandleRetroToggleAsterisk(
     return;
   }
 
-  strokes[currentOffset - 1] ^= StrokeMask::STAR;
+  strokeBuffer[currentOffset - 1] ^= StrokeMask::STAR;
 }
 
 void StenoSegmentBuilder::HandleRepeatLastStroke(BuildSegmentContext &context,
                                                  size_t currentOffset,
                                                  size_t length) {
-  hasModifiedStrokeHistory = true;
+  ModifyStrokeHistory(context);
 
   if (currentOffset == 0) {
     ResetStrokes(currentOffset, length);
@@ -835,8 +870,8 @@ void StenoSegmentBuilder::HandleRepeatLastStroke(BuildSegmentContext &context,
 
   ResetStrokes(currentOffset, length - 1);
 
-  strokes[currentOffset + length - 1] = lastStroke;
-  states[currentOffset + length - 1] = state;
+  strokeBuffer[currentOffset + length - 1] = lastStroke;
+  stateBuffer[currentOffset + length - 1] = state;
 }
 
 //---------------------------------------------------------------------------
@@ -937,6 +972,51 @@ TEST_BEGIN("StrokeHistory: Test *? splits strokes") {
 }
 TEST_END
 
+TEST_BEGIN("StrokeHistory: Test *? leaves viewed history unchanged") {
+  StenoCompactMapDictionary mainDictionary(TestDictionary::definition);
+  StenoDictionary *const DICTIONARIES[] = {
+      &StenoEmilySymbolsDictionary::instance,
+      &mainDictionary,
+  };
+  StenoDictionaryList dictionary(DICTIONARIES, 2);
+
+  StenoState state;
+  state.Reset();
+
+  StenoStrokeHistory strokeHistory;
+  // spellchecker: disable
+  strokeHistory.Add(StenoStroke("TEFT"), state, 1);
+  strokeHistory.Add(StenoStroke("-D"), state, 2);
+  strokeHistory.Add(StenoStroke("SKWHU"), state, 3);
+  // spellchecker: enable
+
+  StenoSegmentBuilder history;
+  history.TransferFrom(strokeHistory, strokeHistory.GetCount(), 3);
+  assert(history.GetStrokes(0) == strokeHistory.GetStrokes(0));
+
+  StenoSegmentList segments;
+  const StenoCompiledOrthography orthography(
+      StenoOrthography::emptyOrthography);
+
+  StenoEngine engine(dictionary, orthography);
+  BuildSegmentContext context(segments, engine, false);
+  history.CreateSegments(context);
+
+  assert(history.HasModifiedStrokeHistory());
+  assert(history.GetStrokes(0) != strokeHistory.GetStrokes(0));
+  assert(segments.GetCount() == 3);
+  assert(segments[0].state == history.GetStatePointer(0));
+  assert(Str::Eq(segments[0].lookup.GetText(), "test"));
+  assert(Str::Eq(segments[1].lookup.GetText(), ""));
+  assert(Str::Eq(segments[2].lookup.GetText(), "{:=\\{*?\\}}-D"));
+
+  // spellchecker: disable
+  assert(strokeHistory[1].stroke == StenoStroke("-D"));
+  assert(strokeHistory[2].stroke == StenoStroke("SKWHU"));
+  // spellchecker: enable
+}
+TEST_END
+
 TEST_BEGIN("StrokeHistory: Test * toggles lookup") {
   StenoDebugDictionary dictionary;
   dictionary.SetResponse("{*}");
@@ -4,16 +4,26 @@
 #include "segment.h"
 #include "state.h"
 #include "stroke.h"
+#include "stroke_history.h"
 #include <assert.h>
 
 //---------------------------------------------------------------------------
 
+// Stats are always recorded on test builds, where they are used to check the
+// engine cost model.
+#if RUN_TESTS
+#define RECORD_SEGMENT_BUILDER_STATS 1
+#else
+#define RECORD_SEGMENT_BUILDER_STATS 0
+#endif
+
+//---------------------------------------------------------------------------
+
 struct StenoSegment;
 class BufferWriter;
 class StenoCompiledOrthography;
 class StenoDictionary;
 class StenoEngine;
-class StenoStrokeHistory;
 
 //---------------------------------------------------------------------------
 
@@ -39,28 +49,32 @@ public:
   void Reset() {
     hasRawStroke = false;
     count = 0;
+    strokes = strokeBuffer;
+    states = stateBuffer;
   }
 
   void Add(StenoStroke stroke, StenoState state) {
-    strokes[count] = stroke;
-    states[count] = state;
+    strokeBuffer[count] = stroke;
+    stateBuffer[count] = state;
     ++count;
   }
 
   void Add(const StenoStroke *strokes, size_t length) {
     count = length;
 
-    strokes->CopyTo(this->strokes, length);
+    strokes->CopyTo(strokeBuffer, length);
 
     StenoState emptyState;
     emptyState.Reset();
 
     for (size_t i = 0; i < length; ++i) {
-      states[i] = emptyState;
+      stateBuffer[i] = emptyState;
     }
   }
 
-  void TransferStartFrom(const StenoSegmentBuilder &source, size_t count);
+  // Views the last maxCount strokes of the first sourceStrokeCount in source,
+  // which must not change until segments have been converted. The strokes are
+  // only copied if they wrap around the end of the history.
   void TransferFrom(const StenoStrokeHistory &source, size_t sourceStrokeCount,
                     size_t maxCount);
 
@@ -82,21 +96,42 @@ public:
   bool HasModifiedStrokeHistory() const { return hasModifiedStrokeHistory; }
   bool HasRawStroke() const { return hasRawStroke; }
 
-  static const size_t BUFFER_SIZE = 256;
+#if RECORD_SEGMENT_BUILDER_STATS
+  // Bytes of strokes and states copied from the stroke history into builders.
+  static void ResetStats() { copyByteCount = 0; }
+  static size_t GetCopyByteCount() { return copyByteCount; }
+#endif
+
+  // Conversions can cover the entire stroke history.
+  static const size_t BUFFER_SIZE = STENO_STROKE_HISTORY_SIZE;
 
 private:
+#if RECORD_SEGMENT_BUILDER_STATS
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
+  static size_t copyByteCount;
+#else
+  static thread_local size_t copyByteCount;
+#endif
+#endif
+
   bool hasModifiedStrokeHistory = false;
   bool hasRawStroke;
   size_t count = 0;
   const char *lastSegmentCommand;
-  StenoStroke strokes[BUFFER_SIZE];
-  StenoState states[BUFFER_SIZE];
+
+  // Either a view of the stroke history, or the buffers below.
+  const StenoStroke *strokes = strokeBuffer;
+  const StenoState *states = stateBuffer;
+
+  StenoStroke strokeBuffer[BUFFER_SIZE];
+  StenoState stateBuffer[BUFFER_SIZE];
 
   char *EscapeCommand(const char *p);
   void EscapeCommand(BufferWriter &writer, const char *p);
 
   void AddSegments(BuildSegmentContext &context, size_t &offset);
 
+  void ModifyStrokeHistory(BuildSegmentContext &context);
   void ResetStrokes(size_t offset, size_t length);
 
   void ReevaluateSegments(BuildSegmentContext &context, size_t &offset);
@@ -0,0 +1,227 @@
+//---------------------------------------------------------------------------
+
+#include "steno_compiled_command.h"
+#include "crc.h"
+#include "steno_key_code_buffer.h"
+
+//---------------------------------------------------------------------------
+
+StenoCompiledCommandCache StenoCompiledCommandCache::instance;
+
+//---------------------------------------------------------------------------
+
+// Parameters are split the same way as StenoKeyCodeBuffer::AddParameter.
+StenoCompiledCommand *StenoCompiledCommand::CreateFunction(const char *p,
+                                                           size_t length,
+                                                           uint32_t hash) {
+  // A trailing escape can take a parameter one byte past the end, and each
+  // parameter has a terminating null.
+  const size_t parameterSpace = 2 * length;
+  StenoCompiledCommand *command =
+      new (length + parameterSpace) StenoCompiledCommand;
+  command->hash = hash;
+  command->length = length;
+  memcpy(command->text, p, length);
+
+  const char *end = p + length;
+  char *parameter = command->text + length;
+  ++p;
+  while (p) {
+    const char *start = p;
+    const char *next = nullptr;
+    while (p < end) {
+      const char c = *p;
+      if (c == ':') {
+        next = p + 1;
+        break;
+      }
+      ++p;
+      if (c == '\\') {
+        ++p;
+      }
+    }
+
+    memcpy(parameter, start, p - start);
+    command->parameters.Add(parameter);
+    parameter += p - start;
+    *parameter++ = '\0';
+    p = next;
+  }
+
+  command->handler =
+      StenoKeyCodeBuffer::FindFunction(command->parameters[0]);
+  return command;
+}
+
+StenoCompiledCommand *StenoCompiledCommand::CreateKeyPresses(
+    const char *p, size_t length, uint32_t hash, bool isValid,
+    const StenoKeyCode *keyCodes, size_t keyCodeCount) {
+  const size_t keyCodeOffset =
+      (length + alignof(StenoKeyCode) - 1) & -alignof(StenoKeyCode);
+  StenoCompiledCommand *command = new (
+      keyCodeOffset + keyCodeCount * sizeof(StenoKeyCode)) StenoCompiledCommand;
+  command->hash = hash;
+  command->length = length;
+  memcpy(command->text, p, length);
+
+  StenoKeyCode *compiledKeyCodes =
+      (StenoKeyCode *)(command->text + keyCodeOffset);
+  memcpy(compiledKeyCodes, keyCodes, keyCodeCount * sizeof(StenoKeyCode));
+  command->isValidKeyPresses = isValid;
+  command->keyCodeCount = keyCodeCount;
+  command->keyCodes = compiledKeyCodes;
+  return command;
+}
+
+//---------------------------------------------------------------------------
+
+StenoCompiledCommandCache::~StenoCompiledCommandCache() {
+  for (StenoCompiledCommand *entry : entries) {
+    delete entry;
+  }
+}
+
+const StenoCompiledCommand *
+StenoCompiledCommandCache::GetFunction(const char *p, size_t length) {
+  const uint32_t hash = Crc32(p, length);
+  StenoCompiledCommand *&entry = GetEntry(hash);
+  if (entry && entry->IsCommand(hash, p, length)) {
+    return entry;
+  }
+  if (lockCount) {
+    return nullptr;
+  }
+
+  delete entry;
+  entry = StenoCompiledCommand::CreateFunction(p, length, hash);
+  return entry;
+}
+
+const StenoCompiledCommand *
+StenoCompiledCommandCache::FindKeyPresses(const char *p, size_t length) {
+  const uint32_t hash = Crc32(p, length);
+  const StenoCompiledCommand *entry = GetEntry(hash);
+  if (entry && entry->IsCommand(hash, p, length)) {
+    return entry;
+  }
+  return nullptr;
+}
+
+void StenoCompiledCommandCache::AddKeyPresses(const char *p, size_t length,
+                                              bool isValid,
+                                              const StenoKeyCode *keyCodes,
+                                              size_t keyCodeCount) {
+  if (lockCount) {
+    return;
+  }
+
+  const uint32_t hash = Crc32(p, length);
+  StenoCompiledCommand *&entry = GetEntry(hash);
+  delete entry;
+  entry = StenoCompiledCommand::CreateKeyPresses(p, length, hash, isValid,
+                                                 keyCodes, keyCodeCount);
+}
+
+//---------------------------------------------------------------------------
+
+#include "malloc_count.h"
+#include "str.h"
+#include "unit_test.h"
+
+TEST_BEGIN("StenoCompiledCommand: Splits parameters like AddParameter") {
+  static const char *const COMMANDS[] = {
+      ":retro_upper:2",
+      ":retro_replace_space:1:\\:",
+      ":retro_surround:1:\\{:\\}",
+      ":set_case",
+      ":console:x\\",
+      ":unknown_function:a::b",
+  };
+
+  for (const char *text : COMMANDS) {
+    // The text is followed by the closing brace, as in a dictionary entry.
+    char *command = Str::Join(text, "}");
+    const size_t length = strlen(text);
+    const char *end = command + length;
+
+    List<char *> expected;
+    const char *token = command + 1;
+    while (token) {
+      token = StenoKeyCodeBuffer::AddParameter(expected, token, end);
+    }
+
+    StenoCompiledCommand *compiled =
+        StenoCompiledCommand::CreateFunction(command, length, 0);
+    assert(compiled->parameters.GetCount() == expected.GetCount());
+    for (size_t i = 0; i < expected.GetCount(); ++i) {
+      assert(Str::Eq(compiled->parameters[i], expected[i]));
+    }
+    assert(compiled->handler ==
+           StenoKeyCodeBuffer::FindFunction(expected[0]));
+
+    for (char *parameter : expected) {
+      free(parameter);
+    }
+    delete compiled;
+    free(command);
+  }
+}
+TEST_END
+
+TEST_BEGIN("StenoCompiledCommand: Cached functions run without allocations") {
+  StenoCompiledCommandCache *cache = new StenoCompiledCommandCache;
+  const char *text = ":retro_upper:1}";
+  const size_t length = strlen(text) - 1;
+
+  const StenoCompiledCommand *command = cache->GetFunction(text, length);
+  assert(command != nullptr);
+  assert(command->handler == StenoKeyCodeBuffer::FindFunction("retro_upper"));
+
+  const size_t mallocStart = MallocCount::Get();
+  assert(cache->GetFunction(text, length) == command);
+  assert(MallocCount::Get() == mallocStart);
+
+  // Misses can't replace entries while locked.
+  cache->Lock();
+  assert(cache->GetFunction(":retro_lower:1}", length) == nullptr);
+  assert(cache->GetFunction(text, length) == command);
+  cache->Unlock();
+  assert(cache->GetFunction(":retro_lower:1}", length) != nullptr);
+
+  delete cache;
+}
+TEST_END
+
+TEST_BEGIN("StenoCompiledCommand: Key presses match uncached key presses") {
+  static const char *const COMMANDS[] = {
+      "#Shift_L(h a p) p y",
+      "#Control_L(BackSpace)",
+      "#a not_a_key b",
+      "#a) b",
+      "#Shift_L(a",
+  };
+
+  StenoKeyCodeBuffer *expected = new StenoKeyCodeBuffer;
+  StenoKeyCodeBuffer *compiled = new StenoKeyCodeBuffer;
+  for (const char *command : COMMANDS) {
+    const char *end = command + strlen(command);
+    expected->Reset();
+    const bool isValid = expected->ProcessKeyPresses(command + 1, end);
+
+    // The first conversion adds the key presses, the second reuses them.
+    for (size_t i = 0; i < 2; ++i) {
+      compiled->Reset();
+      const size_t mallocStart = MallocCount::Get();
+      assert(compiled->ProcessCompiledKeyPresses(command, end) == isValid);
+      assert(i == 0 || MallocCount::Get() == mallocStart);
+      assert(compiled->count == expected->count);
+      assert(memcmp(compiled->buffer, expected->buffer,
+                    expected->count * sizeof(StenoKeyCode)) == 0);
+    }
+  }
+  delete compiled;
+  delete expected;
+}
+TEST_END
+
+//---------------------------------------------------------------------------
@@ -0,0 +1,107 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include "list.h"
+#include "malloc_allocate.h"
+#include "steno_key_code.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------
+
+// Number of compiled commands kept. Each entry is a pointer, and compiled
+// commands are allocated when first used.
+#if !defined(JAVELIN_COMPILED_COMMAND_CACHE_SIZE)
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
+#define JAVELIN_COMPILED_COMMAND_CACHE_SIZE 32
+#else
+#define JAVELIN_COMPILED_COMMAND_CACHE_SIZE 64
+#endif
+#endif
+
+//---------------------------------------------------------------------------
+
+class StenoKeyCodeBuffer;
+
+// A dictionary command with its parsing already done, so that it can be
+// executed again without allocations.
+struct StenoCompiledCommand : public JavelinMallocAllocate {
+  typedef bool (StenoKeyCodeBuffer::*FunctionHandler)(
+      const List<char *> &parameters);
+
+  uint32_t hash;
+  size_t length;
+
+  // For {:function:parameters...}. nullptr for unknown functions.
+  FunctionHandler handler = nullptr;
+  List<char *> parameters;
+
+  // For {#key presses}, the key codes they add, and whether they were valid.
+  // Invalid key presses still add the key codes before the error.
+  bool isValidKeyPresses = false;
+  size_t keyCodeCount = 0;
+  const StenoKeyCode *keyCodes = nullptr;
+
+  // The command text without braces, followed by the compiled data.
+  char text[];
+
+  bool IsCommand(uint32_t hash, const char *p, size_t length) const {
+    return this->hash == hash && this->length == length &&
+           memcmp(text, p, length) == 0;
+  }
+
+  // p starts at the ':'.
+  static StenoCompiledCommand *CreateFunction(const char *p, size_t length,
+                                              uint32_t hash);
+
+  // p starts at the '#'.
+  static StenoCompiledCommand *
+  CreateKeyPresses(const char *p, size_t length, uint32_t hash, bool isValid,
+                   const StenoKeyCode *keyCodes, size_t keyCodeCount);
+
+  using JavelinMallocAllocate::operator new;
+  using JavelinMallocAllocate::operator delete;
+
+  static void *operator new(size_t n, size_t extra) noexcept {
+    return operator new(n + extra);
+  }
+  static void operator delete(void *p, size_t extra) noexcept {
+    operator delete(p);
+  }
+};
+
+//---------------------------------------------------------------------------
+
+// Compiled commands, keyed by their text. Keying by text rather than address
+// keeps results correct for dynamic definitions and edited user dictionaries.
+class StenoCompiledCommandCache {
+public:
+  ~StenoCompiledCommandCache();
+
+  // p is the text between "{" and "}", starting with ':'.
+  // Returns nullptr if the command can't be cached.
+  const StenoCompiledCommand *GetFunction(const char *p, size_t length);
+
+  // p is the text between "{" and "}", starting with '#'.
+  // Returns nullptr if the key presses haven't been added.
+  const StenoCompiledCommand *FindKeyPresses(const char *p, size_t length);
+  void AddKeyPresses(const char *p, size_t length, bool isValid,
+                     const StenoKeyCode *keyCodes, size_t keyCodeCount);
+
+  // Entries are not replaced while locked, since a command being executed can
+  // run further conversions, such as through console commands.
+  void Lock() { ++lockCount; }
+  void Unlock() { --lockCount; }
+
+  static StenoCompiledCommandCache instance;
+
+private:
+  static const size_t SIZE = JAVELIN_COMPILED_COMMAND_CACHE_SIZE;
+
+  size_t lockCount = 0;
+  StenoCompiledCommand *entries[SIZE] = {};
+
+  StenoCompiledCommand *&GetEntry(uint32_t hash) { return entries[hash % SIZE]; }
+};
+
+//---------------------------------------------------------------------------
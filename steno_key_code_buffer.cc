@@ -18,9 +18,47 @@ void StenoKeyCodeBuffer::Reset() {
   addTranslationCount = 0;
   resetStateCount = 0;
   lastTextOffset = 0;
+  watermark = 0;
+  wordStartsBegin = 0;
+  wordStartsEnd = 0;
   state.Reset();
 }
 
+void StenoKeyCodeBuffer::operator=(const StenoKeyCodeBuffer &o) {
+  if (this == &o) {
+    return;
+  }
+
+  orthography = o.orthography;
+  rootDictionary = o.rootDictionary;
+  context = o.context;
+  wasLastActionAStitch = o.wasLastActionAStitch;
+  count = o.count;
+  consoleCount = o.consoleCount;
+  addTranslationCount = o.addTranslationCount;
+  resetStateCount = o.resetStateCount;
+  lastTextOffset = o.lastTextOffset;
+  watermark = o.watermark;
+  state = o.state;
+
+  free(addTranslationText);
+  addTranslationText =
+      o.addTranslationText ? Str::Dup(o.addTranslationText) : nullptr;
+
+  memcpy(buffer, o.buffer, count * sizeof(StenoKeyCode));
+
+  // The word start index is rebuilt as needed.
+  wordStartsBegin = count;
+  wordStartsEnd = count;
+}
+
+void StenoKeyCodeBuffer::Set(const StenoKeyCode *keyCodes,
+                             size_t keyCodeCount) {
+  Reset();
+  memcpy(buffer, keyCodes, keyCodeCount * sizeof(StenoKeyCode));
+  count = keyCodeCount;
+}
+
 void StenoKeyCodeBuffer::Populate(StenoTokenizer *tokenizer) {
   Reset();
   Append(tokenizer);
@@ -69,12 +107,62 @@ void StenoKeyCodeBuffer::AppendText(const char *p, size_t n,
   AppendTextNoCaseModeOverride(p, n, caseMode);
 }
 
+// Returns the end of the leading run of ASCII characters that aren't escapes
+// or backspaces, checking a word at a time.
+static const char *FindPlainTextEnd(const char *p, const char *end) {
+  const auto isPlain = [](uint8_t c) {
+    return c < 0x80 && c != '\\' && c != '\b';
+  };
+  while (p < end && ((uintptr_t)p & (sizeof(size_t) - 1)) != 0) {
+    if (!isPlain(*p)) {
+      return p;
+    }
+    ++p;
+  }
+
+  const size_t ONES = size_t(-1) / 0xff;
+  const size_t HIGH_BITS = ONES * 0x80;
+  while (size_t(end - p) >= sizeof(size_t)) {
+    size_t word;
+    memcpy(&word, p, sizeof(word));
+    const size_t backslashes = word ^ (ONES * '\\');
+    const size_t backspaces = word ^ (ONES * '\b');
+    const size_t special = word | ((backslashes - ONES) & ~backslashes) |
+                           ((backspaces - ONES) & ~backspaces);
+    if (special & HIGH_BITS) {
+      break;
+    }
+    p += sizeof(size_t);
+  }
+
+  while (p < end && isPlain(*p)) {
+    ++p;
+  }
+  return p;
+}
+
 void StenoKeyCodeBuffer::AppendTextNoCaseModeOverride(const char *p, size_t n,
                                                       StenoCaseMode caseMode) {
   const char *end = p + n;
-  Utf8Pointer utf8p(p);
 
-  while (utf8p < end) {
+  while (p < end) {
+    // Plain text needs no decoding, and every character after the first has
+    // the same case mode.
+    const char *plainEnd = FindPlainTextEnd(p, end);
+    if (p < plainEnd) {
+      buffer[count++] =
+          StenoKeyCode(uint8_t(*p++), caseMode, StenoCaseMode::NORMAL);
+      caseMode = GetNextLetterCaseMode(caseMode);
+      while (p < plainEnd) {
+        buffer[count++] =
+            StenoKeyCode(uint8_t(*p++), caseMode, StenoCaseMode::NORMAL);
+      }
+      if (p == end) {
+        break;
+      }
+    }
+
+    Utf8Pointer utf8p(p);
     uint32_t c = *utf8p++;
 
     if (c == '\\' && utf8p < end) {
@@ -113,6 +201,7 @@ void StenoKeyCodeBuffer::AppendTextNoCaseModeOverride(const char *p, size_t n,
     }
 
     caseMode = GetNextLetterCaseMode(caseMode);
+    p = utf8p.GetRawPointer();
   }
 
   wasLastActionAStitch = false;
@@ -307,23 +396,36 @@ void StenoKeyCodeBuffer::ProcessCommand(const char *p, size_t length) {
       return;
     }
 
-    List<char *> parameters;
-    const char *token = p + 2;
-    while (token) {
-      token = AddParameter(parameters, token, end);
-    }
+    StenoCompiledCommandCache &cache = StenoCompiledCommandCache::instance;
+    const StenoCompiledCommand *command = cache.GetFunction(p + 1, end - p - 1);
+    if (command) {
+      if (command->handler) {
+        cache.Lock();
+        const bool handled = (this->*command->handler)(command->parameters);
+        cache.Unlock();
+        if (handled) {
+          return;
+        }
+      }
+    } else {
+      List<char *> parameters;
+      const char *token = p + 2;
+      while (token) {
+        token = AddParameter(parameters, token, end);
+      }
 
-    const bool handled = ProcessFunction(parameters);
-    for (char *parameter : parameters) {
-      free(parameter);
-    }
-    if (handled) {
-      return;
+      const bool handled = ProcessFunction(parameters);
+      for (char *parameter : parameters) {
+        free(parameter);
+      }
+      if (handled) {
+        return;
+      }
     }
   }
 
   if (p[1] == '#') {
-    if (ProcessKeyPresses(p + 2, end)) {
+    if (ProcessCompiledKeyPresses(p + 1, end)) {
       return;
     }
   }
@@ -357,7 +459,13 @@ const char *StenoKeyCodeBuffer::AddParameter(List<char *> &parameters,
 void StenoKeyCodeBuffer::ProcessOrthographicSuffix(const char *text,
                                                    size_t length) {
   char orthographicScratchPad[32];
-  char *suffix = Str::DupN(text, length);
+  char suffixScratchPad[32];
+  char *suffix = length < sizeof(suffixScratchPad) ? suffixScratchPad
+                                                   : Str::DupN(text, length);
+  if (suffix == suffixScratchPad) {
+    memcpy(suffix, text, length);
+    suffix[length] = '\0';
+  }
 
   size_t start = count;
   size_t byteCount = 1; // Need one byte for terminating null.
@@ -380,6 +488,7 @@ void StenoKeyCodeBuffer::ProcessOrthographicSuffix(const char *text,
   char *word = orthography->AddSuffix(orthographicScratchPad, suffix);
 
   count = start;
+  LowerWatermark(start);
 
   char *pWord = word;
   char *pScratchPad = orthographicScratchPad;
@@ -403,7 +512,9 @@ void StenoKeyCodeBuffer::ProcessOrthographicSuffix(const char *text,
   state.caseMode = state.GetNextWordCaseMode();
 
   free(word);
-  free(suffix);
+  if (suffix != suffixScratchPad) {
+    free(suffix);
+  }
 }
 
 //---------------------------------------------------------------------------
@@ -473,6 +584,25 @@ void StenoKeyCodeBuffer::Reverse(StenoKeyCode *start, StenoKeyCode *end) {
 
 //---------------------------------------------------------------------------
 
+// Key presses only depend on their text, so the key codes from the first
+// conversion are reused.
+bool StenoKeyCodeBuffer::ProcessCompiledKeyPresses(const char *p,
+                                                   const char *end) {
+  StenoCompiledCommandCache &cache = StenoCompiledCommandCache::instance;
+  const StenoCompiledCommand *command = cache.FindKeyPresses(p, end - p);
+  if (command) {
+    memcpy(buffer + count, command->keyCodes,
+           command->keyCodeCount * sizeof(StenoKeyCode));
+    count += command->keyCodeCount;
+    return command->isValidKeyPresses;
+  }
+
+  const size_t start = count;
+  const bool isValid = ProcessKeyPresses(p + 1, end);
+  cache.AddKeyPresses(p, end - p, isValid, buffer + start, count - start);
+  return isValid;
+}
+
 bool StenoKeyCodeBuffer::ProcessKeyPresses(const char *p, const char *end) {
   StenoKeyPressTokenizer tokenizer(p, end);
   List<KeyCode> keyPressStack;
@@ -559,4 +689,69 @@ TEST_BEGIN("StenoKeyCodeBuffer tests") {
 }
 TEST_END
 
+TEST_BEGIN("StenoKeyCodeBuffer: Appends plain text, escapes and unicode") {
+  struct TestCase {
+    const char *text;
+    StenoCaseMode caseMode;
+    const char *expected;
+  };
+  static const TestCase TEST_CASES[] = {
+      {"the quick brown fox jumps over", StenoCaseMode::TITLE_ONCE,
+       "The quick brown fox jumps over"},
+      {"the quick brown fox jumps over", StenoCaseMode::UPPER,
+       "THE QUICK BROWN FOX JUMPS OVER"},
+      {"\u00e9t\u00e9 and caf\u00e9 au lait", StenoCaseMode::TITLE,
+       "\u00c9t\u00e9 and caf\u00e9 au lait"},
+      {"first line\\nsecond\\q line", StenoCaseMode::UPPER,
+       "FIRST LINE\nSECOND\\Q LINE"},
+      {"\\{braces\\} and tab\\t", StenoCaseMode::NORMAL,
+       "{braces} and tab\t"},
+      {"mistakee\\b", StenoCaseMode::NORMAL, "mistake"},
+      {"\\", StenoCaseMode::NORMAL, "\\"},
+  };
+
+  StenoKeyCodeBuffer *buffer = new StenoKeyCodeBuffer();
+  for (const TestCase &testCase : TEST_CASES) {
+    // Start at each alignment to cover the word at a time scan.
+    for (size_t offset = 0; offset < 8; ++offset) {
+      char text[64] = {};
+      memcpy(text + offset, testCase.text, strlen(testCase.text));
+
+      buffer->Reset();
+      buffer->AppendTextNoCaseModeOverride(
+          text + offset, strlen(testCase.text), testCase.caseMode);
+      char *result = buffer->ToString();
+      assert(Str::Eq(result, testCase.expected));
+      free(result);
+    }
+  }
+  delete buffer;
+}
+TEST_END
+
+TEST_BEGIN("StenoKeyCodeBuffer: Assignment copies the key codes in use") {
+  StenoKeyCodeBuffer *source = new StenoKeyCodeBuffer();
+  StenoKeyCodeBuffer *copy = new StenoKeyCodeBuffer();
+  source->Reset();
+  source->AppendTextNoCaseModeOverride("one two three", 13,
+                                       StenoCaseMode::NORMAL);
+  source->RetroactiveTitleCase(1);
+
+  copy->Reset();
+  copy->AppendTextNoCaseModeOverride("xxxxxxxxxxxxxxxx", 16,
+                                     StenoCaseMode::NORMAL);
+  *copy = *source;
+  assert(copy->count == 13);
+  assert(copy->buffer[13] == StenoKeyCode('x', StenoCaseMode::NORMAL));
+
+  copy->RetroactiveTitleCase(2);
+  char *text = copy->ToString();
+  assert(Str::Eq(text, "one Two Three"));
+  free(text);
+
+  delete copy;
+  delete source;
+}
+TEST_END
+
 //---------------------------------------------------------------------------
@@ -3,15 +3,27 @@
 #pragma once
 #include <stddef.h>
 
+#include "bit_field.h"
 #include "dictionary/dictionary.h"
+#include "engine_context.h"
 #include "list.h"
 #include "orthography.h"
 #include "segment.h"
 #include "state.h"
+#include "steno_compiled_command.h"
 #include "steno_key_code.h"
 
 //---------------------------------------------------------------------------
 
+// Key codes held by each of the engine's two conversion buffers. This limits
+// the text that a single conversion can produce. Each key code takes 4 bytes,
+// plus a bit for the word start index, so the default uses 16.5kB of RAM.
+#if !defined(JAVELIN_KEY_CODE_BUFFER_SIZE)
+#define JAVELIN_KEY_CODE_BUFFER_SIZE 2048
+#endif
+
+//---------------------------------------------------------------------------
+
 class StenoCompiledOrthography;
 
 //---------------------------------------------------------------------------
@@ -24,18 +36,23 @@ class StenoCompiledOrthography;
 class StenoKeyCodeBuffer {
 public:
   void Prepare(const StenoCompiledOrthography *newOrthography,
-               StenoDictionary *newRootDictionary) {
+               StenoDictionary *newRootDictionary,
+               StenoEngineContext *newContext) {
     orthography = newOrthography;
     rootDictionary = newRootDictionary;
+    context = newContext;
   }
 
   void Populate(StenoTokenizer *tokenizer);
   void Append(StenoTokenizer *tokenizer);
 
-  static const size_t BUFFER_SIZE = 2048;
+  static const size_t BUFFER_SIZE = JAVELIN_KEY_CODE_BUFFER_SIZE;
+  static_assert(BUFFER_SIZE >= 512,
+                "JAVELIN_KEY_CODE_BUFFER_SIZE must be at least 512");
 
   const StenoCompiledOrthography *orthography;
   StenoDictionary *rootDictionary;
+  StenoEngineContext *context = &StenoEngineContext::defaultContext;
 
   bool wasLastActionAStitch;
   size_t count = 0;
@@ -43,12 +60,41 @@ public:
   size_t addTranslationCount = 0;
   size_t resetStateCount = 0;
   size_t lastTextOffset = 0;
+
+  // Key codes before the watermark haven't been modified since it was set,
+  // so buffers populated from the same segments are known to match up to it.
+  size_t watermark = 0;
+
   StenoState state;
   char *addTranslationText = nullptr;
   StenoKeyCode buffer[BUFFER_SIZE];
 
   void Reset();
 
+  // Resets the buffer to hold only keyCodes.
+  void Set(const StenoKeyCode *keyCodes, size_t keyCodeCount);
+
+  void SetWatermark() { watermark = count; }
+
+  // Called whenever key codes from offset onwards are modified, other than by
+  // appending.
+  void LowerWatermark(size_t offset) {
+    LowerWatermarkForCaseChange(offset);
+    if (offset < wordStartsEnd) {
+      wordStartsEnd = offset;
+      if (offset < wordStartsBegin) {
+        wordStartsBegin = offset;
+      }
+    }
+  }
+
+  // Changing case keeps word starts.
+  void LowerWatermarkForCaseChange(size_t offset) {
+    if (offset < watermark) {
+      watermark = offset;
+    }
+  }
+
   void ProcessText(const char *text, size_t length);
   void ProcessCommand(const char *command, size_t length);
   void ProcessOrthographicSuffix(const char *text, size_t length);
@@ -66,6 +112,9 @@ public:
   static bool IsGlue(const char *p);
 
   bool ProcessKeyPresses(const char *p, const char *end);
+
+  // p starts at the '#' of a {#...} command.
+  bool ProcessCompiledKeyPresses(const char *p, const char *end);
   void ReleaseKeyStack(List<KeyCode> &keyPressStack);
 
   static const char *AddParameter(List<char *> &parameters, const char *p,
@@ -87,6 +136,9 @@ public:
 
   bool ProcessFunction(const List<char *> &parameters);
 
+  // Returns nullptr if there is no function called name.
+  static StenoCompiledCommand::FunctionHandler FindFunction(const char *name);
+
   // parameters[0] == function name.
   bool AddTranslationFunction(const List<char *> &parameters);
   bool ConsoleFunction(const List<char *> &parameters);
@@ -109,9 +161,41 @@ public:
   bool ToggleDictionaryFunction(const List<char *> &parameters);
   bool UnicodeFunction(const List<char *> &parameters);
 
+  // Copies only the key codes in use.
   void operator=(const StenoKeyCodeBuffer &o);
 
 private:
+  // Offsets of key codes that start a word: non-whitespace following
+  // whitespace or the start of the buffer.
+  //
+  // Only [wordStartsBegin, wordStartsEnd) is indexed. Retro functions work
+  // back from the end of freshly converted text, so the range starts empty at
+  // the end and is extended backwards as far as they look, and forwards over
+  // text appended since.
+  size_t wordStartsBegin = 0;
+  size_t wordStartsEnd = 0;
+  BitField<BUFFER_SIZE> wordStarts;
+
+  // Extends the indexed range to count.
+  void UpdateWordStarts();
+
+  // Returns the start of the last word before offset, or -1 if there is none.
+  // offset must be within the indexed range.
+  size_t FindPreviousWordStart(size_t offset);
+
+  // Returns the start of the wordCount-th word from the end, or of the first
+  // word if there are fewer. Returns count if there are no words.
+  size_t GetWordStart(int wordCount);
+
+  // Returns the offset after the last key code of the word at start.
+  size_t GetWordEnd(size_t start) const;
+
+  // Sets caseMode on the first letter of each of the last wordCount words.
+  void RetroactiveSetFirstLetterCase(int wordCount, StenoCaseMode caseMode);
+
+  // Sets caseMode on every key code of the last wordCount words.
+  void RetroactiveSetWordCase(int wordCount, StenoCaseMode caseMode);
+
   static void Reverse(StenoKeyCode *start, StenoKeyCode *end);
 
   bool RetroWordCountHandler(void (StenoKeyCodeBuffer::*handler)(int),
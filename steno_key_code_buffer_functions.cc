@@ -12,7 +12,7 @@
 
 struct KeyCodeFunctionEntry {
   const char *name;
-  bool (StenoKeyCodeBuffer::*handler)(const List<char *> &parameters);
+  StenoCompiledCommand::FunctionHandler handler;
 };
 
 constexpr KeyCodeFunctionEntry HANDLERS[] = {
@@ -37,6 +37,98 @@ constexpr KeyCodeFunctionEntry HANDLERS[] = {
     {"toggle_dictionary", &StenoKeyCodeBuffer::ToggleDictionaryFunction},
 };
 
+// Maps every HANDLERS name to a distinct slot, so a lookup is one hash and one
+// string compare.
+//
+// As with gperf, names are keyed by their length and a few sampled
+// characters rather than hashing every character, and the compiler searches
+// for a seed without collisions. Adding a name that has the same key as an
+// existing one fails the build, and needs another sampled position.
+class KeyCodeFunctionTable {
+public:
+  constexpr KeyCodeFunctionTable() {
+    for (size_t i = 0; i < HANDLER_COUNT; ++i) {
+      for (size_t j = 0; j < i; ++j) {
+        if (GetKey(HANDLERS[i].name) == GetKey(HANDLERS[j].name)) {
+          hasDistinctKeys = false;
+          return;
+        }
+      }
+    }
+
+    for (seed = 0; seed < 0x10000; ++seed) {
+      if (TryBuild()) {
+        hasSeed = true;
+        return;
+      }
+    }
+  }
+
+  // Checked at compile time, as the firmware is built without exceptions.
+  constexpr bool HasDistinctKeys() const { return hasDistinctKeys; }
+  constexpr bool HasSeed() const { return hasSeed; }
+
+  const KeyCodeFunctionEntry *Find(const char *name) const {
+    const size_t length = strlen(name);
+    if (length < MIN_LENGTH) {
+      return nullptr;
+    }
+    const uint8_t index = slots[GetSlot(GetKey(name, length))];
+    if (index == EMPTY) {
+      return nullptr;
+    }
+    const KeyCodeFunctionEntry &entry = HANDLERS[index];
+    return Str::Eq(name, entry.name) ? &entry : nullptr;
+  }
+
+private:
+  static const size_t HANDLER_COUNT = sizeof(HANDLERS) / sizeof(*HANDLERS);
+  static const size_t SIZE_BITS = 6;
+  static const size_t SIZE = 1 << SIZE_BITS;
+  static const size_t MIN_LENGTH = 3;
+  static const uint8_t EMPTY = 0xff;
+
+  static_assert(HANDLER_COUNT < SIZE);
+
+  bool hasDistinctKeys = true;
+  bool hasSeed = false;
+  uint32_t seed = 0;
+  uint8_t slots[SIZE] = {};
+
+  static constexpr uint32_t GetKey(const char *name) {
+    return GetKey(name, __builtin_strlen(name));
+  }
+
+  // length must be at least MIN_LENGTH.
+  static constexpr uint32_t GetKey(const char *name, size_t length) {
+    return length | uint8_t(name[0]) << 8 | uint8_t(name[length / 2]) << 16 |
+           uint32_t(uint8_t(name[length - 3])) << 24;
+  }
+
+  constexpr size_t GetSlot(uint32_t key) const {
+    return ((key ^ seed) * 0x9e3779b1) >> (32 - SIZE_BITS);
+  }
+
+  constexpr bool TryBuild() {
+    for (uint8_t &slot : slots) {
+      slot = EMPTY;
+    }
+    for (size_t i = 0; i < HANDLER_COUNT; ++i) {
+      uint8_t &slot = slots[GetSlot(GetKey(HANDLERS[i].name))];
+      if (slot != EMPTY) {
+        return false;
+      }
+      slot = i;
+    }
+    return true;
+  }
+};
+
+static constexpr KeyCodeFunctionTable FUNCTION_TABLE;
+static_assert(FUNCTION_TABLE.HasDistinctKeys(),
+              "HANDLERS names need another sampled position");
+static_assert(FUNCTION_TABLE.HasSeed(), "No perfect hash seed for HANDLERS");
+
 //---------------------------------------------------------------------------
 
 static bool ReadIntegerParameter(int &result, const char *p,
@@ -62,6 +154,7 @@ void StenoKeyCodeBuffer::Backspace(int backspaceCount) {
       break;
     }
   }
+  LowerWatermark(size_t(d - buffer));
 
   StenoKeyCode *s = d;
   while (s < pEnd) {
@@ -75,165 +168,165 @@ void StenoKeyCodeBuffer::Backspace(int backspaceCount) {
   count = size_t(d - buffer);
 }
 
-void StenoKeyCodeBuffer::RetroactiveCapitalize(int wordCount) {
-  if (count == 0) {
+void StenoKeyCodeBuffer::UpdateWordStarts() {
+  if (wordStartsBegin >= wordStartsEnd || wordStartsEnd > count) {
+    wordStartsBegin = count;
+    wordStartsEnd = count;
     return;
   }
 
-  StenoKeyCode *p = buffer + count - 1;
-  StenoKeyCode *lastCharacterPointer = p;
-
-  while (wordCount > 0) {
-    for (;;) {
-      if (p < buffer) {
-        goto epilog;
-      }
-      if (!p->IsWhitespace()) {
-        break;
-      }
-      --p;
+  bool isPreviousWhitespace = buffer[wordStartsEnd - 1].IsWhitespace();
+  for (size_t i = wordStartsEnd; i < count; ++i) {
+    const bool isWhitespace = buffer[i].IsWhitespace();
+    if (isPreviousWhitespace && !isWhitespace) {
+      wordStarts.Set(i);
+    } else {
+      wordStarts.Clear(i);
     }
+    isPreviousWhitespace = isWhitespace;
+  }
+  wordStartsEnd = count;
 
-    for (;;) {
-      if (p < buffer) {
-        goto epilog;
-      }
-      if (p->IsWhitespace()) {
-        break;
-      }
-      if (p->IsLetter()) {
-        lastCharacterPointer = p;
-      }
-      --p;
-    }
+  for (size_t i = wordStartsBegin; i < wordStartsEnd; ++i) {
+    assert(wordStarts.IsSet(i) ==
+           (!buffer[i].IsWhitespace() &&
+            (i == 0 || buffer[i - 1].IsWhitespace())));
+  }
+}
 
-    --wordCount;
+size_t StenoKeyCodeBuffer::FindPreviousWordStart(size_t offset) {
+  assert(wordStartsBegin <= offset && offset <= wordStartsEnd);
+
+  const size_t start = wordStarts.FindPrevious(offset);
+  if (start != size_t(-1) && start >= wordStartsBegin) {
+    return start;
   }
 
-epilog:
-  lastCharacterPointer->SetCase(StenoCaseMode::TITLE_ONCE);
+  // Bits before wordStartsBegin are stale, so index backwards until the next
+  // word start is found.
+  size_t i = wordStartsBegin;
+  if (i == 0) {
+    return -1;
+  }
+  bool isWhitespace = buffer[i - 1].IsWhitespace();
+  while (i > 0) {
+    --i;
+    const bool isPreviousWhitespace = i == 0 || buffer[i - 1].IsWhitespace();
+    if (isPreviousWhitespace && !isWhitespace) {
+      wordStarts.Set(i);
+      wordStartsBegin = i;
+      return i;
+    }
+    wordStarts.Clear(i);
+    isWhitespace = isPreviousWhitespace;
+  }
+  wordStartsBegin = 0;
+  return -1;
 }
 
-void StenoKeyCodeBuffer::RetroactiveUncapitalize(int wordCount) {
-  StenoKeyCode *p = buffer + count - 1;
+size_t StenoKeyCodeBuffer::GetWordStart(int wordCount) {
+  UpdateWordStarts();
+
+  size_t start = count;
   while (wordCount > 0) {
-    for (;;) {
-      if (p < buffer) {
-        return;
-      }
-      if (!p->IsWhitespace()) {
-        break;
-      }
-      --p;
+    const size_t previous = FindPreviousWordStart(start);
+    if (previous == size_t(-1)) {
+      break;
     }
+    start = previous;
+    --wordCount;
+  }
+  return start;
+}
 
-    StenoKeyCode *lastCharacterPointer = p;
-    for (;;) {
-      if (p < buffer) {
-        break;
-      }
-      if (p->IsWhitespace()) {
-        break;
-      }
-      if (p->IsLetter()) {
-        lastCharacterPointer = p;
-      }
-      --p;
-    }
-    lastCharacterPointer->SetCase(StenoCaseMode::LOWER_ONCE);
+size_t StenoKeyCodeBuffer::GetWordEnd(size_t start) const {
+  while (start < count && !buffer[start].IsWhitespace()) {
+    ++start;
+  }
+  return start;
+}
 
-    --wordCount;
+void StenoKeyCodeBuffer::RetroactiveCapitalize(int wordCount) {
+  if (count == 0) {
+    return;
+  }
+
+  // The first letter of the words, or the last key code if there are none.
+  size_t offset = GetWordStart(wordCount);
+  while (offset < count && !buffer[offset].IsLetter()) {
+    ++offset;
   }
+  if (offset == count) {
+    offset = count - 1;
+  }
+
+  LowerWatermarkForCaseChange(offset);
+  buffer[offset].SetCase(StenoCaseMode::TITLE_ONCE);
 }
 
-void StenoKeyCodeBuffer::RetroactiveTitleCase(int wordCount) {
-  StenoKeyCode *p = buffer + count - 1;
+void StenoKeyCodeBuffer::RetroactiveSetFirstLetterCase(int wordCount,
+                                                       StenoCaseMode caseMode) {
+  UpdateWordStarts();
+
+  size_t end = count;
   while (wordCount > 0) {
-    for (;;) {
-      if (p < buffer) {
-        return;
-      }
-      if (!p->IsWhitespace()) {
-        break;
-      }
-      --p;
+    const size_t start = FindPreviousWordStart(end);
+    if (start == size_t(-1)) {
+      return;
     }
 
-    StenoKeyCode *lastCharacterPointer = p;
-    for (;;) {
-      if (p < buffer) {
-        break;
-      }
-      if (p->IsWhitespace()) {
+    // The first letter of the word, or its last key code if there are none.
+    size_t offset = start;
+    while (!buffer[offset].IsLetter()) {
+      if (offset + 1 == count || buffer[offset + 1].IsWhitespace()) {
         break;
       }
-      if (p->IsLetter()) {
-        lastCharacterPointer = p;
-      }
-      --p;
+      ++offset;
     }
-    lastCharacterPointer->SetCase(StenoCaseMode::TITLE);
+    LowerWatermarkForCaseChange(offset);
+    buffer[offset].SetCase(caseMode);
 
+    end = start;
     --wordCount;
   }
 }
 
-void StenoKeyCodeBuffer::RetroactiveUpperCase(int wordCount) {
-  StenoKeyCode *p = buffer + count - 1;
+void StenoKeyCodeBuffer::RetroactiveSetWordCase(int wordCount,
+                                                StenoCaseMode caseMode) {
+  UpdateWordStarts();
+
+  size_t end = count;
   while (wordCount > 0) {
-    for (;;) {
-      if (p < buffer) {
-        return;
-      }
-      if (!p->IsWhitespace()) {
-        break;
-      }
-      --p;
+    const size_t start = FindPreviousWordStart(end);
+    if (start == size_t(-1)) {
+      return;
     }
 
-    for (;;) {
-      if (p < buffer) {
-        return;
-      }
-
-      if (p->IsWhitespace()) {
-        break;
-      }
-      p->SetCase(StenoCaseMode::UPPER);
-      --p;
+    LowerWatermarkForCaseChange(start);
+    const size_t wordEnd = GetWordEnd(start);
+    for (size_t i = start; i < wordEnd; ++i) {
+      buffer[i].SetCase(caseMode);
     }
 
+    end = start;
     --wordCount;
   }
 }
 
-void StenoKeyCodeBuffer::RetroactiveLowerCase(int wordCount) {
-  StenoKeyCode *p = buffer + count - 1;
-  while (wordCount > 0) {
-    for (;;) {
-      if (p < buffer) {
-        return;
-      }
-      if (!p->IsWhitespace()) {
-        break;
-      }
-      --p;
-    }
+void StenoKeyCodeBuffer::RetroactiveUncapitalize(int wordCount) {
+  RetroactiveSetFirstLetterCase(wordCount, StenoCaseMode::LOWER_ONCE);
+}
 
-    for (;;) {
-      if (p < buffer) {
-        return;
-      }
+void StenoKeyCodeBuffer::RetroactiveTitleCase(int wordCount) {
+  RetroactiveSetFirstLetterCase(wordCount, StenoCaseMode::TITLE);
+}
 
-      if (p->IsWhitespace()) {
-        break;
-      }
-      p->SetCase(StenoCaseMode::LOWER);
-      --p;
-    }
+void StenoKeyCodeBuffer::RetroactiveUpperCase(int wordCount) {
+  RetroactiveSetWordCase(wordCount, StenoCaseMode::UPPER);
+}
 
-    --wordCount;
-  }
+void StenoKeyCodeBuffer::RetroactiveLowerCase(int wordCount) {
+  RetroactiveSetWordCase(wordCount, StenoCaseMode::LOWER);
 }
 
 void StenoKeyCodeBuffer::RetroactiveReplaceSpace(int wordCount,
@@ -251,6 +344,7 @@ void StenoKeyCodeBuffer::RetroactiveReplaceSpace(int wordCount,
       }
     }
 
+    LowerWatermark(size_t(p - buffer));
     StenoKeyCode *endText = buffer + count;
     AppendText(replacement, replacementLength, StenoCaseMode::NORMAL);
     StenoKeyCode *endReplacement = buffer + count;
@@ -272,41 +366,14 @@ void StenoKeyCodeBuffer::RetroactiveQuotes(int wordCount,
     return;
   }
 
-  StenoKeyCode *endQuoteBufferPointer = buffer + count;
+  const size_t start = GetWordStart(wordCount);
   AppendText(endQuote, Str::Length(endQuote), StenoCaseMode::NORMAL);
   StenoKeyCode *startQuoteBufferPointer = buffer + count;
   AppendText(startQuote, Str::Length(startQuote), StenoCaseMode::NORMAL);
 
-  StenoKeyCode *p = endQuoteBufferPointer - 1;
-  while (wordCount) {
-    for (;;) {
-      if (p <= buffer) {
-        break;
-      }
-      if (!p->IsWhitespace()) {
-        break;
-      }
-      --p;
-    }
-
-    for (;;) {
-      if (p <= buffer) {
-        break;
-      }
-
-      if (p->IsWhitespace()) {
-        break;
-      }
-      --p;
-    }
-
-    --wordCount;
-  }
-  if (p->IsWhitespace()) {
-    ++p;
-  }
-
   // Rotate in place.
+  StenoKeyCode *p = buffer + start;
+  LowerWatermark(start);
   Reverse(p, startQuoteBufferPointer);
   Reverse(startQuoteBufferPointer, buffer + count);
   Reverse(p, buffer + count);
@@ -327,6 +394,7 @@ void StenoKeyCodeBuffer::RetroactiveDeleteSpace() {
   while (p >= buffer) {
     if (p->IsWhitespace()) {
       count--;
+      LowerWatermark(size_t(p - buffer));
       memmove(p, p + 1, sizeof(StenoKeyCode) * (end - p - 1));
       return;
     }
@@ -367,6 +435,7 @@ void StenoKeyCodeBuffer::RetroactiveFormatCurrency(const char *pStart,
     }
   }
   ++p;
+  LowerWatermark(size_t(p - buffer));
 
   if (integralDigits == 0) {
     numberBuffer[numberBufferLength++] = '0';
@@ -410,23 +479,15 @@ void StenoKeyCodeBuffer::RetroactiveFormatCurrency(const char *pStart,
 //---------------------------------------------------------------------------
 
 bool StenoKeyCodeBuffer::ProcessFunction(const List<char *> &parameters) {
-  size_t left = 0;
-  size_t right = sizeof(HANDLERS) / sizeof(*HANDLERS);
-
-  while (left < right) {
-    const size_t mid = (left + right) >> 1;
-
-    const KeyCodeFunctionEntry &entry = HANDLERS[mid];
-    const int compare = strcmp(parameters[0], entry.name);
-    if (compare < 0) {
-      right = mid;
-    } else if (compare > 0) {
-      left = mid + 1;
-    } else {
-      return (this->*entry.handler)(parameters);
-    }
-  }
-  return false;
+  const StenoCompiledCommand::FunctionHandler handler =
+      FindFunction(parameters[0]);
+  return handler && (this->*handler)(parameters);
+}
+
+StenoCompiledCommand::FunctionHandler
+StenoKeyCodeBuffer::FindFunction(const char *name) {
+  const KeyCodeFunctionEntry *entry = FUNCTION_TABLE.Find(name);
+  return entry ? entry->handler : nullptr;
 }
 
 //---------------------------------------------------------------------------
@@ -716,6 +777,7 @@ bool StenoKeyCodeBuffer::StitchLastWordFunction(
       *output-- = *p--;
     }
   }
+  LowerWatermark(size_t(p + 1 - buffer));
 
   return true;
 }
@@ -732,7 +794,7 @@ bool StenoKeyCodeBuffer::HostLayoutFunction(const List<char *> &parameters) {
     return false;
   }
 
-  return HostLayouts::SetActiveLayout(parameters[1]);
+  return context->SetHostLayout(parameters[1]);
 }
 
 bool StenoKeyCodeBuffer::ConsoleFunction(const List<char *> &parameters) {
@@ -754,6 +816,17 @@ bool StenoKeyCodeBuffer::ConsoleFunction(const List<char *> &parameters) {
 
 #include "unit_test.h"
 
+TEST_BEGIN("StenoKeyCodeBuffer: FindFunction finds every handler") {
+  for (const KeyCodeFunctionEntry &entry : HANDLERS) {
+    assert(StenoKeyCodeBuffer::FindFunction(entry.name) == entry.handler);
+  }
+  assert(StenoKeyCodeBuffer::FindFunction("") == nullptr);
+  assert(StenoKeyCodeBuffer::FindFunction("retro") == nullptr);
+  assert(StenoKeyCodeBuffer::FindFunction("retro_upperx") == nullptr);
+  assert(StenoKeyCodeBuffer::FindFunction("unknown_function") == nullptr);
+}
+TEST_END
+
 TEST_BEGIN("StenoKeyCodeBuffer: Backspace() should give expected results") {
   StenoKeyCodeBuffer buffer;
   buffer.Reset();
@@ -774,6 +847,46 @@ TEST_BEGIN("StenoKeyCodeBuffer: Backspace() should give expected results") {
 }
 TEST_END
 
+TEST_BEGIN("StenoKeyCodeBuffer: Retro functions lower the watermark") {
+  StenoKeyCodeBuffer buffer;
+  buffer.Reset();
+  buffer.AppendText("ab cd ef", 8, StenoCaseMode::NORMAL);
+  buffer.SetWatermark();
+  assert(buffer.watermark == 8);
+
+  buffer.AppendText(" gh", 3, StenoCaseMode::NORMAL);
+  assert(buffer.watermark == 8);
+
+  buffer.RetroactiveUpperCase(2);
+  assert(buffer.watermark == 6);
+
+  buffer.RetroactiveCapitalize(3);
+  assert(buffer.watermark == 3);
+
+  buffer.Backspace(10);
+  assert(buffer.count == 1);
+  assert(buffer.watermark == 1);
+}
+TEST_END
+
+TEST_BEGIN("StenoKeyCodeBuffer: Word starts follow Backspace and Reverse") {
+  StenoKeyCodeBuffer buffer;
+  buffer.Reset();
+  buffer.AppendText("ab cd ef", 8, StenoCaseMode::NORMAL);
+  buffer.RetroactiveUpperCase(1);
+  buffer.Backspace(4);
+  buffer.AppendText("x yz", 4, StenoCaseMode::NORMAL);
+  buffer.RetroactiveTitleCase(2);
+  buffer.RetroactiveReplaceSpace(1, "-");
+  buffer.RetroactiveDoubleQuotes(2);
+  buffer.RetroactiveCapitalize(2);
+
+  char *text = buffer.ToString();
+  assert(Str::Eq(text, "\"Ab Cx-Yz\""));
+  free(text);
+}
+TEST_END
+
 TEST_BEGIN("StenoKeyCodeBuffer: RetroReplaceSpace") {
   StenoKeyCodeBuffer buffer;
   buffer.Reset();
@@ -42,9 +42,6 @@ const uint16_t StenoKeyCodeEmitter::EmitterContext::KP_ALT_HEX_KEY_CODES[] = {
 
 //---------------------------------------------------------------------------
 
-StenoKeyCodeEmitter::EmitterContext::EmitterContext()
-    : hostLayout(HostLayouts::GetActiveLayout()) {}
-
 bool StenoKeyCodeEmitter::EmitterContext::GetIsNumLockOn() {
   if (!hasDeterminedNumLockState) {
     hasDeterminedNumLockState = true;
@@ -58,7 +55,17 @@ bool StenoKeyCodeEmitter::EmitterContext::GetIsNumLockOn() {
 bool StenoKeyCodeEmitter::Process(const StenoKeyCode *previous,
                                   size_t previousLength,
                                   const StenoKeyCode *value,
-                                  size_t valueLength) const {
+                                  size_t valueLength,
+                                  size_t commonLength) const {
+  assert(commonLength <= previousLength && commonLength <= valueLength);
+  for (size_t i = 0; i < commonLength; ++i) {
+    assert(previous[i].HasSameOutput(value[i]));
+  }
+  previous += commonLength;
+  previousLength -= commonLength;
+  value += commonLength;
+  valueLength -= commonLength;
+
   // Skip common prefixes.
   while (previousLength > 0 && valueLength > 0 &&
          previous->HasSameOutput(*value)) {
@@ -72,7 +79,7 @@ bool StenoKeyCodeEmitter::Process(const StenoKeyCode *previous,
     return true;
   }
 
-  EmitterContext context;
+  EmitterContext context(engineContext.GetHostLayout());
 
   // Now the length of previous represents how much needs to be backspaced.
   for (size_t i = 0; i < previousLength; ++i) {
@@ -3,6 +3,7 @@
 #pragma once
 #include <stddef.h>
 
+#include "engine_context.h"
 #include "steno_key_code.h"
 #include "steno_key_code_buffer.h"
 
@@ -10,15 +11,36 @@
 
 class StenoKeyCodeEmitter {
 public:
+  StenoKeyCodeEmitter(const StenoEngineContext &engineContext =
+                          StenoEngineContext::defaultContext)
+      : engineContext(engineContext) {}
+
   struct EmitterContext;
 
+  // The first commonLength key codes are known to have the same output, and
+  // the comparison starts after them.
   bool Process(const StenoKeyCode *previous, size_t previousLength,
-               const StenoKeyCode *value, size_t valueLength) const;
+               const StenoKeyCode *value, size_t valueLength,
+               size_t commonLength = 0) const;
 
   bool Process(const StenoKeyCodeBuffer &previous,
                const StenoKeyCodeBuffer &next) const {
     return Process(previous.buffer, previous.count, next.buffer, next.count);
   }
+
+  // For buffers converted together from the same segments, where each
+  // watermark covers key codes from the segments common to both.
+  bool ProcessFromWatermark(const StenoKeyCodeBuffer &previous,
+                            const StenoKeyCodeBuffer &next) const {
+    const size_t commonLength = previous.watermark < next.watermark
+                                    ? previous.watermark
+                                    : next.watermark;
+    return Process(previous.buffer, previous.count, next.buffer, next.count,
+                   commonLength);
+  }
+
+private:
+  const StenoEngineContext &engineContext;
 };
 
 //---------------------------------------------------------------------------
@@ -13,7 +13,7 @@ struct HostLayout;
 //---------------------------------------------------------------------------
 
 struct StenoKeyCodeEmitter::EmitterContext {
-  EmitterContext();
+  EmitterContext(const HostLayout &hostLayout) : hostLayout(hostLayout) {}
 
   uint32_t modifiers = 0;
   bool shouldCombineUndo = true;
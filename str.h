@@ -52,6 +52,17 @@ public:
     return false;
   }
 
+  // FNV-1a. Usable at compile time, so that lookup tables keyed by fixed
+  // names can be built by the compiler.
+  static constexpr uint32_t Hash(const char *p, size_t length,
+                                 uint32_t seed = 0x811c9dc5) {
+    uint32_t hash = seed;
+    for (size_t i = 0; i < length; ++i) {
+      hash = (hash ^ uint8_t(p[i])) * 0x01000193;
+    }
+    return hash;
+  }
+
   static bool HasPrefix(const char *p, const char *prefix);
   static bool HasSuffix(const char *p, const char *suffix);
 
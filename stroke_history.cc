@@ -44,27 +44,47 @@ void StenoStrokeHistory::UpdateDefinitionBoundaries(
   }
   const StenoState *firstState = segments[0].state;
   for (const StenoSegment &segment : segments) {
-    StenoState &state =
-        (*this)[startingOffset + segment.GetStrokeIndex(firstState)].state;
-    state.lookupType = segment.lookupType;
-
-    const char *lookupText = segment.lookup.GetText();
-    if (lookupText[0] == '{') {
-      state.requestsHistoryExtending =
-          lookupText[1] == ':' &&
-          (Str::HasPrefix(lookupText, "{:==set_value") ||
-           Str::HasPrefix(lookupText, "{:==retro_transform"));
-      state.isSpace = Str::IsSpace(lookupText);
-      state.isHistoryExtending =
-          Str::IsFingerSpellingCommand(lookupText) ||
-          segment.lookup == StenoDictionaryLookupResult::NO_OP;
-      state.isSuffix = Str::HasPrefix(lookupText, "{^");
-    } else {
-      state.requestsHistoryExtending = false;
-      state.isSpace = false;
-      state.isHistoryExtending = false;
-      state.isSuffix = false;
-    }
+    SetDefinitionBoundary(
+        (*this)[startingOffset + segment.GetStrokeIndex(firstState)].state,
+        segment);
+  }
+}
+
+void StenoStrokeHistory::UpdateDefinitionBoundaries(
+    StenoState *states, size_t count, const StenoSegmentList &segments) {
+  if (segments.IsEmpty()) {
+    return;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    states[i].lookupType = SegmentLookupType::UNKNOWN;
+  }
+  const StenoState *firstState = segments[0].state;
+  for (const StenoSegment &segment : segments) {
+    SetDefinitionBoundary(states[segment.GetStrokeIndex(firstState)], segment);
+  }
+}
+
+void StenoStrokeHistory::SetDefinitionBoundary(StenoState &state,
+                                               const StenoSegment &segment) {
+  state.lookupType = segment.lookupType;
+
+  const char *lookupText = segment.lookup.GetText();
+  if (lookupText[0] == '{') {
+    state.requestsHistoryExtending =
+        lookupText[1] == ':' &&
+        (Str::HasPrefix(lookupText, "{:==set_value") ||
+         Str::HasPrefix(lookupText, "{:==retro_transform"));
+    state.isSpace = Str::IsSpace(lookupText);
+    state.isHistoryExtending =
+        Str::IsFingerSpellingCommand(lookupText) ||
+        segment.lookup == StenoDictionaryLookupResult::NO_OP;
+    state.isSuffix = Str::HasPrefix(lookupText, "{^");
+  } else {
+    state.requestsHistoryExtending = false;
+    state.isSpace = false;
+    state.isHistoryExtending = false;
+    state.isSuffix = false;
   }
 }
 
@@ -1,35 +1,90 @@
 //---------------------------------------------------------------------------
 
 #pragma once
-#include "cyclic_queue.h"
 #include "state.h"
 #include "stroke.h"
 #include <assert.h>
 
 //---------------------------------------------------------------------------
 
+// Strokes kept for conversion and undo. The engine keeps two histories, one
+// for normal mode and one for add translation and console modes, and each of
+// its two segment builders holds the same number of strokes. Each stroke
+// therefore takes 2 * 12 bytes of history + 2 * 8 bytes of builder overlay,
+// or 40 bytes on 32-bit devices, and the default uses 10kB of RAM.
+//
+// Must be a power of 2, and large enough to hold the longest outline plus
+// the strokes that normal mode conversion looks back over.
+#if !defined(JAVELIN_STROKE_HISTORY_SIZE)
+#define JAVELIN_STROKE_HISTORY_SIZE 256
+#endif
+
+//---------------------------------------------------------------------------
+
 class StenoSegmentList;
+struct StenoSegment;
 
 //---------------------------------------------------------------------------
 
-struct StenoStrokeHistoryEntry {
-  StenoStroke stroke;
-  StenoState state;
-  size_t conversionCount;
+const size_t STENO_STROKE_HISTORY_SIZE = JAVELIN_STROKE_HISTORY_SIZE;
+static_assert(STENO_STROKE_HISTORY_SIZE >= 32,
+              "JAVELIN_STROKE_HISTORY_SIZE must be at least 32");
+static_assert((STENO_STROKE_HISTORY_SIZE & (STENO_STROKE_HISTORY_SIZE - 1)) ==
+                  0,
+              "JAVELIN_STROKE_HISTORY_SIZE must be a power of 2");
 
-  void Set(StenoStroke stroke, StenoState state, size_t conversionCount) {
-    this->stroke = stroke;
-    this->state = state;
-    this->conversionCount = conversionCount;
+// Strokes, states and conversion counts are held in separate arrays so that
+// segment builders can view runs of strokes and states without copying them.
+class StenoStrokeHistory {
+public:
+  // References to the fields of a single entry.
+  struct Entry {
+    StenoStroke &stroke;
+    StenoState &state;
+    size_t &conversionCount;
+  };
+
+  struct ConstEntry {
+    const StenoStroke &stroke;
+    const StenoState &state;
+    const size_t &conversionCount;
+  };
+
+  void Reset() {
+    start = 0;
+    end = 0;
   }
-};
 
-//---------------------------------------------------------------------------
+  bool IsEmpty() const { return start == end; }
+  bool IsNotEmpty() const { return start != end; }
+  bool IsFull() const { return end - start == SIZE; }
+  bool IsNotFull() const { return end - start != SIZE; }
+  size_t GetCount() const { return end - start; }
+
+  void RemoveFront() { ++start; }
+  void RemoveBack(size_t count) {
+    assert(GetCount() >= count);
+    end -= count;
+  }
+
+  Entry operator[](size_t n) { return GetEntry(start + n); }
+  ConstEntry operator[](size_t n) const { return GetEntry(start + n); }
+  Entry Back(size_t fromEnd = 1) { return GetEntry(end - fromEnd); }
+  ConstEntry Back(size_t fromEnd = 1) const { return GetEntry(end - fromEnd); }
+  ConstEntry Front() const { return GetEntry(start); }
+
+  // Entries [index, index + count) are stored contiguously unless they wrap
+  // around the end of the arrays.
+  bool IsContiguous(size_t index, size_t count) const {
+    return ((start + index) & (SIZE - 1)) + count <= SIZE;
+  }
+  const StenoStroke *GetStrokes(size_t index) const {
+    return &strokes[(start + index) & (SIZE - 1)];
+  }
+  const StenoState *GetStates(size_t index) const {
+    return &states[(start + index) & (SIZE - 1)];
+  }
 
-const size_t STENO_STROKE_HISTORY_SIZE = 256;
-class StenoStrokeHistory
-    : public CyclicQueue<StenoStrokeHistoryEntry, STENO_STROKE_HISTORY_SIZE> {
-public:
   void PruneIfFull() {
     if (IsFull()) {
       Prune();
@@ -38,7 +93,10 @@ public:
 
   void Add(StenoStroke stroke, StenoState state, size_t conversionCount) {
     assert(IsNotFull());
-    CyclicQueue::Add().Set(stroke, state, conversionCount);
+    const size_t index = end++ & (SIZE - 1);
+    strokes[index] = stroke;
+    states[index] = state;
+    conversionCounts[index] = conversionCount;
   }
 
   // When undo is pressed, returns how many items should be removed
@@ -47,6 +105,18 @@ public:
 
   void UpdateDefinitionBoundaries(size_t startingOffset,
                                   const StenoSegmentList &segments);
+
+  // As above, for a copy of the count states that segments were built from.
+  static void UpdateDefinitionBoundaries(StenoState *states, size_t count,
+                                         const StenoSegmentList &segments);
+
+  // Replaces the states of the last count entries.
+  void SetBackStates(const StenoState *states, size_t count) {
+    assert(count <= GetCount());
+    for (size_t i = 0; i < count; ++i) {
+      Back(count - i).state = states[i];
+    }
+  }
   size_t GetStartingStroke(size_t maximumCount) const;
 
   // Returns the offset of the word start. result <= index.
@@ -59,7 +129,27 @@ public:
   }
 
 private:
+  static const size_t SIZE = STENO_STROKE_HISTORY_SIZE;
+
+  size_t start = 0;
+  size_t end = 0;
+  StenoStroke strokes[SIZE];
+  StenoState states[SIZE];
+  size_t conversionCounts[SIZE];
+
+  Entry GetEntry(size_t n) {
+    n &= SIZE - 1;
+    return {strokes[n], states[n], conversionCounts[n]};
+  }
+  ConstEntry GetEntry(size_t n) const {
+    n &= SIZE - 1;
+    return {strokes[n], states[n], conversionCounts[n]};
+  }
+
   void Prune();
+
+  static void SetDefinitionBoundary(StenoState &state,
+                                    const StenoSegment &segment);
 };
 
 //---------------------------------------------------------------------------
@@ -0,0 +1,844 @@
+//---------------------------------------------------------------------------
+//
+// Host command line tool that benchmarks stroke processing.
+//
+// Usage:
+//   benchmark [-d dictionary.json]... [-o orthography.json] [-w words.json]
+//             [-n rounds] log-file...
+//
+// The stroke logs are replayed through StenoEngine, using the same format and
+// reset boundaries as the transcribe tool. Dictionaries given with -d are
+// loaded into a user dictionary, which is combined with the built in Jeff
+// phrasing, Jeff numbers, Emily symbols and show stroke dictionaries and the
+// compact map test dictionary. The word list is a JSON object of words to
+// frequency ranks.
+//
+// The replay reports strokes/s, per stroke latency percentiles, mallocs per
+// stroke and dictionary lookups per stroke. Startup is measured from
+// creating the orthography to processing the first stroke, with the rule
+// patterns compiled and with them loaded from an orthography snapshot.
+// Microbenchmarks then measure the individual operations that dominate stroke
+// processing, using the words produced by the replay as input, and report the
+// DFA states and memory of the orthography rule patterns. Word list lookups
+// are also measured on a generated 100k word list.
+//
+//---------------------------------------------------------------------------
+
+#include "tool_support.h"
+#include "../dictionary/compact_map_dictionary.h"
+#include "../dictionary/dictionary_list.h"
+#include "../dictionary/emily_symbols_dictionary.h"
+#include "../dictionary/jeff_numbers_dictionary.h"
+#include "../dictionary/jeff_phrasing_dictionary.h"
+#include "../dictionary/jeff_show_stroke_dictionary.h"
+#include "../dictionary/test_dictionary.h"
+#include "../dictionary/user_dictionary.h"
+#include "../dictionary/wrapped_dictionary.h"
+#include "../engine.h"
+#include "../host_layout.h"
+#include "../key.h"
+#include "../keyboard_report_builder.h"
+#include "../malloc_count.h"
+#include "../pattern.h"
+#include "../steno_key_code_buffer.h"
+#include "../steno_key_code_emitter.h"
+#include "../str.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+//---------------------------------------------------------------------------
+
+// Counts the calls the engine makes to the top level dictionary.
+class CountingDictionary final : public StenoWrappedDictionary {
+public:
+  CountingDictionary(StenoDictionary *dictionary)
+      : StenoWrappedDictionary(dictionary) {}
+
+  StenoDictionaryLookupResult
+  Lookup(const StenoDictionaryLookup &lookup) const final {
+    ++lookupCount;
+    return StenoWrappedDictionary::Lookup(lookup);
+  }
+
+  const StenoDictionary *
+  GetDictionaryForOutline(const StenoDictionaryLookup &lookup) const final {
+    ++dictionaryForOutlineCount;
+    return StenoWrappedDictionary::GetDictionaryForOutline(lookup);
+  }
+
+  void ReverseLookup(StenoReverseDictionaryLookup &lookup) const final {
+    ++reverseLookupCount;
+    StenoWrappedDictionary::ReverseLookup(lookup);
+  }
+
+  const char *GetName() const final { return "counting"; }
+
+  mutable size_t lookupCount = 0;
+  mutable size_t dictionaryForOutlineCount = 0;
+  mutable size_t reverseLookupCount = 0;
+};
+
+//---------------------------------------------------------------------------
+
+struct ReplayResult {
+  size_t strokeCount;
+  double seconds;
+  size_t mallocCount;
+
+  // Per stroke latencies in nanoseconds.
+  List<uint32_t> latencies;
+
+  void Reset() {
+    strokeCount = 0;
+    seconds = 0;
+    mallocCount = 0;
+    latencies.Reset();
+  }
+
+  // Requires latencies to be sorted.
+  uint32_t GetPercentile(double percentile) const {
+    if (latencies.IsEmpty()) {
+      return 0;
+    }
+    const size_t index =
+        size_t((latencies.GetCount() - 1) * percentile / 100 + 0.5);
+    return latencies[index];
+  }
+};
+
+static void Replay(ReplayResult &result, StenoDictionary &dictionary,
+                   const StenoCompiledOrthography &orthography,
+                   StenoEngineContext &engineContext,
+                   const StrokeLogParser &parser, IWriter *writer) {
+  for (const Section &section : parser.sections) {
+    StenoEngine *engine =
+        new StenoEngine(dictionary, orthography, nullptr, engineContext);
+    engine->SetTextWriter(writer);
+
+    for (size_t i = 0; i < section.length; ++i) {
+      const StenoStroke stroke = section.strokes[i];
+      const size_t mallocStart = MallocCount::Get();
+      const double startTime = GetSeconds();
+      if (stroke == UNDO_STROKE) {
+        engine->ProcessUndo();
+      } else {
+        engine->ProcessStroke(stroke);
+      }
+      const double elapsed = GetSeconds() - startTime;
+      result.mallocCount += MallocCount::Get() - mallocStart;
+      result.seconds += elapsed;
+      result.latencies.Add(uint32_t(elapsed * 1e9));
+    }
+    result.strokeCount += section.length;
+
+    delete engine;
+    if (writer) {
+      writer->WriteByte('\n');
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+
+// Runs a pass of operationCount operations repeatedly for at least
+// MINIMUM_SECONDS, and prints the time and mallocs per operation. reset is
+// called before every pass and is not timed.
+class Microbenchmark {
+public:
+  template <typename RESET, typename PASS>
+  static void Run(const char *name, size_t operationCount, RESET reset,
+                  PASS pass);
+
+  template <typename PASS>
+  static void Run(const char *name, size_t operationCount, PASS pass) {
+    Run(name, operationCount, [] {}, pass);
+  }
+
+private:
+  static constexpr double MINIMUM_SECONDS = 0.25;
+};
+
+template <typename RESET, typename PASS>
+void Microbenchmark::Run(const char *name, size_t operationCount, RESET reset,
+                         PASS pass) {
+  if (operationCount == 0) {
+    fprintf(stderr, "  %-32s skipped, no input\n", name);
+    return;
+  }
+
+  size_t passCount = 0;
+  size_t mallocCount = 0;
+  double seconds = 0;
+  while (seconds < MINIMUM_SECONDS) {
+    reset();
+    const size_t mallocStart = MallocCount::Get();
+    const double startTime = GetSeconds();
+    pass();
+    seconds += GetSeconds() - startTime;
+    mallocCount += MallocCount::Get() - mallocStart;
+    ++passCount;
+  }
+
+  const double totalOperations = double(passCount) * operationCount;
+  fprintf(stderr, "  %-32s %10.1f ns/op %8.2f mallocs/op\n", name,
+          seconds * 1e9 / totalOperations, mallocCount / totalOperations);
+}
+
+//---------------------------------------------------------------------------
+
+// Splits transcribed text into unique words.
+static void CollectWords(List<char *> &words, const List<char> &text) {
+  static const size_t MAXIMUM_WORD_COUNT = 4096;
+
+  const char *p = begin(text);
+  const char *const textEnd = end(text);
+  while (p < textEnd && words.GetCount() < MAXIMUM_WORD_COUNT) {
+    while (p < textEnd && (*p == ' ' || *p == '\n')) {
+      ++p;
+    }
+    const char *wordStart = p;
+    while (p < textEnd && *p != ' ' && *p != '\n') {
+      ++p;
+    }
+    if (p == wordStart) {
+      continue;
+    }
+
+    char *word = Str::DupN(wordStart, p - wordStart);
+    bool isDuplicate = false;
+    for (const char *existing : words) {
+      if (Str::Eq(existing, word)) {
+        isDuplicate = true;
+        break;
+      }
+    }
+    if (isDuplicate) {
+      free(word);
+    } else {
+      words.Add(word);
+    }
+  }
+}
+
+// Reports the fastest of several startups, since each is only run once.
+static void MeasureStartup(StenoDictionary &dictionary,
+                           const StenoOrthography &orthographyData,
+                           StenoEngineContext &engineContext,
+                           const StrokeLogParser &parser) {
+  static const size_t STARTUP_ROUND_COUNT = 10;
+
+  List<uint8_t> snapshotBuffer;
+  StenoOrthographySnapshot::Create(snapshotBuffer, orthographyData);
+  const StenoOrthographySnapshot *orthographySnapshot =
+      (const StenoOrthographySnapshot *)begin(snapshotBuffer);
+
+  fprintf(stderr, "Startup to first stroke (%zu rules, %zu byte snapshot):\n",
+          orthographyData.rules.GetCount(), snapshotBuffer.GetCount());
+  if (parser.strokes.IsEmpty()) {
+    return;
+  }
+
+  const auto measure = [&](const char *name,
+                           const StenoOrthographySnapshot *snapshot) {
+    double bestSeconds = 0;
+    for (size_t i = 0; i < STARTUP_ROUND_COUNT; ++i) {
+      const double startTime = GetSeconds();
+      const StenoCompiledOrthography *orthography =
+          new StenoCompiledOrthography(orthographyData, snapshot,
+                                       engineContext);
+      StenoEngine *engine =
+          new StenoEngine(dictionary, *orthography, nullptr, engineContext);
+      engine->ProcessStroke(parser.strokes[0]);
+      const double seconds = GetSeconds() - startTime;
+      if (i == 0 || seconds < bestSeconds) {
+        bestSeconds = seconds;
+      }
+      delete engine;
+      delete orthography;
+    }
+    fprintf(stderr, "  %-32s %10.1f us\n", name, bestSeconds * 1e6);
+  };
+  measure("Compiled rules", nullptr);
+  measure("Snapshot rules", orthographySnapshot);
+}
+
+//---------------------------------------------------------------------------
+
+// Builds a list of distinct pseudo random words, in the same format as
+// LoadWordList. queries has the words in random order, followed by the same
+// number of words that are not in the list.
+static WordList CreateLargeWordList(size_t wordCount, List<char *> &queries) {
+  uint32_t seed = 0x2545f491;
+  const auto random = [&seed]() -> uint32_t {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+  };
+
+  List<char *> words;
+  for (size_t i = 0; i < wordCount; ++i) {
+    char word[16];
+    const size_t length = 3 + random() % 10;
+    for (size_t j = 0; j < length; ++j) {
+      word[j] = 'a' + random() % 26;
+    }
+    word[length] = '\0';
+    words.Add(Str::Dup(word));
+  }
+  for (char *word : words) {
+    queries.Add(word);
+  }
+  for (const char *word : words) {
+    queries.Add(Str::Join(word, "-"));
+  }
+
+  words.Sort([](char *const *a, char *const *b) -> int {
+    return strcmp(*a, *b);
+  });
+  size_t dataLength = 1;
+  for (const char *word : words) {
+    dataLength += Str::Length(word) + 1;
+  }
+  uint8_t *data = (uint8_t *)malloc(dataLength);
+  uint8_t *p = data;
+  *p++ = 0xf0;
+  const char *lastWord = "";
+  for (const char *word : words) {
+    if (Str::Eq(word, lastWord)) {
+      continue;
+    }
+    const size_t length = Str::Length(word);
+    memcpy(p, word, length);
+    p += length;
+    *p++ = 0xf0 | (random() % (WordList::MAX_SCORE + 1));
+    lastWord = word;
+  }
+  return WordList(data, p - data);
+}
+
+//---------------------------------------------------------------------------
+
+static const char *const SUFFIXES[] = {"s", "ed", "ing", "er", "ly"};
+static const size_t SUFFIX_COUNT = sizeof(SUFFIXES) / sizeof(*SUFFIXES);
+
+static void RunMicrobenchmarks(StenoDictionary &dictionary,
+                               const StenoOrthography &orthographyData,
+                               const StenoCompiledOrthography &orthography,
+                               const StenoEngineContext &engineContext,
+                               const StrokeLogParser &parser,
+                               const List<char *> &words) {
+  fprintf(stderr, "Microbenchmarks (%zu words):\n", words.GetCount());
+
+  const StenoCompactMapDictionary compactDictionary(TestDictionary::definition);
+  const size_t outlineCount = parser.strokes.GetCount();
+  Microbenchmark::Run("CompactMapDictionary::Lookup", outlineCount, [&] {
+    for (const StenoStroke &stroke : parser.strokes) {
+      compactDictionary.Lookup(&stroke, 1).Destroy();
+    }
+  });
+
+  // A fresh copy of the orthography starts with an empty cache. Warm
+  // lookups use few enough words that the results stay cached.
+  static const size_t WARM_WORD_COUNT = 32;
+  const auto addSuffixPass = [&](const StenoCompiledOrthography &o,
+                                 size_t wordCount) {
+    for (const char *word : words) {
+      if (wordCount-- == 0) {
+        return;
+      }
+      for (const char *suffix : SUFFIXES) {
+        free(o.AddSuffix(word, suffix));
+      }
+    }
+  };
+  StenoCompiledOrthography *coldOrthography = nullptr;
+  Microbenchmark::Run(
+      "Orthography::AddSuffix (cold)", words.GetCount() * SUFFIX_COUNT,
+      [&] {
+        delete coldOrthography;
+        coldOrthography =
+            new StenoCompiledOrthography(orthography, engineContext);
+      },
+      [&] { addSuffixPass(*coldOrthography, words.GetCount()); });
+  delete coldOrthography;
+
+  const size_t warmWordCount =
+      words.GetCount() < WARM_WORD_COUNT ? words.GetCount() : WARM_WORD_COUNT;
+  Microbenchmark::Run("Orthography::AddSuffix (warm)",
+                      warmWordCount * SUFFIX_COUNT,
+                      [&] { addSuffixPass(orthography, warmWordCount); });
+
+  const WordList &wordList = engineContext.GetWordList();
+  Microbenchmark::Run("WordList::GetWordRank", words.GetCount(), [&] {
+    for (const char *word : words) {
+      wordList.GetRank(word);
+    }
+  });
+
+  static const size_t LARGE_WORD_LIST_COUNT = 100000;
+  List<char *> largeWordListQueries;
+  const WordList largeWordList =
+      CreateLargeWordList(LARGE_WORD_LIST_COUNT, largeWordListQueries);
+  fprintf(stderr, "  Large word list: %zu words, %zu byte index\n",
+          LARGE_WORD_LIST_COUNT, largeWordList.GetIndexMemoryUsage());
+  Microbenchmark::Run(
+      "WordList::GetRank (100k words)", largeWordListQueries.GetCount(), [&] {
+        for (const char *word : largeWordListQueries) {
+          largeWordList.GetRank(word);
+        }
+      });
+
+  // Orthography candidates for one word share a prefix, so look up similar
+  // groups individually and as a batch.
+  static const char *const CANDIDATE_SUFFIXES[] = {"", "s", "es", "ed"};
+  static const size_t CANDIDATE_COUNT =
+      sizeof(CANDIDATE_SUFFIXES) / sizeof(*CANDIDATE_SUFFIXES);
+  List<char *> candidates;
+  for (size_t i = 0; i < LARGE_WORD_LIST_COUNT; ++i) {
+    const char *word = largeWordListQueries[i];
+    for (const char *suffix : CANDIDATE_SUFFIXES) {
+      candidates.Add(Str::Join(word, suffix));
+    }
+  }
+  Microbenchmark::Run(
+      "WordList::GetRank (4 candidates)", LARGE_WORD_LIST_COUNT, [&] {
+        for (const char *candidate : candidates) {
+          largeWordList.GetRank(candidate);
+        }
+      });
+  Microbenchmark::Run(
+      "WordList::GetRanks (4 candidates)", LARGE_WORD_LIST_COUNT, [&] {
+        for (size_t i = 0; i < candidates.GetCount(); i += CANDIDATE_COUNT) {
+          int ranks[CANDIDATE_COUNT] = {};
+          largeWordList.GetRanks(&candidates[i], ranks, CANDIDATE_COUNT);
+        }
+      });
+  for (char *candidate : candidates) {
+    free(candidate);
+  }
+  for (char *word : largeWordListQueries) {
+    free(word);
+  }
+
+  List<Pattern> patterns;
+  size_t dfaCount = 0;
+  size_t dfaStateCount = 0;
+  size_t dfaMaximumStateCount = 0;
+  size_t dfaMemoryUsage = 0;
+  for (const StenoOrthographyRule &rule : orthographyData.rules) {
+    const Pattern pattern = Pattern::Compile(rule.testPattern);
+    const size_t stateCount = pattern.GetDfaStateCount();
+    if (stateCount != 0) {
+      ++dfaCount;
+      dfaStateCount += stateCount;
+      if (stateCount > dfaMaximumStateCount) {
+        dfaMaximumStateCount = stateCount;
+      }
+      dfaMemoryUsage += pattern.GetDfaMemoryUsage();
+    }
+    patterns.Add(pattern);
+  }
+  fprintf(stderr,
+          "  Pattern DFAs: %zu/%zu rules, %.1f states/rule (max %zu), "
+          "%zu bytes\n",
+          dfaCount, patterns.GetCount(),
+          dfaCount ? double(dfaStateCount) / dfaCount : 0.0,
+          dfaMaximumStateCount, dfaMemoryUsage);
+  List<char *> suffixedWords;
+  for (const char *word : words) {
+    for (const char *suffix : SUFFIXES) {
+      suffixedWords.Add(Str::Join(word, " ^", suffix));
+    }
+  }
+  Microbenchmark::Run(
+      "Pattern::Match", patterns.GetCount() * suffixedWords.GetCount(), [&] {
+        for (const char *text : suffixedWords) {
+          for (const Pattern &pattern : patterns) {
+            pattern.Match(text);
+          }
+        }
+      });
+  for (char *text : suffixedWords) {
+    free(text);
+  }
+
+  // Long definitions, and the words that orthographic suffixes rewrite.
+  static const char LONG_DEFINITION[] =
+      "The quick brown fox jumps over the lazy dog, and then it runs back "
+      "across the field to do it all again before the sun goes down.";
+  StenoKeyCodeBuffer *keyCodeBuffer = new StenoKeyCodeBuffer;
+  keyCodeBuffer->Reset();
+  Microbenchmark::Run("KeyCodeBuffer::AppendText (long)", 1, [&] {
+    keyCodeBuffer->count = 0;
+    keyCodeBuffer->AppendTextNoCaseModeOverride(
+        LONG_DEFINITION, Str::Length<>(LONG_DEFINITION),
+        StenoCaseMode::TITLE_ONCE);
+  });
+  List<char *> suffixOutputs;
+  for (const char *word : words) {
+    for (const char *suffix : SUFFIXES) {
+      suffixOutputs.Add(orthography.AddSuffix(word, suffix));
+    }
+  }
+  Microbenchmark::Run(
+      "KeyCodeBuffer::AppendText (suffix)", suffixOutputs.GetCount(), [&] {
+        for (const char *text : suffixOutputs) {
+          keyCodeBuffer->count = 0;
+          keyCodeBuffer->AppendTextNoCaseModeOverride(text, strlen(text),
+                                                      StenoCaseMode::NORMAL);
+        }
+      });
+  for (char *text : suffixOutputs) {
+    free(text);
+  }
+
+  static const char FUNCTION_COMMAND[] = "{:retro_replace_space:2:-}";
+  static const char SUFFIX_COMMAND[] = "{^ing}";
+  static const char KEY_PRESS_COMMAND[] = "{#Control_L(BackSpace) Shift_L(a)}";
+  keyCodeBuffer->Prepare(&orthography, &dictionary, keyCodeBuffer->context);
+  const auto runCommand = [&](const char *command, size_t length) {
+    keyCodeBuffer->Reset();
+    keyCodeBuffer->ProcessText("look up", 7);
+    keyCodeBuffer->ProcessCommand(command, length);
+  };
+  Microbenchmark::Run("KeyCodeBuffer::ProcessCommand (function)", 1, [&] {
+    runCommand(FUNCTION_COMMAND, Str::Length<>(FUNCTION_COMMAND));
+  });
+  Microbenchmark::Run("KeyCodeBuffer::ProcessCommand (suffix)", 1, [&] {
+    runCommand(SUFFIX_COMMAND, Str::Length<>(SUFFIX_COMMAND));
+  });
+  Microbenchmark::Run("KeyCodeBuffer::ProcessCommand (keys)", 1, [&] {
+    runCommand(KEY_PRESS_COMMAND, Str::Length<>(KEY_PRESS_COMMAND));
+  });
+
+  // A long paragraph with one word added. The watermark covers the text that
+  // both buffers were populated with.
+  StenoKeyCodeBuffer *nextKeyCodeBuffer = new StenoKeyCodeBuffer;
+  const auto populateParagraph = [&](StenoKeyCodeBuffer *buffer) {
+    buffer->Reset();
+    const size_t length = Str::Length<>(LONG_DEFINITION);
+    while (buffer->count + length + 1 < StenoKeyCodeBuffer::BUFFER_SIZE / 2) {
+      buffer->AppendSpace();
+      buffer->AppendTextNoCaseModeOverride(LONG_DEFINITION, length,
+                                           StenoCaseMode::NORMAL);
+    }
+    buffer->SetWatermark();
+  };
+  populateParagraph(keyCodeBuffer);
+  populateParagraph(nextKeyCodeBuffer);
+  nextKeyCodeBuffer->AppendText(" word", 5, StenoCaseMode::NORMAL);
+  const StenoKeyCodeEmitter emitter(engineContext);
+  Microbenchmark::Run("Emitter::Process (paragraph)", 1, [&] {
+    emitter.Process(*keyCodeBuffer, *nextKeyCodeBuffer);
+  });
+  Microbenchmark::Run("Emitter::Process (watermark)", 1, [&] {
+    emitter.ProcessFromWatermark(*keyCodeBuffer, *nextKeyCodeBuffer);
+  });
+
+  // Key events are one report each without coalescing.
+  const auto measureReports = [&](const char *name,
+                                  const StenoKeyCodeBuffer &previous,
+                                  const StenoKeyCodeBuffer &next) {
+    Key::EnableHistory();
+    emitter.Process(previous, next);
+    Key::DisableHistory();
+
+    KeyboardReportBuilder builder;
+    for (const Key::HistoryEntry &entry : Key::history) {
+      if (entry.isPress) {
+        builder.Press(entry.code);
+      } else {
+        builder.Release(entry.code);
+      }
+    }
+    builder.Flush();
+
+    const double characterCount =
+        double(previous.count > next.count ? previous.count - next.count
+                                           : next.count - previous.count);
+    fprintf(stderr, "  %-32s %10.2f events/char %6.2f reports/char\n", name,
+            Key::history.size() / characterCount,
+            builder.GetReportCount() / characterCount);
+    Key::history.clear();
+  };
+  keyCodeBuffer->Reset();
+  measureReports("KeyboardReportBuilder (text)", *keyCodeBuffer,
+                 *nextKeyCodeBuffer);
+  measureReports("KeyboardReportBuilder (delete)", *nextKeyCodeBuffer,
+                 *keyCodeBuffer);
+  delete nextKeyCodeBuffer;
+  delete keyCodeBuffer;
+
+  // A layout with many non-ASCII entries, as used for accented or CJK output.
+  static const size_t LAYOUT_ENTRY_COUNT = 1024;
+  HostLayout *layout = (HostLayout *)malloc(
+      sizeof(HostLayout) + LAYOUT_ENTRY_COUNT * sizeof(HostLayoutEntry));
+  memcpy((void *)layout, &HostLayout::ansi, sizeof(HostLayout));
+  layout->entries.SetCount(LAYOUT_ENTRY_COUNT);
+  for (size_t i = 0; i < LAYOUT_ENTRY_COUNT; ++i) {
+    HostLayoutEntry &entry = begin(layout->entries)[i];
+    entry.unicode = 0x4e00 + 7 * i;
+    entry.length = 1;
+    entry.keyCodes[0] = KeyCode::A;
+  }
+  HostLayoutIndex *layoutIndex = new HostLayoutIndex;
+  layoutIndex->Build(*layout);
+  static const size_t UNICODE_QUERY_COUNT = 4096;
+  Microbenchmark::Run("HostLayout::GetSequence (search)", UNICODE_QUERY_COUNT,
+                      [&] {
+                        for (uint32_t i = 0; i < UNICODE_QUERY_COUNT; ++i) {
+                          layout->GetSequenceForUnicode(0x4e00 + 2 * i);
+                        }
+                      });
+  Microbenchmark::Run("HostLayout::GetSequence (index)", UNICODE_QUERY_COUNT,
+                      [&] {
+                        for (uint32_t i = 0; i < UNICODE_QUERY_COUNT; ++i) {
+                          layoutIndex->Find(0x4e00 + 2 * i);
+                        }
+                      });
+  delete layoutIndex;
+  free(layout);
+
+  static const char *const FUNCTION_NAMES[] = {
+      "retro_capitalise", "retro_upper", "stitch_last_word", "set_case",
+      "toggle_dictionary", "unknown_function",
+  };
+  static const size_t FUNCTION_NAME_COUNT =
+      sizeof(FUNCTION_NAMES) / sizeof(*FUNCTION_NAMES);
+  static const size_t FUNCTION_PASS_COUNT = 256;
+  Microbenchmark::Run(
+      "StenoKeyCodeBuffer::FindFunction",
+      FUNCTION_PASS_COUNT * FUNCTION_NAME_COUNT, [&] {
+        for (size_t i = 0; i < FUNCTION_PASS_COUNT; ++i) {
+          for (const char *name : FUNCTION_NAMES) {
+            StenoKeyCodeBuffer::FindFunction(name);
+          }
+        }
+      });
+
+  // Retro functions on freshly converted text, as when a stroke's
+  // translation ends with one.
+  StenoKeyCodeBuffer *retroKeyCodeBuffer = new StenoKeyCodeBuffer;
+  const auto resetRetroKeyCodeBuffer = [&] {
+    retroKeyCodeBuffer->Reset();
+    for (size_t i = 0; i < 40; ++i) {
+      retroKeyCodeBuffer->AppendText(" the quick", 10, StenoCaseMode::NORMAL);
+    }
+  };
+  Microbenchmark::Run("Retro title case (4 words)", 1, resetRetroKeyCodeBuffer,
+                      [&] { retroKeyCodeBuffer->RetroactiveTitleCase(4); });
+  Microbenchmark::Run("Retro quotes (4 words)", 1, resetRetroKeyCodeBuffer,
+                      [&] { retroKeyCodeBuffer->RetroactiveDoubleQuotes(4); });
+  Microbenchmark::Run("Retro title case (1 to 8 words)", 8,
+                      resetRetroKeyCodeBuffer, [&] {
+                        for (int i = 1; i <= 8; ++i) {
+                          retroKeyCodeBuffer->RetroactiveTitleCase(i);
+                        }
+                      });
+  delete retroKeyCodeBuffer;
+
+  Microbenchmark::Run("Dictionary::ReverseLookup", words.GetCount(), [&] {
+    for (const char *word : words) {
+      StenoReverseDictionaryLookup lookup(word);
+      dictionary.ReverseLookup(lookup);
+    }
+  });
+}
+
+// Replays every stroke into a single engine, as one long paragraph typed
+// without resets.
+static void MeasureParagraph(StenoDictionary &dictionary,
+                             const StenoCompiledOrthography &orthography,
+                             StenoEngineContext &engineContext,
+                             const StrokeLogParser &parser) {
+  fprintf(stderr, "Paragraph without resets (%zu strokes):\n",
+          parser.strokes.GetCount());
+
+  StenoEngine *engine = nullptr;
+  Microbenchmark::Run(
+      "Engine::ProcessStroke", parser.strokes.GetCount(),
+      [&] {
+        delete engine;
+        engine =
+            new StenoEngine(dictionary, orthography, nullptr, engineContext);
+      },
+      [&] {
+        for (const StenoStroke &stroke : parser.strokes) {
+          if (stroke == UNDO_STROKE) {
+            engine->ProcessUndo();
+          } else {
+            engine->ProcessStroke(stroke);
+          }
+        }
+      });
+
+  // Each stroke is undone and stroked again, as when correcting a misstroke.
+  Microbenchmark::Run(
+      "Engine::ProcessUndo and restroke", parser.strokes.GetCount(),
+      [&] {
+        delete engine;
+        engine =
+            new StenoEngine(dictionary, orthography, nullptr, engineContext);
+      },
+      [&] {
+        for (const StenoStroke &stroke : parser.strokes) {
+          if (stroke == UNDO_STROKE) {
+            continue;
+          }
+          engine->ProcessStroke(stroke);
+          engine->ProcessUndo();
+          engine->ProcessStroke(stroke);
+        }
+      });
+  delete engine;
+}
+
+//---------------------------------------------------------------------------
+
+static void PrintUsage() {
+  fprintf(stderr,
+          "Usage: benchmark [-d dictionary.json]... [-o orthography.json]\n"
+          "                 [-w words.json] [-n rounds] log-file...\n");
+  exit(1);
+}
+
+int main(int argc, const char **argv) {
+  List<const char *> dictionaryFilenames;
+  List<const char *> logFilenames;
+  const char *orthographyFilename = nullptr;
+  const char *wordListFilename = nullptr;
+  size_t roundCount = 5;
+
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (arg[0] == '-' && arg[1] != '\0' && arg[2] == '\0') {
+      if (i + 1 >= argc) {
+        PrintUsage();
+      }
+      const char *value = argv[++i];
+      switch (arg[1]) {
+      case 'd':
+        dictionaryFilenames.Add(value);
+        break;
+      case 'o':
+        orthographyFilename = value;
+        break;
+      case 'w':
+        wordListFilename = value;
+        break;
+      case 'n':
+        roundCount = atoi(value);
+        break;
+      default:
+        PrintUsage();
+      }
+    } else {
+      logFilenames.Add(arg);
+    }
+  }
+  if (logFilenames.IsEmpty() || roundCount == 0) {
+    PrintUsage();
+  }
+
+  // Key presses are not needed, only the text output.
+  Key::DisableHistory();
+
+  uint8_t *dictionaryMemory = (uint8_t *)calloc(DICTIONARY_MEMORY_SIZE, 1);
+  const StenoUserDictionaryData layout(dictionaryMemory,
+                                       DICTIONARY_MEMORY_SIZE);
+  StenoUserDictionary userDictionary(layout);
+  for (size_t i = dictionaryFilenames.GetCount(); i > 0; --i) {
+    LoadDictionary(userDictionary, dictionaryFilenames[i - 1]);
+  }
+
+  StenoCompactMapDictionary mainDictionary(TestDictionary::definition);
+  StenoDictionary *dictionaries[] = {
+      &userDictionary,
+      &StenoJeffShowStrokeDictionary::instance,
+      &StenoJeffPhrasingDictionary::instance,
+      &StenoJeffNumbersDictionary::instance,
+      &StenoEmilySymbolsDictionary::instance,
+      &mainDictionary,
+  };
+  StenoDictionaryList dictionaryList(
+      dictionaries, sizeof(dictionaries) / sizeof(*dictionaries));
+  CountingDictionary dictionary(&dictionaryList);
+
+  static WordList wordList =
+      wordListFilename ? LoadWordList(wordListFilename) : WordList::instance;
+  StenoEngineContext engineContext(wordList, HostLayout::ansi,
+                                   &NullWriter::instance);
+
+  static StenoOrthography orthographyData;
+  orthographyData = orthographyFilename ? LoadOrthography(orthographyFilename)
+                                        : StenoOrthography::emptyOrthography;
+  const StenoCompiledOrthography orthography(orthographyData, engineContext);
+
+  StrokeLogParser parser;
+  for (const char *filename : logFilenames) {
+    parser.Parse(filename);
+  }
+  parser.Finish();
+
+  // The first round warms caches and captures the transcript. Only later
+  // rounds are measured, unless there is only a single round.
+  TranscriptWriter writer;
+  ReplayResult result;
+  result.Reset();
+  Replay(result, dictionary, orthography, engineContext, parser, &writer);
+  if (roundCount > 1) {
+    result.Reset();
+    dictionary.lookupCount = 0;
+    dictionary.dictionaryForOutlineCount = 0;
+    dictionary.reverseLookupCount = 0;
+    for (size_t i = 1; i < roundCount; ++i) {
+      Replay(result, dictionary, orthography, engineContext, parser, nullptr);
+    }
+  }
+
+  result.latencies.Sort([](const uint32_t *a, const uint32_t *b) -> int {
+    return *a < *b ? -1 : *a > *b ? 1 : 0;
+  });
+
+  const double strokeCount = result.strokeCount;
+  fprintf(stderr, "Replayed %zu strokes in %zu sections, %zu rounds\n",
+          parser.strokes.GetCount(), parser.sections.GetCount(), roundCount);
+  fprintf(stderr, "  Strokes/s:              %.0f\n",
+          strokeCount / result.seconds);
+  fprintf(stderr,
+          "  Latency (ns):           p50 %u, p90 %u, p99 %u, p99.9 %u, "
+          "max %u\n",
+          result.GetPercentile(50), result.GetPercentile(90),
+          result.GetPercentile(99), result.GetPercentile(99.9),
+          result.GetPercentile(100));
+  if (MallocCount::IsAvailable()) {
+    fprintf(stderr, "  Mallocs/stroke:         %.2f\n",
+            result.mallocCount / strokeCount);
+  } else {
+    fprintf(stderr, "  Mallocs/stroke:         unavailable in this build\n");
+  }
+  fprintf(stderr, "  Lookups/stroke:         %.2f\n",
+          dictionary.lookupCount / strokeCount);
+  fprintf(stderr, "  Outline checks/stroke:  %.2f\n",
+          dictionary.dictionaryForOutlineCount / strokeCount);
+  fprintf(stderr, "  Reverse lookups/stroke: %.2f\n",
+          dictionary.reverseLookupCount / strokeCount);
+
+  MeasureStartup(dictionary, orthographyData, engineContext, parser);
+  MeasureParagraph(dictionary, orthography, engineContext, parser);
+
+  List<char *> words;
+  CollectWords(words, writer.buffer);
+  RunMicrobenchmarks(dictionary, orthographyData, orthography, engineContext,
+                     parser, words);
+
+  for (char *word : words) {
+    free(word);
+  }
+  free(dictionaryMemory);
+  return 0;
+}
+
+//---------------------------------------------------------------------------
@@ -0,0 +1,453 @@
+//---------------------------------------------------------------------------
+
+#include "tool_support.h"
+#include "../dictionary/user_dictionary.h"
+#include "../str.h"
+#include "../stroke_list_parser.h"
+#include "../utf8_pointer.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//---------------------------------------------------------------------------
+
+double GetSeconds() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+char *ReadFile(const char *filename) {
+  FILE *fp = fopen(filename, "rb");
+  if (fp == nullptr) {
+    fprintf(stderr, "Unable to open %s\n", filename);
+    exit(1);
+  }
+
+  fseek(fp, 0, SEEK_END);
+  const long length = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  char *data = (char *)malloc(length + 1);
+  if (fread(data, 1, length, fp) != (size_t)length) {
+    fprintf(stderr, "Unable to read %s\n", filename);
+    exit(1);
+  }
+  data[length] = '\0';
+  fclose(fp);
+  return data;
+}
+
+//---------------------------------------------------------------------------
+
+void JsonReader::Fail(const char *message, ...) {
+  fprintf(stderr, "%s: ", filename);
+  va_list args;
+  va_start(args, message);
+  vfprintf(stderr, message, args);
+  va_end(args);
+  fprintf(stderr, " near \"%.20s\"\n", p);
+  exit(1);
+}
+
+long JsonReader::ReadInteger() {
+  SkipWhitespace();
+  char *end;
+  const long value = strtol(p, &end, 10);
+  if (end == p) {
+    Fail("Expected integer");
+  }
+  p = end;
+  return value;
+}
+
+uint32_t JsonReader::ReadHex4() {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    const int digit = HexValue(*p);
+    if (digit < 0) {
+      Fail("Invalid \\u escape");
+    }
+    value = (value << 4) | digit;
+    ++p;
+  }
+  return value;
+}
+
+char *JsonReader::ReadString() {
+  Expect('"');
+
+  BufferWriter writer;
+  for (;;) {
+    const char c = *p++;
+    switch (c) {
+    case '\0':
+      Fail("Unterminated string");
+
+    case '"':
+      return writer.TerminateStringAndAdoptBuffer();
+
+    case '\\':
+      switch (*p++) {
+      case 'b':
+        writer.WriteByte('\b');
+        break;
+      case 'f':
+        writer.WriteByte('\f');
+        break;
+      case 'n':
+        writer.WriteByte('\n');
+        break;
+      case 'r':
+        writer.WriteByte('\r');
+        break;
+      case 't':
+        writer.WriteByte('\t');
+        break;
+      case 'u': {
+        uint32_t unicode = ReadHex4();
+        if (0xd800 <= unicode && unicode < 0xdc00 && p[0] == '\\' &&
+            p[1] == 'u') {
+          p += 2;
+          const uint32_t low = ReadHex4();
+          unicode = 0x10000 + ((unicode - 0xd800) << 10) + (low - 0xdc00);
+        }
+        char buffer[4];
+        Utf8Pointer utf8(buffer);
+        utf8.SetAndAdvance(unicode);
+        writer.Write(buffer, utf8.GetRawPointer() - buffer);
+        break;
+      }
+      case '\0':
+        Fail("Unterminated string");
+      default:
+        writer.WriteByte(p[-1]);
+        break;
+      }
+      break;
+
+    default:
+      writer.WriteByte(c);
+      break;
+    }
+  }
+}
+
+void JsonReader::SkipValue() {
+  SkipWhitespace();
+  switch (*p) {
+  case '"':
+    free(ReadString());
+    return;
+
+  case '{': {
+    bool first = true;
+    char *key;
+    while (NextMember(first, key)) {
+      free(key);
+      SkipValue();
+    }
+    return;
+  }
+
+  case '[': {
+    bool first = true;
+    while (NextElement(first)) {
+      SkipValue();
+    }
+    return;
+  }
+
+  default:
+    while (*p != '\0' && *p != ',' && *p != '}' && *p != ']' && *p != ' ' &&
+           *p != '\t' && *p != '\r' && *p != '\n') {
+      ++p;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+
+void LoadDictionary(StenoUserDictionary &dictionary,
+                           const char *filename) {
+  char *data = ReadFile(filename);
+  JsonReader reader(data, filename);
+
+  size_t entryCount = 0;
+  size_t skippedCount = 0;
+  bool first = true;
+  char *key;
+  while (reader.NextMember(first, key)) {
+    if (!reader.IsString()) {
+      reader.SkipValue();
+      free(key);
+      ++skippedCount;
+      continue;
+    }
+
+    char *definition = reader.ReadString();
+    StrokeListParser parser;
+    if (parser.Parse(key) && *parser.failureOrEnd == '\0' &&
+        dictionary.Add(parser.strokes, parser.length, definition)) {
+      ++entryCount;
+    } else {
+      ++skippedCount;
+    }
+    free(definition);
+    free(key);
+  }
+
+  fprintf(stderr, "Loaded %zu entries from %s", entryCount, filename);
+  if (skippedCount) {
+    fprintf(stderr, " (%zu skipped)", skippedCount);
+  }
+  fprintf(stderr, "\n");
+  free(data);
+}
+
+//---------------------------------------------------------------------------
+
+StenoOrthography LoadOrthography(const char *filename) {
+  char *data = ReadFile(filename);
+  JsonReader reader(data, filename);
+
+  static List<StenoOrthographyRule> rules;
+  static List<StenoOrthographyAlias> aliases;
+  static List<StenoOrthographyAutoSuffix> autoSuffixes;
+  StenoStroke autoSuffixMask;
+
+  bool first = true;
+  char *section;
+  while (reader.NextMember(first, section)) {
+    bool firstElement = true;
+    if (Str::Eq(section, "rules")) {
+      while (reader.NextElement(firstElement)) {
+        StenoOrthographyRule rule = {};
+        bool firstMember = true;
+        char *key;
+        while (reader.NextMember(firstMember, key)) {
+          if (Str::Eq(key, "pattern")) {
+            rule.testPattern = reader.ReadString();
+          } else if (Str::Eq(key, "replacement")) {
+            rule.replacement = reader.ReadString();
+          } else {
+            reader.SkipValue();
+          }
+          free(key);
+        }
+        if (rule.testPattern == nullptr || rule.replacement == nullptr) {
+          reader.Fail("Rule requires pattern and replacement");
+        }
+        rules.Add(rule);
+      }
+    } else if (Str::Eq(section, "aliases")) {
+      while (reader.NextElement(firstElement)) {
+        StenoOrthographyAlias alias = {};
+        bool firstMember = true;
+        char *key;
+        while (reader.NextMember(firstMember, key)) {
+          if (Str::Eq(key, "suffix")) {
+            alias.text = reader.ReadString();
+          } else if (Str::Eq(key, "alias")) {
+            alias.alias = reader.ReadString();
+          } else {
+            reader.SkipValue();
+          }
+          free(key);
+        }
+        if (alias.text == nullptr || alias.alias == nullptr) {
+          reader.Fail("Alias requires suffix and alias");
+        }
+        aliases.Add(alias);
+      }
+    } else if (Str::Eq(section, "auto-suffix")) {
+      while (reader.NextElement(firstElement)) {
+        StenoOrthographyAutoSuffix autoSuffix = {};
+        bool firstMember = true;
+        char *key;
+        while (reader.NextMember(firstMember, key)) {
+          if (Str::Eq(key, "key")) {
+            char *stroke = reader.ReadString();
+            autoSuffix.stroke.Set(stroke);
+            free(stroke);
+          } else if (Str::Eq(key, "suffix")) {
+            // Auto suffix text is appended to the lookup, and is stored
+            // with a leading space, matching the firmware data layout.
+            char *suffix = reader.ReadString();
+            autoSuffix.text = Str::Join(" ", suffix);
+            free(suffix);
+          } else {
+            reader.SkipValue();
+          }
+          free(key);
+        }
+        if (autoSuffix.stroke.IsEmpty() || autoSuffix.text == nullptr) {
+          reader.Fail("Auto-suffix requires key and suffix");
+        }
+        autoSuffixMask |= autoSuffix.stroke;
+        autoSuffixes.Add(autoSuffix);
+      }
+    } else {
+      reader.SkipValue();
+    }
+    free(section);
+  }
+  free(data);
+
+  StenoOrthography orthography = {
+      .rules = {rules.GetCount(), begin(rules)},
+      .aliases = {aliases.GetCount(), begin(aliases)},
+      .autoSuffixMask = autoSuffixMask,
+      .autoSuffixes = {autoSuffixes.GetCount(), begin(autoSuffixes)},
+      .reverseAutoSuffixes = {0, nullptr},
+  };
+  return orthography;
+}
+
+//---------------------------------------------------------------------------
+
+WordList LoadWordList(const char *filename) {
+  char *data = ReadFile(filename);
+  JsonReader reader(data, filename);
+
+  struct Entry {
+    char *word;
+    int score;
+  };
+  List<Entry> entries;
+  size_t dataLength = 1;
+
+  bool first = true;
+  char *word;
+  while (reader.NextMember(first, word)) {
+    const long rank = reader.ReadInteger();
+
+    // Word list data cannot represent empty words, or bytes that collide
+    // with the score bytes.
+    bool isValid = *word != '\0';
+    for (const char *p = word; *p; ++p) {
+      if (uint8_t(*p) >= 0xf0) {
+        isValid = false;
+      }
+    }
+    if (!isValid) {
+      free(word);
+      continue;
+    }
+
+    const int bitLength = rank > 0 ? 64 - __builtin_clzll(rank) : 1;
+    const int score = bitLength - 1 < WordList::MAX_SCORE ? bitLength - 1
+                                                          : WordList::MAX_SCORE;
+    entries.Add(Entry{.word = word, .score = score});
+    dataLength += Str::Length(word) + 1;
+  }
+  free(data);
+
+  entries.Sort([](const Entry *a, const Entry *b) -> int {
+    const int compare = strcmp(a->word, b->word);
+    return compare != 0 ? compare : a->score - b->score;
+  });
+
+  // Words are stored sorted, each followed by a score byte. The data starts
+  // with a dummy score byte so that the first word is found by the search.
+  uint8_t *wordListData = (uint8_t *)malloc(dataLength);
+  uint8_t *p = wordListData;
+  *p++ = 0xf0;
+  const char *lastWord = "";
+  for (const Entry &entry : entries) {
+    if (Str::Eq(entry.word, lastWord)) {
+      continue;
+    }
+    const size_t length = Str::Length(entry.word);
+    memcpy(p, entry.word, length);
+    p += length;
+    *p++ = 0xf0 | entry.score;
+    lastWord = entry.word;
+  }
+  for (const Entry &entry : entries) {
+    free(entry.word);
+  }
+
+  fprintf(stderr, "Loaded %zu words from %s\n", entries.GetCount(), filename);
+  return WordList(wordListData, p - wordListData);
+}
+
+//---------------------------------------------------------------------------
+
+void StrokeLogParser::EndSection() {
+  if (strokes.GetCount() == sectionStart) {
+    return;
+  }
+  // Section pointers are fixed up in Finish() once the stroke array stops
+  // growing.
+  sections.Add(Section{
+      .strokes = (const StenoStroke *)sectionStart,
+      .length = strokes.GetCount() - sectionStart,
+  });
+  sectionStart = strokes.GetCount();
+}
+
+void StrokeLogParser::Parse(const char *filename) {
+  char *data = ReadFile(filename);
+
+  size_t lineNumber = 0;
+  char *line = data;
+  while (*line) {
+    ++lineNumber;
+    char *lineEnd = strchr(line, '\n');
+    char *next = lineEnd ? lineEnd + 1 : line + strlen(line);
+    if (lineEnd) {
+      *lineEnd = '\0';
+    }
+
+    char *p = line;
+    while (*p == ' ' || *p == '\t' || *p == '\r') {
+      ++p;
+    }
+
+    if (*p == '\0') {
+      EndSection();
+    } else if (*p != '#') {
+      while (*p) {
+        char *tokenEnd = p;
+        while (*tokenEnd && *tokenEnd != ' ' && *tokenEnd != '\t' &&
+               *tokenEnd != '\r') {
+          ++tokenEnd;
+        }
+        const char terminator = *tokenEnd;
+        *tokenEnd = '\0';
+
+        StrokeListParser parser;
+        if (!parser.Parse(p) || *parser.failureOrEnd != '\0') {
+          fprintf(stderr, "%s:%zu: Invalid stroke \"%s\"\n", filename,
+                  lineNumber, p);
+          exit(1);
+        }
+        for (size_t i = 0; i < parser.length; ++i) {
+          strokes.Add(parser.strokes[i]);
+        }
+
+        *tokenEnd = terminator;
+        p = tokenEnd;
+        while (*p == ' ' || *p == '\t' || *p == '\r') {
+          ++p;
+        }
+      }
+    }
+    line = next;
+  }
+
+  EndSection();
+  free(data);
+}
+
+void StrokeLogParser::Finish() {
+  for (Section &section : sections) {
+    section.strokes = begin(strokes) + (size_t)section.strokes;
+  }
+}
+
+//---------------------------------------------------------------------------
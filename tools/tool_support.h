@@ -0,0 +1,200 @@
+//---------------------------------------------------------------------------
+//
+// Shared helpers for the host command line tools: file and JSON loading of
+// dictionaries, orthographies and word lists, and stroke log parsing.
+//
+//---------------------------------------------------------------------------
+
+#pragma once
+#include "../list.h"
+#include "../orthography.h"
+#include "../stroke.h"
+#include "../word_list.h"
+#include "../writer.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------
+
+class StenoUserDictionary;
+
+//---------------------------------------------------------------------------
+
+// Returns a monotonic time in seconds.
+double GetSeconds();
+
+// Returns the contents of filename as an allocated, nul terminated string.
+// Exits on failure.
+char *ReadFile(const char *filename);
+
+//---------------------------------------------------------------------------
+
+// Minimal reader for the subset of JSON used by dictionary and orthography
+// files.
+class JsonReader {
+public:
+  JsonReader(const char *p, const char *filename)
+      : p(p), filename(filename) {}
+
+  void Expect(char c) {
+    SkipWhitespace();
+    if (*p != c) {
+      Fail("Expected '%c'", c);
+    }
+    ++p;
+  }
+
+  bool Consume(char c) {
+    SkipWhitespace();
+    if (*p != c) {
+      return false;
+    }
+    ++p;
+    return true;
+  }
+
+  bool IsString() {
+    SkipWhitespace();
+    return *p == '"';
+  }
+
+  // Returns an allocated string.
+  char *ReadString();
+
+  long ReadInteger();
+
+  void SkipValue();
+
+  // Iterates over the members of an object, setting key to an allocated
+  // string for each.
+  bool NextMember(bool &first, char *&key) {
+    if (first) {
+      first = false;
+      Expect('{');
+      if (Consume('}')) {
+        return false;
+      }
+    } else if (!Consume(',')) {
+      Expect('}');
+      return false;
+    }
+    key = ReadString();
+    Expect(':');
+    return true;
+  }
+
+  bool NextElement(bool &first) {
+    if (first) {
+      first = false;
+      Expect('[');
+      return !Consume(']');
+    }
+    if (Consume(',')) {
+      return true;
+    }
+    Expect(']');
+    return false;
+  }
+
+  [[noreturn]] void Fail(const char *message, ...);
+
+private:
+  const char *p;
+  const char *filename;
+
+  void SkipWhitespace() {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+      ++p;
+    }
+  }
+
+  static int HexValue(int c) {
+    if ('0' <= c && c <= '9') {
+      return c - '0';
+    }
+    if ('a' <= c && c <= 'f') {
+      return c - 'a' + 10;
+    }
+    if ('A' <= c && c <= 'F') {
+      return c - 'A' + 10;
+    }
+    return -1;
+  }
+
+  uint32_t ReadHex4();
+};
+
+//---------------------------------------------------------------------------
+
+// The user dictionary emulates flash in RAM, sized generously enough that
+// large dictionaries do not run out of hash table slots.
+static const size_t DICTIONARY_MEMORY_SIZE = 64 * 1024 * 1024;
+
+void LoadDictionary(StenoUserDictionary &dictionary, const char *filename);
+
+// The loaded orthography lives for the duration of the process, so its lists
+// and strings are intentionally never freed.
+StenoOrthography LoadOrthography(const char *filename);
+
+// Loads a JSON object of words to frequency ranks, where 1 is the most common
+// word. Ranks are mapped to word list scores by their bit length, so that
+// each score covers twice as many words as the one before it. The word list
+// lives for the duration of the process.
+WordList LoadWordList(const char *filename);
+
+//---------------------------------------------------------------------------
+
+static const StenoStroke UNDO_STROKE(StrokeMask::STAR);
+
+// A run of strokes that starts from a reset engine state.
+struct Section {
+  const StenoStroke *strokes;
+  size_t length;
+};
+
+// Parses stroke logs into a single stroke array, recording reset boundaries.
+class StrokeLogParser {
+public:
+  void Parse(const char *filename);
+  void Finish();
+
+  List<StenoStroke> strokes;
+  List<Section> sections;
+
+private:
+  size_t sectionStart = 0;
+
+  void EndSection();
+};
+
+//---------------------------------------------------------------------------
+
+// Collects engine text output, applying backspaces as they arrive.
+class TranscriptWriter final : public IWriter {
+public:
+  void Write(const char *data, size_t length) final {
+    for (size_t i = 0; i < length; ++i) {
+      WriteByte(data[i]);
+    }
+  }
+
+  void WriteByte(char c) final {
+    if (c != '\b') {
+      buffer.Add(c);
+      return;
+    }
+
+    // Backspaces remove a whole UTF-8 character.
+    while (buffer.IsNotEmpty()) {
+      const uint8_t last = buffer.Back();
+      buffer.Pop();
+      if ((last & 0xc0) != 0x80) {
+        break;
+      }
+    }
+  }
+
+  List<char> buffer;
+};
+
+//---------------------------------------------------------------------------
@@ -0,0 +1,487 @@
+//---------------------------------------------------------------------------
+//
+// Host command line tool that transcribes stroke logs to text.
+//
+// Usage:
+//   transcribe [-d dictionary.json]... [-o orthography.json] [-j threads]
+//              [-s shard-strokes] [--space-after] log-file...
+//
+// Stroke logs contain outlines separated by whitespace, e.g. "KAT/-S TKOG".
+// Lines starting with '#' are ignored.
+//
+// Every file, and every blank line within a file, is a reset boundary: the
+// engine starts with a reset StenoState and an empty stroke history, so no
+// retro command or undo can reach across it.
+//
+// Long sections are also split at points where nothing can reach back:
+// strokes around the split translate to plain words, no outline spans it, and
+// no retro command, fingerspelling or undo follows within the look back
+// window. Each run after a split starts a new engine as if after a word.
+// Workers check that the engine before a split ended in a plain state, and
+// that no undo after it reached back into the window. Runs whose split fails
+// either check are transcribed again in order, with the run before them.
+//
+// Runs are grouped into shards, shards are transcribed in parallel with one
+// engine per run, and the results are written to stdout in input order.
+//
+// Dictionaries are Plover style JSON files, with earlier dictionaries taking
+// priority. The orthography uses the same JSON format as
+// sample-orthography.json.
+//
+// Throughput is reported on stderr.
+//
+//---------------------------------------------------------------------------
+
+#include "tool_support.h"
+#include "../dictionary/user_dictionary.h"
+#include "../engine.h"
+#include "../host_layout.h"
+#include "../key.h"
+#include "../str.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+//---------------------------------------------------------------------------
+
+// Strokes transcribed by a single engine.
+struct Run {
+  const StenoStroke *strokes;
+  size_t length;
+
+  // Starts at a split point within a section, rather than at a reset.
+  bool isSplit;
+  bool endsSection;
+
+  // Set by the worker. A run is a valid start unless an undo reached back to
+  // the split it starts at.
+  bool isValidStart;
+  bool hasSplitEndState;
+  char *text;
+  size_t textLength;
+};
+
+// A contiguous group of runs transcribed by a single worker.
+struct Shard {
+  size_t runStart;
+  size_t runEnd;
+  size_t strokeCount;
+};
+
+//---------------------------------------------------------------------------
+
+// Text that reaches back over earlier strokes or words.
+static bool IsReachingBack(const char *text) {
+  return text[0] == '=' || strstr(text, "{*") != nullptr ||
+         strstr(text, "{:") != nullptr || strstr(text, "{&") != nullptr;
+}
+
+class SplitFinder {
+public:
+  SplitFinder(const StenoDictionary &dictionary, StenoStroke autoSuffixMask)
+      : dictionary(dictionary), autoSuffixMask(autoSuffixMask),
+        maximumOutlineLength(dictionary.GetMaximumOutlineLength()) {
+    window = 2 * maximumOutlineLength + 8;
+    if (window > STENO_STROKE_HISTORY_SIZE / 2) {
+      window = STENO_STROKE_HISTORY_SIZE / 2;
+    }
+  }
+
+  // Strokes after a split that must not be undone.
+  size_t GetWindow() const { return window; }
+
+  // Adds runs for section, split at the first split point after every
+  // runStrokes strokes.
+  void AddRuns(List<Run> &runs, const Section &section,
+               size_t runStrokes) const;
+
+private:
+  const StenoDictionary &dictionary;
+  StenoStroke autoSuffixMask;
+  size_t maximumOutlineLength;
+  size_t window;
+
+  // Strokes within maximumOutlineLength of the split must translate to plain
+  // text, and none after it within the window may reach back.
+  bool IsSplitPoint(const StenoStroke *strokes, size_t index) const;
+};
+
+void SplitFinder::AddRuns(List<Run> &runs, const Section &section,
+                          size_t runStrokes) const {
+  size_t start = 0;
+  size_t index = runStrokes;
+  while (index + window <= section.length) {
+    if (!IsSplitPoint(section.strokes, index)) {
+      ++index;
+      continue;
+    }
+
+    runs.Add(Run{
+        .strokes = section.strokes + start,
+        .length = index - start,
+        .isSplit = start != 0,
+        .endsSection = false,
+    });
+    start = index;
+    index += runStrokes;
+  }
+
+  runs.Add(Run{
+      .strokes = section.strokes + start,
+      .length = section.length - start,
+      .isSplit = start != 0,
+      .endsSection = true,
+  });
+}
+
+bool SplitFinder::IsSplitPoint(const StenoStroke *strokes,
+                               size_t index) const {
+  if (index < maximumOutlineLength) {
+    return false;
+  }
+
+  const size_t nearEnd = index + maximumOutlineLength;
+  const size_t end = index + window;
+  for (size_t i = index - maximumOutlineLength; i < end; ++i) {
+    if (strokes[i] == UNDO_STROKE) {
+      return false;
+    }
+    if (i >= index && i < nearEnd &&
+        (strokes[i] & autoSuffixMask).IsNotEmpty()) {
+      return false;
+    }
+
+    for (size_t j = 1; j <= maximumOutlineLength && i + j <= end; ++j) {
+      StenoDictionaryLookupResult lookup = dictionary.Lookup(strokes + i, j);
+      if (!lookup.IsValid()) {
+        continue;
+      }
+
+      const char *text = lookup.GetText();
+      const bool isSafe =
+          i < nearEnd ? (i >= index || i + j <= index) &&
+                            !Str::Contains(text, '{') && text[0] != '='
+                      : !IsReachingBack(text);
+      lookup.Destroy();
+      if (!isSafe) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+
+struct TranscribeContext {
+  StenoDictionary *dictionary;
+  const StenoCompiledOrthography *orthography;
+  bool spaceAfter;
+  size_t splitWindow;
+
+  Run *runs;
+  const Shard *shards;
+  size_t shardCount;
+
+  pthread_mutex_t mutex;
+  size_t nextShardIndex;
+};
+
+static StenoEngine *CreateEngine(const TranscribeContext &context,
+                                 StenoEngineContext &engineContext,
+                                 const Run &run, IWriter *writer) {
+  StenoEngine *engine =
+      new StenoEngine(*context.dictionary, *context.orthography, nullptr,
+                      engineContext);
+  engine->SetSpaceAfter(context.spaceAfter);
+  engine->SetTextWriter(writer);
+  if (run.isSplit) {
+    engine->ContinueAfterText();
+  }
+  return engine;
+}
+
+// Returns false if an undo reached back within splitWindow strokes of the
+// start of the engine's history.
+static bool Transcribe(StenoEngine &engine, const Run &run,
+                       size_t splitWindow) {
+  bool result = true;
+  for (size_t i = 0; i < run.length; ++i) {
+    const StenoStroke stroke = run.strokes[i];
+    if (stroke == UNDO_STROKE) {
+      engine.ProcessUndo();
+      if (engine.GetHistoryCount() < splitWindow) {
+        result = false;
+      }
+    } else {
+      engine.ProcessStroke(stroke);
+    }
+  }
+  return result;
+}
+
+// The state a run after a split starts with.
+static bool IsSplitState(const StenoState &state) {
+  return state.caseMode == StenoCaseMode::NORMAL &&
+         state.overrideCaseMode == StenoCaseMode::NORMAL && !state.joinNext &&
+         !state.isGlue && state.spaceLength == 1 && state.spaceOffset == 0;
+}
+
+// Runs that follow a failed split are transcribed by the engine that
+// transcribed the run before them.
+static bool CanContinueAfter(const Run *runs, size_t index) {
+  return runs[index].endsSection ||
+         (runs[index].hasSplitEndState && runs[index + 1].isValidStart);
+}
+
+struct Worker {
+  TranscribeContext *context;
+  pthread_t thread;
+  size_t strokeCount;
+  double busySeconds;
+
+  void Run();
+  static void *EntryPoint(void *data) {
+    ((Worker *)data)->Run();
+    return nullptr;
+  }
+};
+
+void Worker::Run() {
+  // Each worker has its own engine context, so engines on different threads
+  // share no mutable state. Console output from the engine is discarded.
+  StenoEngineContext engineContext(WordList::instance, HostLayout::ansi,
+                                   &NullWriter::instance);
+
+  for (;;) {
+    pthread_mutex_lock(&context->mutex);
+    const size_t shardIndex = context->nextShardIndex++;
+    pthread_mutex_unlock(&context->mutex);
+    if (shardIndex >= context->shardCount) {
+      return;
+    }
+
+    const double startTime = GetSeconds();
+    const Shard &shard = context->shards[shardIndex];
+    for (size_t i = shard.runStart; i < shard.runEnd; ++i) {
+      ::Run &run = context->runs[i];
+
+      TranscriptWriter writer;
+      StenoEngine *engine =
+          CreateEngine(*context, engineContext, run, &writer);
+      run.isValidStart =
+          Transcribe(*engine, run, run.isSplit ? context->splitWindow : 0);
+      run.hasSplitEndState =
+          !run.endsSection && IsSplitState(engine->GetState());
+      delete engine;
+
+      if (run.endsSection) {
+        writer.WriteByte('\n');
+      }
+      run.textLength = writer.buffer.GetCount();
+      run.text = (char *)malloc(run.textLength);
+      memcpy(run.text, begin(writer.buffer), run.textLength);
+    }
+
+    busySeconds += GetSeconds() - startTime;
+    strokeCount += shard.strokeCount;
+  }
+}
+
+// Transcribes runs from index with a single engine, until the next run can
+// start from the split. Returns the index of the next run.
+static size_t TranscribeInOrder(const TranscribeContext &context,
+                                size_t index, TranscriptWriter &writer) {
+  StenoEngineContext engineContext(WordList::instance, HostLayout::ansi,
+                                   &NullWriter::instance);
+  StenoEngine *engine =
+      CreateEngine(context, engineContext, context.runs[index], &writer);
+  for (;;) {
+    const ::Run &run = context.runs[index];
+    Transcribe(*engine, run, 0);
+    if (run.endsSection) {
+      writer.WriteByte('\n');
+      break;
+    }
+    if (IsSplitState(engine->GetState()) &&
+        context.runs[index + 1].isValidStart) {
+      break;
+    }
+    ++index;
+  }
+  delete engine;
+  return index + 1;
+}
+
+//---------------------------------------------------------------------------
+
+static void PrintUsage() {
+  fprintf(stderr,
+          "Usage: transcribe [-d dictionary.json]... [-o orthography.json]\n"
+          "                  [-j threads] [-s shard-strokes] [--space-after]\n"
+          "                  log-file...\n");
+  exit(1);
+}
+
+int main(int argc, const char **argv) {
+  List<const char *> dictionaryFilenames;
+  List<const char *> logFilenames;
+  const char *orthographyFilename = nullptr;
+  size_t threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t shardStrokes = 4096;
+  bool spaceAfter = false;
+
+  for (int i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (Str::Eq(arg, "--space-after")) {
+      spaceAfter = true;
+    } else if (arg[0] == '-' && arg[1] != '\0' && arg[2] == '\0') {
+      if (i + 1 >= argc) {
+        PrintUsage();
+      }
+      const char *value = argv[++i];
+      switch (arg[1]) {
+      case 'd':
+        dictionaryFilenames.Add(value);
+        break;
+      case 'o':
+        orthographyFilename = value;
+        break;
+      case 'j':
+        threadCount = atoi(value);
+        break;
+      case 's':
+        shardStrokes = atoi(value);
+        break;
+      default:
+        PrintUsage();
+      }
+    } else {
+      logFilenames.Add(arg);
+    }
+  }
+  if (logFilenames.IsEmpty() || threadCount == 0) {
+    PrintUsage();
+  }
+
+  // Key presses are not needed, only the text output.
+  Key::DisableHistory();
+
+  // Engines only ever read the dictionary, so a single instance is shared by
+  // all workers. Lower priority dictionaries are loaded first so that higher
+  // priority entries replace them.
+  uint8_t *dictionaryMemory = (uint8_t *)calloc(DICTIONARY_MEMORY_SIZE, 1);
+  const StenoUserDictionaryData layout(dictionaryMemory,
+                                       DICTIONARY_MEMORY_SIZE);
+  StenoUserDictionary dictionary(layout);
+  for (size_t i = dictionaryFilenames.GetCount(); i > 0; --i) {
+    LoadDictionary(dictionary, dictionaryFilenames[i - 1]);
+  }
+
+  // Patterns are compiled here, before any workers start, as the pattern
+  // component allocator is not thread safe. Each engine takes its own copy
+  // of the compiled orthography, with a cache bound to its context.
+  static StenoOrthography orthographyData;
+  orthographyData = orthographyFilename ? LoadOrthography(orthographyFilename)
+                                        : StenoOrthography::emptyOrthography;
+  const StenoCompiledOrthography orthography(orthographyData);
+
+  StrokeLogParser parser;
+  for (const char *filename : logFilenames) {
+    parser.Parse(filename);
+  }
+  parser.Finish();
+
+  const SplitFinder splitFinder(dictionary, orthographyData.autoSuffixMask);
+  List<Run> runs;
+  for (const Section &section : parser.sections) {
+    splitFinder.AddRuns(runs, section, shardStrokes);
+  }
+
+  List<Shard> shards;
+  for (size_t i = 0; i < runs.GetCount();) {
+    Shard shard = {.runStart = i, .strokeCount = 0};
+    while (i < runs.GetCount() && shard.strokeCount < shardStrokes) {
+      shard.strokeCount += runs[i++].length;
+    }
+    shard.runEnd = i;
+    shards.Add(shard);
+  }
+
+  if (threadCount > shards.GetCount()) {
+    threadCount = shards.GetCount() ? shards.GetCount() : 1;
+  }
+
+  TranscribeContext context = {
+      .dictionary = &dictionary,
+      .orthography = &orthography,
+      .spaceAfter = spaceAfter,
+      .splitWindow = splitFinder.GetWindow(),
+      .runs = begin(runs),
+      .shards = begin(shards),
+      .shardCount = shards.GetCount(),
+      .mutex = PTHREAD_MUTEX_INITIALIZER,
+      .nextShardIndex = 0,
+  };
+
+  Worker *workers = new Worker[threadCount];
+  const double startTime = GetSeconds();
+  for (size_t i = 0; i < threadCount; ++i) {
+    workers[i] = Worker{.context = &context};
+    pthread_create(&workers[i].thread, nullptr, &Worker::EntryPoint,
+                   &workers[i]);
+  }
+  for (size_t i = 0; i < threadCount; ++i) {
+    pthread_join(workers[i].thread, nullptr);
+  }
+
+  size_t failedSplitCount = 0;
+  for (size_t i = 0; i < runs.GetCount();) {
+    if (CanContinueAfter(begin(runs), i)) {
+      fwrite(runs[i].text, 1, runs[i].textLength, stdout);
+      ++i;
+      continue;
+    }
+
+    TranscriptWriter writer;
+    const size_t next = TranscribeInOrder(context, i, writer);
+    fwrite(begin(writer.buffer), 1, writer.buffer.GetCount(), stdout);
+    failedSplitCount += next - i - 1;
+    i = next;
+  }
+  const double elapsedSeconds = GetSeconds() - startTime;
+
+  for (const Run &run : runs) {
+    free(run.text);
+  }
+  fflush(stdout);
+
+  const size_t strokeCount = parser.strokes.GetCount();
+  fprintf(stderr,
+          "Transcribed %zu strokes in %zu sections, %zu runs, %zu shards, "
+          "%zu threads\n",
+          strokeCount, parser.sections.GetCount(), runs.GetCount(),
+          shards.GetCount(), threadCount);
+  if (failedSplitCount != 0) {
+    fprintf(stderr, "  %zu splits transcribed again in order\n",
+            failedSplitCount);
+  }
+  fprintf(stderr, "Elapsed: %.3fs, %.0f strokes/s, %.0f strokes/s/core\n",
+          elapsedSeconds, strokeCount / elapsedSeconds,
+          strokeCount / elapsedSeconds / threadCount);
+  for (size_t i = 0; i < threadCount; ++i) {
+    const Worker &worker = workers[i];
+    fprintf(stderr, "  Thread %zu: %zu strokes, %.0f strokes/s\n", i,
+            worker.strokeCount,
+            worker.busySeconds > 0 ? worker.strokeCount / worker.busySeconds
+                                   : 0.0);
+  }
+
+  delete[] workers;
+  free(dictionaryMemory);
+  return 0;
+}
+
+//---------------------------------------------------------------------------
@@ -0,0 +1,70 @@
+//---------------------------------------------------------------------------
+
+#include "undo_snapshot.h"
+#include "segment.h"
+#include "steno_key_code_buffer.h"
+#include "stroke_history.h"
+#include <string.h>
+
+//---------------------------------------------------------------------------
+
+bool StenoUndoSnapshot::SetStates(const StenoStrokeHistory &history,
+                                  size_t stateCount,
+                                  const StenoSegmentList &previousSegments) {
+  if (stateCount > STATE_CAPACITY) {
+    return false;
+  }
+
+  // history.Back() is the current stroke.
+  assert(stateCount < history.GetCount());
+  this->stateCount = stateCount;
+  for (size_t i = 0; i < stateCount; ++i) {
+    states[i] = history.Back(stateCount + 1 - i).state;
+  }
+  StenoStrokeHistory::UpdateDefinitionBoundaries(states, stateCount,
+                                                 previousSegments);
+  return true;
+}
+
+bool StenoUndoSnapshot::SetKeyCodes(const StenoKeyCodeBuffer &previous,
+                                    const StenoKeyCodeBuffer &next) {
+  size_t commonLength =
+      previous.watermark < next.watermark ? previous.watermark : next.watermark;
+  while (commonLength < previous.count && commonLength < next.count &&
+         previous.buffer[commonLength].HasSameOutput(
+             next.buffer[commonLength])) {
+    ++commonLength;
+  }
+
+  removedKeyCodeCount = next.count - commonLength;
+  restoredKeyCodeCount = previous.count - commonLength;
+  if (removedKeyCodeCount + restoredKeyCodeCount > KEY_CODE_CAPACITY) {
+    return false;
+  }
+
+  memcpy(keyCodes, next.buffer + commonLength,
+         removedKeyCodeCount * sizeof(StenoKeyCode));
+  memcpy(keyCodes + removedKeyCodeCount, previous.buffer + commonLength,
+         restoredKeyCodeCount * sizeof(StenoKeyCode));
+  return true;
+}
+
+//---------------------------------------------------------------------------
+
+bool StenoUndoSnapshotRing::CanUndo(const StenoStrokeHistory &history,
+                                    size_t count) const {
+  if (count > GetCount() || count > history.GetCount()) {
+    return false;
+  }
+
+  for (size_t i = 1; i <= count; ++i) {
+    const StenoUndoSnapshot &snapshot = Back(i);
+    if (!snapshot.isValid || snapshot.stroke != history.Back(i).stroke ||
+        snapshot.stateCount + i > history.GetCount()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
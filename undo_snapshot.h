@@ -0,0 +1,101 @@
+//---------------------------------------------------------------------------
+
+#pragma once
+#include "cyclic_queue.h"
+#include "state.h"
+#include "steno_key_code.h"
+#include "stroke.h"
+#include <assert.h>
+#include <stddef.h>
+
+//---------------------------------------------------------------------------
+
+// Number of strokes that can be undone without converting the stroke history
+// again. Must be a power of 2.
+#if !defined(JAVELIN_UNDO_SNAPSHOT_COUNT)
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
+#define JAVELIN_UNDO_SNAPSHOT_COUNT 4
+#else
+#define JAVELIN_UNDO_SNAPSHOT_COUNT 16
+#endif
+#endif
+
+// Key codes kept per snapshot, shared between the text a stroke added and the
+// text it replaced. Strokes that change more text are undone by conversion.
+//
+// Each snapshot takes 4 bytes per key code plus about 90 bytes, so the device
+// defaults use 1.1kB of RAM.
+#if !defined(JAVELIN_UNDO_SNAPSHOT_KEY_CODE_COUNT)
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
+#define JAVELIN_UNDO_SNAPSHOT_KEY_CODE_COUNT 48
+#else
+#define JAVELIN_UNDO_SNAPSHOT_KEY_CODE_COUNT 128
+#endif
+#endif
+
+//---------------------------------------------------------------------------
+
+class StenoKeyCodeBuffer;
+class StenoSegmentList;
+class StenoStrokeHistory;
+
+//---------------------------------------------------------------------------
+
+// What is needed to undo a single normal mode stroke:
+//
+//  * The key codes the stroke changed, before and after.
+//  * The states of the strokes before it, with the definition boundaries
+//    from converting without the stroke.
+struct StenoUndoSnapshot {
+  static const size_t STATE_CAPACITY = 16;
+  static const size_t KEY_CODE_CAPACITY = JAVELIN_UNDO_SNAPSHOT_KEY_CODE_COUNT;
+
+  bool isValid;
+  StenoStroke stroke;
+  size_t stateCount;
+  size_t removedKeyCodeCount;
+  size_t restoredKeyCodeCount;
+  StenoState states[STATE_CAPACITY];
+
+  // Removed key codes, followed by restored key codes.
+  StenoKeyCode keyCodes[KEY_CODE_CAPACITY];
+
+  // previousSegments were converted from the last stateCount strokes in
+  // history before the current stroke. Returns false if they don't fit.
+  bool SetStates(const StenoStrokeHistory &history, size_t stateCount,
+                 const StenoSegmentList &previousSegments);
+
+  // Records the key codes that differ between the buffers.
+  // Returns false if they don't fit.
+  bool SetKeyCodes(const StenoKeyCodeBuffer &previous,
+                   const StenoKeyCodeBuffer &next);
+
+  const StenoKeyCode *GetRemovedKeyCodes() const { return keyCodes; }
+  const StenoKeyCode *GetRestoredKeyCodes() const {
+    return keyCodes + removedKeyCodeCount;
+  }
+};
+
+//---------------------------------------------------------------------------
+
+// Snapshots for the most recent strokes in history, newest at the back.
+//
+// The snapshots always match the end of the stroke history: any stroke that
+// does not add a snapshot must reset them. When full, the oldest snapshot is
+// discarded, and undo falls back to conversion once they run out.
+class StenoUndoSnapshotRing
+    : public CyclicQueue<StenoUndoSnapshot, JAVELIN_UNDO_SNAPSHOT_COUNT> {
+public:
+  StenoUndoSnapshot &Add() {
+    if (IsFull()) {
+      RemoveFront();
+    }
+    return CyclicQueue::Add();
+  }
+
+  // Returns true if the last count strokes in history can be undone from
+  // snapshots.
+  bool CanUndo(const StenoStrokeHistory &history, size_t count) const;
+};
+
+//---------------------------------------------------------------------------
@@ -6,39 +6,275 @@
 
 //---------------------------------------------------------------------------
 
-static uint32_t Lookup(uint32_t c, const UnicodePair *data, size_t length) {
-  size_t left = 0;
-  size_t right = length;
-  while (left < right) {
-    const size_t mid = (left + right) / 2;
-    const uint32_t midKey = data[mid].key;
-
-    if (c < midKey) {
-      right = mid;
-    } else if (c > midKey) {
-      left = mid + 1;
-    } else {
-      return data[mid].value;
-    }
-  }
-  return c;
-}
+// Case mappings and letter classes are looked up in two stages: the high bits
+// of a code point select a page, and the low bits an entry in that page.
+// Pages with the same contents are shared. Both tables are built from
+// unicode_data.h at compile time.
+
+constexpr size_t UPPER_COUNT = sizeof(UPPER_DATA) / sizeof(*UPPER_DATA);
+constexpr size_t LOWER_COUNT = sizeof(LOWER_DATA) / sizeof(*LOWER_DATA);
+constexpr size_t LETTER_COUNT = sizeof(LETTER_DATA) / sizeof(*LETTER_DATA);
+
+//---------------------------------------------------------------------------
+
+struct UnicodeCaseDelta {
+  int32_t upper;
+  int32_t lower;
+};
+
+// Each entry is an index into a list of distinct case deltas, with entry 0
+// having no mapping.
+class UnicodeCaseTableBuilder {
+public:
+  static constexpr size_t PAGE_SHIFT = 6;
+  static constexpr size_t PAGE_SIZE = 1 << PAGE_SHIFT;
+  static constexpr uint32_t LIMIT =
+      (UPPER_DATA[UPPER_COUNT - 1].key > LOWER_DATA[LOWER_COUNT - 1].key
+           ? UPPER_DATA[UPPER_COUNT - 1].key
+           : LOWER_DATA[LOWER_COUNT - 1].key) +
+      1;
+  static constexpr size_t PAGE_INDEX_COUNT =
+      (LIMIT + PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+  static constexpr size_t MAXIMUM_PAGE_COUNT = 128;
+  static constexpr size_t MAXIMUM_DELTA_COUNT = 256;
+
+  uint8_t pageIndexes[PAGE_INDEX_COUNT] = {};
+  uint8_t pages[MAXIMUM_PAGE_COUNT][PAGE_SIZE] = {};
+  UnicodeCaseDelta deltas[MAXIMUM_DELTA_COUNT] = {};
+
+  // Page 0 and delta 0 are for code points with no mapping.
+  size_t pageCount = 1;
+  size_t deltaCount = 1;
 
-static bool Lookup(uint32_t c, const UnicodeRange *data, size_t length) {
-  size_t left = 0;
-  size_t right = length;
-  while (left < right) {
-    const size_t mid = (left + right) / 2;
-    if (c < data[mid].begin) {
-      right = mid;
-    } else if (c > data[mid].end) {
-      left = mid + 1;
-    } else {
-      return c != data[mid].end;
+  // Checked at compile time, as the firmware is built without exceptions.
+  bool hasTooManyPages = false;
+  bool hasTooManyDeltas = false;
+
+  constexpr UnicodeCaseTableBuilder() {
+    size_t upperIndex = 0;
+    size_t lowerIndex = 0;
+    for (size_t pageIndex = 0; pageIndex < PAGE_INDEX_COUNT; ++pageIndex) {
+      const uint32_t pageBegin = pageIndex << PAGE_SHIFT;
+      const uint32_t pageEnd = pageBegin + PAGE_SIZE;
+
+      UnicodeCaseDelta pageDeltas[PAGE_SIZE] = {};
+      bool isEmpty = true;
+      for (; upperIndex < UPPER_COUNT && UPPER_DATA[upperIndex].key < pageEnd;
+           ++upperIndex) {
+        const UnicodePair &pair = UPPER_DATA[upperIndex];
+        pageDeltas[pair.key - pageBegin].upper = pair.value - pair.key;
+        isEmpty = false;
+      }
+      for (; lowerIndex < LOWER_COUNT && LOWER_DATA[lowerIndex].key < pageEnd;
+           ++lowerIndex) {
+        const UnicodePair &pair = LOWER_DATA[lowerIndex];
+        pageDeltas[pair.key - pageBegin].lower = pair.value - pair.key;
+        isEmpty = false;
+      }
+      if (isEmpty) {
+        continue;
+      }
+
+      uint8_t page[PAGE_SIZE] = {};
+      for (size_t i = 0; i < PAGE_SIZE; ++i) {
+        page[i] = AddDelta(pageDeltas[i]);
+      }
+      pageIndexes[pageIndex] = AddPage(page);
     }
   }
-  return false;
-}
+
+private:
+  constexpr uint8_t AddDelta(UnicodeCaseDelta delta) {
+    for (size_t i = 0; i < deltaCount; ++i) {
+      if (deltas[i].upper == delta.upper && deltas[i].lower == delta.lower) {
+        return i;
+      }
+    }
+    if (deltaCount == MAXIMUM_DELTA_COUNT) {
+      hasTooManyDeltas = true;
+      return 0;
+    }
+    deltas[deltaCount] = delta;
+    return deltaCount++;
+  }
+
+  constexpr uint8_t AddPage(const uint8_t *page) {
+    for (size_t i = 0; i < pageCount; ++i) {
+      size_t j = 0;
+      while (j < PAGE_SIZE && pages[i][j] == page[j]) {
+        ++j;
+      }
+      if (j == PAGE_SIZE) {
+        return i;
+      }
+    }
+    if (pageCount == MAXIMUM_PAGE_COUNT) {
+      hasTooManyPages = true;
+      return 0;
+    }
+    for (size_t j = 0; j < PAGE_SIZE; ++j) {
+      pages[pageCount][j] = page[j];
+    }
+    return pageCount++;
+  }
+};
+
+// The builder only exists during compilation, and the table is trimmed to
+// the pages and deltas it uses.
+template <size_t PAGE_COUNT, size_t DELTA_COUNT> class UnicodeCaseTable {
+public:
+  constexpr UnicodeCaseTable() {
+    const UnicodeCaseTableBuilder builder;
+    for (size_t i = 0; i < UnicodeCaseTableBuilder::PAGE_INDEX_COUNT; ++i) {
+      pageIndexes[i] = builder.pageIndexes[i];
+    }
+    for (size_t i = 0; i < PAGE_COUNT; ++i) {
+      for (size_t j = 0; j < UnicodeCaseTableBuilder::PAGE_SIZE; ++j) {
+        pages[i][j] = builder.pages[i][j];
+      }
+    }
+    for (size_t i = 0; i < DELTA_COUNT; ++i) {
+      deltas[i] = builder.deltas[i];
+    }
+  }
+
+  const UnicodeCaseDelta &Lookup(uint32_t c) const {
+    if (c >= UnicodeCaseTableBuilder::LIMIT) {
+      return deltas[0];
+    }
+    const uint8_t *page =
+        pages[pageIndexes[c >> UnicodeCaseTableBuilder::PAGE_SHIFT]];
+    return deltas[page[c & (UnicodeCaseTableBuilder::PAGE_SIZE - 1)]];
+  }
+
+private:
+  uint8_t pageIndexes[UnicodeCaseTableBuilder::PAGE_INDEX_COUNT] = {};
+  uint8_t pages[PAGE_COUNT][UnicodeCaseTableBuilder::PAGE_SIZE] = {};
+  UnicodeCaseDelta deltas[DELTA_COUNT] = {};
+};
+
+static_assert(!UnicodeCaseTableBuilder().hasTooManyPages,
+              "Too many distinct case pages");
+static_assert(!UnicodeCaseTableBuilder().hasTooManyDeltas,
+              "Too many distinct case deltas");
+
+constexpr UnicodeCaseTable<UnicodeCaseTableBuilder().pageCount,
+                           UnicodeCaseTableBuilder().deltaCount>
+    CASE_TABLE;
+
+//---------------------------------------------------------------------------
+
+// Each page is a bit mask of which code points are letters.
+class UnicodeLetterTableBuilder {
+public:
+  static constexpr size_t PAGE_SHIFT = 8;
+  static constexpr size_t PAGE_SIZE = 1 << PAGE_SHIFT;
+  static constexpr size_t PAGE_WORD_COUNT = PAGE_SIZE / 32;
+  static constexpr uint32_t LIMIT = LETTER_DATA[LETTER_COUNT - 1].end;
+  static constexpr size_t PAGE_INDEX_COUNT =
+      (LIMIT + PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+  static constexpr size_t MAXIMUM_PAGE_COUNT = 256;
+
+  uint8_t pageIndexes[PAGE_INDEX_COUNT] = {};
+  uint32_t pages[MAXIMUM_PAGE_COUNT][PAGE_WORD_COUNT] = {};
+
+  // Page 0 has no letters.
+  size_t pageCount = 1;
+
+  // Checked at compile time, as the firmware is built without exceptions.
+  bool hasTooManyPages = false;
+
+  constexpr UnicodeLetterTableBuilder() {
+    size_t rangeIndex = 0;
+    for (size_t pageIndex = 0; pageIndex < PAGE_INDEX_COUNT; ++pageIndex) {
+      const uint32_t pageBegin = pageIndex << PAGE_SHIFT;
+      const uint32_t pageEnd = pageBegin + PAGE_SIZE;
+
+      uint32_t page[PAGE_WORD_COUNT] = {};
+      for (size_t i = rangeIndex;
+           i < LETTER_COUNT && LETTER_DATA[i].begin < pageEnd; ++i) {
+        const uint32_t begin =
+            LETTER_DATA[i].begin < pageBegin ? 0
+                                             : LETTER_DATA[i].begin - pageBegin;
+        const uint32_t end =
+            LETTER_DATA[i].end > pageEnd ? PAGE_SIZE
+                                         : LETTER_DATA[i].end - pageBegin;
+        for (uint32_t c = begin; c < end;) {
+          // Set whole words at a time where possible.
+          const uint32_t wordEnd = (c | 31) + 1 < end ? (c | 31) + 1 : end;
+          const uint32_t bitCount = wordEnd - c;
+          const uint32_t mask =
+              bitCount == 32 ? 0xffffffff : ((1u << bitCount) - 1) << (c & 31);
+          page[c >> 5] |= mask;
+          c = wordEnd;
+        }
+      }
+      while (rangeIndex < LETTER_COUNT &&
+             LETTER_DATA[rangeIndex].end <= pageEnd) {
+        ++rangeIndex;
+      }
+      pageIndexes[pageIndex] = AddPage(page);
+    }
+  }
+
+private:
+  constexpr uint8_t AddPage(const uint32_t *page) {
+    for (size_t i = 0; i < pageCount; ++i) {
+      size_t j = 0;
+      while (j < PAGE_WORD_COUNT && pages[i][j] == page[j]) {
+        ++j;
+      }
+      if (j == PAGE_WORD_COUNT) {
+        return i;
+      }
+    }
+    if (pageCount == MAXIMUM_PAGE_COUNT) {
+      hasTooManyPages = true;
+      return 0;
+    }
+    for (size_t j = 0; j < PAGE_WORD_COUNT; ++j) {
+      pages[pageCount][j] = page[j];
+    }
+    return pageCount++;
+  }
+};
+
+template <size_t PAGE_COUNT> class UnicodeLetterTable {
+public:
+  constexpr UnicodeLetterTable() {
+    const UnicodeLetterTableBuilder builder;
+    for (size_t i = 0; i < UnicodeLetterTableBuilder::PAGE_INDEX_COUNT; ++i) {
+      pageIndexes[i] = builder.pageIndexes[i];
+    }
+    for (size_t i = 0; i < PAGE_COUNT; ++i) {
+      for (size_t j = 0; j < UnicodeLetterTableBuilder::PAGE_WORD_COUNT; ++j) {
+        pages[i][j] = builder.pages[i][j];
+      }
+    }
+  }
+
+  bool Lookup(uint32_t c) const {
+    if (c >= UnicodeLetterTableBuilder::LIMIT) {
+      return false;
+    }
+    const uint32_t *page =
+        pages[pageIndexes[c >> UnicodeLetterTableBuilder::PAGE_SHIFT]];
+    const size_t offset = c & (UnicodeLetterTableBuilder::PAGE_SIZE - 1);
+    return (page[offset >> 5] >> (offset & 31)) & 1;
+  }
+
+private:
+  uint8_t pageIndexes[UnicodeLetterTableBuilder::PAGE_INDEX_COUNT] = {};
+  uint32_t pages[PAGE_COUNT][UnicodeLetterTableBuilder::PAGE_WORD_COUNT] = {};
+};
+
+static_assert(!UnicodeLetterTableBuilder().hasTooManyPages,
+              "Too many distinct letter pages");
+
+constexpr UnicodeLetterTable<UnicodeLetterTableBuilder().pageCount>
+    LETTER_TABLE;
 
 //---------------------------------------------------------------------------
 
@@ -49,7 +285,7 @@ uint32_t Unicode::ToUpper(uint32_t c) {
     }
     return c + 'A' - 'a';
   }
-  return Lookup(c, UPPER_DATA, sizeof(UPPER_DATA) / sizeof(*UPPER_DATA));
+  return c + CASE_TABLE.Lookup(c).upper;
 }
 
 uint32_t Unicode::ToLower(uint32_t c) {
@@ -59,7 +295,7 @@ uint32_t Unicode::ToLower(uint32_t c) {
     }
     return c + 'a' - 'A';
   }
-  return Lookup(c, LOWER_DATA, sizeof(LOWER_DATA) / sizeof(*LOWER_DATA));
+  return c + CASE_TABLE.Lookup(c).lower;
 }
 
 bool Unicode::IsLetter(uint32_t c) {
@@ -67,7 +303,7 @@ bool Unicode::IsLetter(uint32_t c) {
     c |= 0x20;
     return 'a' <= c && c <= 'z';
   }
-  return Lookup(c, LETTER_DATA, sizeof(LETTER_DATA) / sizeof(*LETTER_DATA));
+  return LETTER_TABLE.Lookup(c);
 }
 
 #if JAVELIN_CPU_CORTEX_M0 || JAVELIN_CPU_CORTEX_M4
@@ -100,3 +336,37 @@ bool Unicode::IsWordCharacter(uint32_t c) {
 }
 
 //---------------------------------------------------------------------------
+
+#include "unit_test.h"
+
+TEST_BEGIN("Unicode: Tables match unicode data") {
+  size_t upperIndex = 0;
+  size_t lowerIndex = 0;
+  size_t letterIndex = 0;
+  for (uint32_t c = 0; c < 0x110000; ++c) {
+    uint32_t upper = c;
+    if (upperIndex < UPPER_COUNT && UPPER_DATA[upperIndex].key == c) {
+      upper = UPPER_DATA[upperIndex++].value;
+    }
+    uint32_t lower = c;
+    if (lowerIndex < LOWER_COUNT && LOWER_DATA[lowerIndex].key == c) {
+      lower = LOWER_DATA[lowerIndex++].value;
+    }
+    while (letterIndex < LETTER_COUNT && LETTER_DATA[letterIndex].end <= c) {
+      ++letterIndex;
+    }
+    const bool isLetter =
+        letterIndex < LETTER_COUNT && LETTER_DATA[letterIndex].begin <= c;
+
+    if (c >= 128) {
+      assert(Unicode::ToUpper(c) == upper);
+      assert(Unicode::ToLower(c) == lower);
+      assert(Unicode::IsLetter(c) == isLetter);
+    }
+  }
+  assert(upperIndex == UPPER_COUNT);
+  assert(lowerIndex == LOWER_COUNT);
+}
+TEST_END
+
+//---------------------------------------------------------------------------
@@ -11,7 +11,7 @@ struct UnicodeRange {
   uint32_t end; // exclusive
 };
 
-const UnicodePair UPPER_DATA[] = {
+constexpr UnicodePair UPPER_DATA[] = {
     {181, 924},     {224, 192},     {225, 193},     {226, 194},
     {227, 195},     {228, 196},     {229, 197},     {230, 198},
     {231, 199},     {232, 200},     {233, 201},     {234, 202},
@@ -266,7 +266,7 @@ const UnicodePair UPPER_DATA[] = {
     {66639, 66599},
 };
 
-const UnicodePair LOWER_DATA[] = {
+constexpr UnicodePair LOWER_DATA[] = {
     {192, 224},     {193, 225},     {194, 226},     {195, 227},
     {196, 228},     {197, 229},     {198, 230},     {199, 231},
     {200, 232},     {201, 233},     {202, 234},     {203, 235},
@@ -519,7 +519,7 @@ const UnicodePair LOWER_DATA[] = {
     {66599, 66639},
 };
 
-const UnicodeRange LETTER_DATA[] = {
+constexpr UnicodeRange LETTER_DATA[] = {
     {170, 171},       {181, 182},       {186, 187},       {192, 215},
     {216, 247},       {248, 706},       {710, 722},       {736, 741},
     {748, 749},       {750, 751},       {880, 885},       {886, 888},
@@ -1,6 +1,46 @@
 //---------------------------------------------------------------------------
 
 #include "word_list.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------
+
+#if JAVELIN_WORD_LIST_INDEX_SPACING
+
+struct WordList::Index {
+  struct Sample {
+    // The first 4 bytes of the word, big endian and zero padded, so most
+    // comparisons don't read the word list data.
+    uint32_t key;
+
+    // Word start offset from data.min.
+    uint32_t offset;
+  };
+
+  // Samples with a first byte below c are before firstSamples[c].
+  uint32_t firstSamples[257];
+  uint32_t sampleCount;
+  Sample samples[];
+
+  // Bytes after the end of text are 0, as is the value byte after a word.
+  template <bool IS_DATA> static uint32_t GetKey(const uint8_t *text) {
+    uint32_t key = 0;
+    for (size_t i = 0; i < 4; ++i) {
+      const uint8_t c = *text;
+      if (c == 0 || (IS_DATA && IsValueByte(c))) {
+        // Shifting a 32-bit key by 32 is undefined.
+        return i == 0 ? 0 : key << (8 * (4 - i));
+      }
+      key = (key << 8) | c;
+      ++text;
+    }
+    return key;
+  }
+};
+
+#endif
 
 //---------------------------------------------------------------------------
 
@@ -49,14 +89,108 @@ inline const uint8_t *WordList::FindValueByteForward(const uint8_t *p) {
 #endif
 }
 
-int WordList::GetWordRank(const uint8_t *word, int defaultRank) {
-  if (ContainsEmoji(word)) {
-    return defaultRank;
+void WordList::BuildIndex() {
+#if JAVELIN_WORD_LIST_INDEX_SPACING
+  free((void *)index);
+  index = nullptr;
+
+  const size_t length = data.max - data.min;
+  if (length == 0) {
+    return;
+  }
+
+  const size_t maximumSampleCount =
+      (length + JAVELIN_WORD_LIST_INDEX_SPACING - 1) /
+      JAVELIN_WORD_LIST_INDEX_SPACING;
+  Index *newIndex = (Index *)malloc(
+      sizeof(Index) + maximumSampleCount * sizeof(Index::Sample));
+
+  // Only the bytes around each sample are read, so building the index
+  // doesn't scan the whole list. The byte before data.min is the dummy score.
+  size_t sampleCount = 0;
+  for (size_t position = 0; position < length;
+       position += JAVELIN_WORD_LIST_INDEX_SPACING) {
+    const uint8_t *wordStart =
+        FindValueByteForward(data.min + position - 1) + 1;
+    if (wordStart >= data.max) {
+      break;
+    }
+    const uint32_t offset = wordStart - data.min;
+    if (sampleCount == 0 ||
+        newIndex->samples[sampleCount - 1].offset != offset) {
+      newIndex->samples[sampleCount++] = {
+          .key = Index::GetKey<true>(wordStart),
+          .offset = offset,
+      };
+    }
+  }
+  newIndex->sampleCount = sampleCount;
+
+  size_t sampleIndex = 0;
+  for (size_t c = 0; c <= 256; ++c) {
+    while (sampleIndex < sampleCount &&
+           data.min[newIndex->samples[sampleIndex].offset] < c) {
+      ++sampleIndex;
+    }
+    newIndex->firstSamples[c] = sampleIndex;
+  }
+
+  index = newIndex;
+#endif
+}
+
+size_t WordList::GetIndexMemoryUsage() const {
+#if JAVELIN_WORD_LIST_INDEX_SPACING
+  return index ? sizeof(Index) + index->sampleCount * sizeof(Index::Sample)
+               : 0;
+#else
+  return 0;
+#endif
+}
+
+#if JAVELIN_WORD_LIST_INDEX_SPACING
+
+const uint8_t *WordList::SearchIndex(const uint8_t *word, const uint8_t *&left,
+                                     const uint8_t *&right) const {
+  // Keys order the same way as words, and the data is only compared when
+  // keys are equal.
+  const uint32_t key = Index::GetKey<false>(word);
+  size_t low = index->firstSamples[*word];
+  size_t high = index->firstSamples[*word + 1];
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    const Index::Sample &sample = index->samples[mid];
+    int compare;
+    if (key != sample.key) {
+      compare = key < sample.key ? -1 : 1;
+    } else {
+      compare = Compare(word, data.min + sample.offset);
+      if (compare == 0) {
+        left = data.min + sample.offset;
+        right = mid + 1 < index->sampleCount
+                    ? data.min + index->samples[mid + 1].offset
+                    : data.max;
+        return FindValueByteForward(left);
+      }
+    }
+    if (compare < 0) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
   }
 
-  const uint8_t *left = instance.data.min;
-  const uint8_t *right = instance.data.max;
+  // Samples before low are less than word, and the rest are greater.
+  left = low > 0 ? data.min + index->samples[low - 1].offset : data.min;
+  right = low < index->sampleCount ? data.min + index->samples[low].offset
+                                   : data.max;
+  return nullptr;
+}
+
+#endif
 
+const uint8_t *WordList::Search(const uint8_t *word, const uint8_t *&left,
+                                const uint8_t *right) {
   while (left < right) {
 #if JAVELIN_PLATFORM_PICO_SDK || JAVELIN_PLATFORM_NRF5_SDK
     // Optimization when top bit of pointer cannot be set.
@@ -75,12 +209,82 @@ int WordList::GetWordRank(const uint8_t *word, int defaultRank) {
       if (compare > 0) {
         left = wordEnd + 1;
       } else {
-        return *wordEnd & 0xf;
+        left = wordStart;
+        return wordEnd;
       }
     }
   }
 
-  return defaultRank;
+  return nullptr;
+}
+
+int WordList::GetRank(const uint8_t *word, int defaultRank) const {
+  if (ContainsEmoji(word)) {
+    return defaultRank;
+  }
+
+  const uint8_t *left = data.min;
+  const uint8_t *right = data.max;
+
+#if JAVELIN_WORD_LIST_INDEX_SPACING
+  if (index) {
+    const uint8_t *valueByte = SearchIndex(word, left, right);
+    if (valueByte) {
+      return *valueByte & 0xf;
+    }
+  }
+#endif
+
+  const uint8_t *valueByte = Search(word, left, right);
+  return valueByte ? *valueByte & 0xf : defaultRank;
+}
+
+void WordList::GetRanks(const char *const *words, int *ranks,
+                        size_t count) const {
+  assert(count <= MAXIMUM_BATCH_COUNT);
+
+  uint8_t order[MAXIMUM_BATCH_COUNT];
+  for (size_t i = 0; i < count; ++i) {
+    size_t j = i;
+    while (j > 0 && strcmp(words[order[j - 1]], words[i]) > 0) {
+      order[j] = order[j - 1];
+      --j;
+    }
+    order[j] = i;
+  }
+
+  // Each word is at or after the previous word's position, and words within
+  // the previous search range don't need the index.
+  const uint8_t *left = data.min;
+  const uint8_t *right = data.max;
+  bool hasRange = false;
+  for (size_t i = 0; i < count; ++i) {
+    const uint8_t *word = (const uint8_t *)words[order[i]];
+    if (ContainsEmoji(word)) {
+      continue;
+    }
+
+    if (hasRange && right < data.max && Compare(word, right) >= 0) {
+      hasRange = false;
+    }
+    const uint8_t *valueByte = nullptr;
+#if JAVELIN_WORD_LIST_INDEX_SPACING
+    if (!hasRange && index) {
+      const uint8_t *sampleLeft;
+      valueByte = SearchIndex(word, sampleLeft, right);
+      if (sampleLeft > left) {
+        left = sampleLeft;
+      }
+    }
+#endif
+    hasRange = true;
+    if (valueByte == nullptr) {
+      valueByte = Search(word, left, right);
+    }
+    if (valueByte) {
+      ranks[order[i]] = *valueByte & 0xf;
+    }
+  }
 }
 
 bool WordList::ContainsEmoji(const uint8_t *word) {
@@ -111,3 +315,46 @@ int WordList::Compare(const uint8_t *word, const uint8_t *data) {
 }
 
 //---------------------------------------------------------------------------
+
+#include "unit_test.h"
+
+TEST_BEGIN("WordList: Finds ranks across index samples") {
+  // Words "a0".."z9" and their "x" suffixed versions, with distinct ranks.
+  uint8_t data[1 + 26 * 10 * 7];
+  uint8_t *p = data;
+  *p++ = 0xf0;
+  for (char c = 'a'; c <= 'z'; ++c) {
+    for (char n = '0'; n <= '9'; ++n) {
+      *p++ = c;
+      *p++ = n;
+      *p++ = 0xf0 | (n - '0');
+      *p++ = c;
+      *p++ = n;
+      *p++ = 'x';
+      *p++ = 0xf0 | ((c - 'a') & 0xf);
+    }
+  }
+  const WordList wordList(data, p - data);
+  assert(JAVELIN_WORD_LIST_INDEX_SPACING == 0 ||
+         wordList.GetIndexMemoryUsage() != 0);
+
+  for (char c = 'a'; c <= 'z'; ++c) {
+    for (char n = '0'; n <= '9'; ++n) {
+      char word[4] = {c, n, '\0', '\0'};
+      assert(wordList.GetRank(word) == n - '0');
+      word[2] = 'x';
+      assert(wordList.GetRank(word) == ((c - 'a') & 0xf));
+      word[2] = 'y';
+      assert(wordList.GetRank(word) == -1);
+      word[1] = '\0';
+      assert(wordList.GetRank(word) == -1);
+    }
+  }
+  assert(wordList.GetRank("") == -1);
+  assert(wordList.GetRank("0") == -1);
+  assert(wordList.GetRank("zz") == -1);
+  assert(wordList.GetRank("\x7f") == -1);
+}
+TEST_END
+
+//---------------------------------------------------------------------------
@@ -1,5 +1,6 @@
 //---------------------------------------------------------------------------
 
+#include JAVELIN_BOARD_CONFIG
 #include "interval.h"
 #include "static_list.h"
 #include <stddef.h>
@@ -7,23 +8,64 @@
 
 //---------------------------------------------------------------------------
 
+// Word lists are indexed when their data is set, by sampling the first word
+// at or after every JAVELIN_WORD_LIST_INDEX_SPACING bytes. Lookups binary
+// search the samples with the same first byte, then only the data between
+// two samples.
+//
+// The index uses 8 bytes of RAM per sample, plus 1kB. 0 disables the index.
+#if !defined(JAVELIN_WORD_LIST_INDEX_SPACING)
+#if JAVELIN_PLATFORM_NRF5_SDK || JAVELIN_PLATFORM_PICO_SDK
+#define JAVELIN_WORD_LIST_INDEX_SPACING 1024
+#else
+#define JAVELIN_WORD_LIST_INDEX_SPACING 64
+#endif
+#endif
+
+//---------------------------------------------------------------------------
+
 using WordListData = StaticList<uint8_t>;
 
 //---------------------------------------------------------------------------
 
 class WordList {
 public:
-  static int GetWordRank(const uint8_t *word, int defaultScore = -1);
+  // Hosts running several engines can create word lists other than instance.
+  // As with SetData(), the data is expected to start with a dummy score.
+  WordList(const uint8_t *data, size_t length)
+      : data{.min = data + 1, .max = data + length} {
+    BuildIndex();
+  }
+
+  int GetRank(const uint8_t *word, int defaultScore = -1) const;
+  int GetRank(const char *word, int defaultScore = -1) const {
+    return GetRank((const uint8_t *)word, defaultScore);
+  }
+
+  // Sets ranks[i] for each of words that is in the list, leaving the others
+  // unchanged. Words are looked up in sorted order, in a single pass over the
+  // list, so words that are close together share most of the search.
+  void GetRanks(const char *const *words, int *ranks, size_t count) const;
+
+  static const size_t MAXIMUM_BATCH_COUNT = 16;
+
+  static int GetWordRank(const uint8_t *word, int defaultScore = -1) {
+    return instance.GetRank(word, defaultScore);
+  }
   static int GetWordRank(const char *word, int defaultScore = -1) {
-    return GetWordRank((const uint8_t *)word, defaultScore);
+    return instance.GetRank(word, defaultScore);
   }
 
   static void SetData(const WordListData &data) {
     // The firmware builder inserts a dummy score before the first word, so
     // offset by 1.
     instance.data.Set(begin(data) + 1, end(data));
+    instance.BuildIndex();
   }
 
+  // Returns 0 when there is no index.
+  size_t GetIndexMemoryUsage() const;
+
   static WordList instance;
 
   static const int MAX_SCORE = 0xf;
@@ -33,8 +75,27 @@ private:
 
   Interval<const uint8_t *> data;
 
+#if JAVELIN_WORD_LIST_INDEX_SPACING
+  struct Index;
+  const Index *index = nullptr;
+#endif
+
   static const uint8_t DATA[];
 
+  void BuildIndex();
+
+#if JAVELIN_WORD_LIST_INDEX_SPACING
+  // Narrows left and right to the samples around word. Returns the value
+  // byte of word if it's a sample, with left set to its start.
+  const uint8_t *SearchIndex(const uint8_t *word, const uint8_t *&left,
+                             const uint8_t *&right) const;
+#endif
+
+  // Returns the value byte of word if it's in [left, right). Otherwise
+  // returns nullptr, with left set to where word would be.
+  static const uint8_t *Search(const uint8_t *word, const uint8_t *&left,
+                               const uint8_t *right);
+
   static int Compare(const uint8_t *word, const uint8_t *data);
   static bool IsValueByte(uint8_t b) { return b >= 0xf0; };
   static bool ContainsEmoji(const uint8_t *word);